@@ -10,6 +10,8 @@ DISABLE_WARNINGS_PUSH()
 DISABLE_WARNINGS_POP()
 #include <exception>
 #include <filesystem>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 struct ShaderLoadingException : public std::runtime_error {
@@ -30,11 +32,13 @@ public:
 
     // Bind the uniform define by the given name to the given buffer and location in its assigned block, 
     void bindUniformBlock(const std::string& blockName, GLuint bindingLocation, GLuint uniformBlockBuffer) const;
+    // Assign the uniform block of the given name to the given location, for blocks whose buffer is bound there by another class
+    void setUniformBlockBinding(const std::string& blockName, GLuint bindingLocation) const;
 
     // Query an attribute location by its name in the shader
     GLuint getAttributeLocation(const std::string& name) const;
     
-    // Query a uniform location by its name in the shader
+    // Query a uniform location by its name in the shader (cached, so only the first query of a name reaches the driver)
     GLint getUniformLocation(const std::string& name) const;
 
 private:
@@ -43,6 +47,7 @@ private:
 
 private:
     GLuint m_program;
+    mutable std::unordered_map<std::string, GLint> m_uniformLocations;
 };
 
 class ShaderBuilder {
@@ -53,6 +58,8 @@ public:
     ~ShaderBuilder();
 
     ShaderBuilder& addStage(GLuint shaderStage, std::filesystem::path shaderFile);
+    // Capture the given vertex shader outputs with transform feedback (applied when the program is linked)
+    ShaderBuilder& setTransformFeedbackVaryings(std::vector<std::string> varyings, GLenum bufferMode);
     Shader build();
 
 private:
@@ -60,4 +67,6 @@ private:
 
 private:
     std::vector<GLuint> m_shaders;
+    std::vector<std::string> m_transformFeedbackVaryings;
+    GLenum m_transformFeedbackBufferMode { GL_SEPARATE_ATTRIBS };
 };
@@ -28,7 +28,9 @@ Shader::Shader()
 Shader::Shader(Shader&& other)
 {
     m_program = other.m_program;
+    m_uniformLocations = std::move(other.m_uniformLocations);
     other.m_program = invalid;
+    other.m_uniformLocations.clear();
 }
 
 Shader::~Shader()
@@ -43,7 +45,9 @@ Shader& Shader::operator=(Shader&& other)
         glDeleteProgram(m_program);
 
     m_program = other.m_program;
+    m_uniformLocations = std::move(other.m_uniformLocations);
     other.m_program = invalid;
+    other.m_uniformLocations.clear();
     return *this;
 }
 
@@ -64,6 +68,16 @@ void Shader::bindUniformBlock(const std::string& blockName, GLuint bindingLocati
     }
 }
 
+void Shader::setUniformBlockBinding(const std::string& blockName, GLuint bindingLocation) const
+{
+    GLuint blockIdx = glGetUniformBlockIndex(m_program, blockName.data());
+    if (blockIdx != GL_INVALID_INDEX) {
+        glUniformBlockBinding(m_program, blockIdx, bindingLocation);
+    } else {
+        std::cout << "Warning : Could not bind uniform block " << blockName << " invalid name" << std::endl;
+    }
+}
+
 GLuint Shader::getAttributeLocation(const std::string& name) const
 {
     GLuint loc = glGetAttribLocation(m_program, name.c_str());
@@ -75,10 +89,14 @@ GLuint Shader::getAttributeLocation(const std::string& name) const
 
 GLint Shader::getUniformLocation(const std::string& name) const
 {
+    if (auto iter = m_uniformLocations.find(name); iter != m_uniformLocations.end())
+        return iter->second;
+
     GLint loc = glGetUniformLocation(m_program, name.c_str());
     if (loc == GL_INVALID_INDEX) {
         std::cerr << "Warning : Could not find uniform " << name << std::endl;
     }
+    m_uniformLocations.emplace(name, loc);
     return loc;
 }
 
@@ -107,12 +125,25 @@ ShaderBuilder& ShaderBuilder::addStage(GLuint shaderStage, std::filesystem::path
     return *this;
 }
 
+ShaderBuilder& ShaderBuilder::setTransformFeedbackVaryings(std::vector<std::string> varyings, GLenum bufferMode)
+{
+    m_transformFeedbackVaryings = std::move(varyings);
+    m_transformFeedbackBufferMode = bufferMode;
+    return *this;
+}
+
 Shader ShaderBuilder::build()
 {
     // Combine vertex and fragment shaders into a single shader program.
     GLuint program = glCreateProgram();
     for (GLuint shader : m_shaders)
         glAttachShader(program, shader);
+    if (!m_transformFeedbackVaryings.empty()) {
+        std::vector<const char*> varyingPtrs;
+        for (const std::string& varying : m_transformFeedbackVaryings)
+            varyingPtrs.push_back(varying.c_str());
+        glTransformFeedbackVaryings(program, static_cast<GLsizei>(varyingPtrs.size()), varyingPtrs.data(), m_transformFeedbackBufferMode);
+    }
     glLinkProgram(program);
     freeShaders();
 
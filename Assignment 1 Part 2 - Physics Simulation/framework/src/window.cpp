@@ -34,27 +34,27 @@ Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersi
         exit(1);
     }
 
-    if (m_presentable) {
-        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
-
-        if (glVersion == OpenGLVersion::GL3) {
-            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-        } else if (glVersion == OpenGLVersion::GL41) {
-            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-            glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-        } else if (glVersion == OpenGLVersion::GL45) {
-            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
-            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-        }
+    // Non-presentable windows are hidden, but still get a context of the requested version for offscreen rendering
+    glfwWindowHint(GLFW_VISIBLE, m_presentable ? GLFW_TRUE : GLFW_FALSE);
+    if (glVersion == OpenGLVersion::GL3) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    } else if (glVersion == OpenGLVersion::GL41) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    } else if (glVersion == OpenGLVersion::GL45) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    }
 #ifndef NDEBUG // Automatically defined by CMake when compiling in Release/MinSizeRel mode.
-        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 #endif
 
+    if (m_presentable) {
         // HighDPI awareness
         // https://decovar.dev/blog/2019/08/04/glfw-dear-imgui/#high-dpi
 #ifdef _WIN32
@@ -70,8 +70,6 @@ Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersi
         // to prevent 1200x800 from becoming 2400x1600
         glfwWindowHint(GLFW_COCOA_RETINA_FRAMEBUFFER, GLFW_FALSE);
 #endif
-    } else {
-        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
     }
 
     // std::string_view does not guarantee that the string contains a terminator character.
@@ -91,27 +89,28 @@ Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersi
 
     glfwGetWindowSize(m_pWindow, &m_windowSize.x, &m_windowSize.y);
 
-    if (m_presentable) {
-        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-            glfwTerminate();
-            std::cerr << "Could not initialize GLEW" << std::endl;
-            exit(1);
-        }
-        int glVersionMajor, glVersionMinor;
-        glGetIntegerv(GL_MAJOR_VERSION, &glVersionMajor);
-        glGetIntegerv(GL_MINOR_VERSION, &glVersionMinor);
-        std::cout << "Initialized OpenGL version " << glVersionMajor << "." << glVersionMinor << std::endl;
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        glfwTerminate();
+        std::cerr << "Could not initialize GLEW" << std::endl;
+        exit(1);
+    }
+    int glVersionMajor, glVersionMinor;
+    glGetIntegerv(GL_MAJOR_VERSION, &glVersionMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &glVersionMinor);
+    std::cout << "Initialized OpenGL version " << glVersionMajor << "." << glVersionMinor << std::endl;
 
-        // NOTE(Mathijs): this is not supported on macOS since Apple can't be bothered to update
-        //  their OpenGL version past 4.1 which released in 2010!
+    // NOTE(Mathijs): this is not supported on macOS since Apple can't be bothered to update
+    //  their OpenGL version past 4.1 which released in 2010!
 #if !defined(__APPLE__) && defined(GL_DEBUG_SEVERITY_NOTIFICATION) && !defined(NDEBUG)
-        // Custom debug message with breakpoints at the exact error. Only supported on OpenGL 4.3 and higher.
-        if (glVersionMajor > 4 || (glVersionMajor == 4 && glVersionMinor >= 3)) {
-            glDebugMessageCallback(glDebugCallback, nullptr);
-            glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-        }
+    // Custom debug message with breakpoints at the exact error. Only supported on OpenGL 4.3 and higher.
+    if (glVersionMajor > 4 || (glVersionMajor == 4 && glVersionMinor >= 3)) {
+        glDebugMessageCallback(glDebugCallback, nullptr);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    }
 #endif
 
+    // Only presentable windows have a UI and receive input
+    if (m_presentable) {
         // Setup Dear ImGui context.
         ImGui::CreateContext();
         ImGuiIO& io = ImGui::GetIO();
@@ -245,8 +244,8 @@ void Window::swapBuffers()
 
 
 void Window::renderToImage (const std::filesystem::path& filePath, const bool flipY) {
-        std::vector <GLubyte> pixels;
-        pixels.reserve (4 * m_windowSize.x * m_windowSize.y);
+        // Synchronous, for single screenshots; FrameCapture records frame sequences without stalling
+        std::vector <GLubyte> pixels(4 * m_windowSize.x * m_windowSize.y);
 
         glReadPixels(0, 0, m_windowSize.x, m_windowSize.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
 
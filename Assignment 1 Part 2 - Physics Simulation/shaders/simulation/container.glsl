@@ -0,0 +1,47 @@
+#version 410
+
+// Container wall shared by the simulation shaders, which link this file into the same shader stage as their entry point
+// The wall is either the sphere of the SimulationParameters block, or a closed mesh placed in that sphere, whose signed
+// distance field is baked in the normalized space of the mesh (mirrors containerDistance() and containerNormal() in container_sdf.h)
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+uniform bool useContainerSdf;
+uniform sampler3D containerSdf;    // Signed distances at the voxel centers, negative inside, filtered trilinearly
+uniform vec3 containerSdfOrigin;   // Corner of the first voxel, in the normalized space of the mesh
+uniform vec3 containerSdfSize;     // Extent of all voxels together, in the normalized space of the mesh
+
+// Distance in the normalized space of the mesh; outside the field, it grows with the distance to its bounds
+float sampleContainerSdf(vec3 meshPos) {
+    vec3 clamped = clamp(meshPos, containerSdfOrigin, containerSdfOrigin + containerSdfSize);
+    return texture(containerSdf, (clamped - containerSdfOrigin) / containerSdfSize).r + distance(meshPos, clamped);
+}
+
+// Signed distance from the container wall, negative inside
+float containerDistance(vec3 pos) {
+    if (useContainerSdf) { return sampleContainerSdf((pos - containerCenter) / containerRadius) * containerRadius; }
+    return length(pos - containerCenter) - containerRadius;
+}
+
+// Outward normal of the container wall closest to the position; only evaluated on contact
+vec3 containerNormal(vec3 pos) {
+    if (useContainerSdf) {
+        // Central differences one voxel apart, falling back to the direction away from the center where the field is flat
+        vec3 meshPos    = (pos - containerCenter) / containerRadius;
+        vec3 voxel      = containerSdfSize / vec3(textureSize(containerSdf, 0));
+        vec3 gradient   = vec3(sampleContainerSdf(meshPos + vec3(voxel.x, 0.0, 0.0)) - sampleContainerSdf(meshPos - vec3(voxel.x, 0.0, 0.0)),
+                               sampleContainerSdf(meshPos + vec3(0.0, voxel.y, 0.0)) - sampleContainerSdf(meshPos - vec3(0.0, voxel.y, 0.0)),
+                               sampleContainerSdf(meshPos + vec3(0.0, 0.0, voxel.z)) - sampleContainerSdf(meshPos - vec3(0.0, 0.0, voxel.z)));
+        if (dot(gradient, gradient) > 0.0) { return normalize(gradient); }
+    }
+    return normalize(pos - containerCenter);
+}
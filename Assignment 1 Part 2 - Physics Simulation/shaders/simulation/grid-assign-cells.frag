@@ -0,0 +1,44 @@
+#version 410
+
+#define INVALID_CELL 0xFFFFFFFFu
+
+uniform sampler2D positions;
+uniform samplerBuffer positionBuffer;  // Used instead of positions by the transform-feedback backend
+uniform bool positionsInBuffer;
+uniform bool worldSpacePositions;      // Positions are not in the stored representation, e.g. the predicted positions of the position-based solver
+uniform uint numParticles;
+uniform uint sortTexWidth;
+uniform vec3 gridOrigin;
+uniform float gridCellSize;
+uniform ivec3 gridResolution;
+
+layout(location = 0) out uvec2 cellKey;
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+
+// Particle i is stored at texel (i % width, i / width) of the state textures, or at element i of the state buffer
+vec3 fetchPosition(uint idx) {
+    if (positionsInBuffer) { return decodePosition(texelFetch(positionBuffer, int(idx))); }
+    int width = textureSize(positions, 0).x;
+    vec4 texel = texelFetch(positions, ivec2(int(idx) % width, int(idx) / width), 0);
+    return worldSpacePositions ? texel.xyz : decodePosition(texel);
+}
+
+void main() {
+    // Linear index of the key written by this fragment, which is also the index of the particle it belongs to
+    uvec2 texel         = uvec2(gl_FragCoord.xy);
+    uint particleIdx    = texel.y * sortTexWidth + texel.x;
+
+    // Padding keys (beyond the particle count) get the largest cell index so they are sorted to the back
+    if (particleIdx >= numParticles) {
+        cellKey = uvec2(INVALID_CELL, particleIdx);
+        return;
+    }
+
+    // Clamp to the grid so particles that escaped the container still end up in a (boundary) cell
+    vec3 particlePos    = fetchPosition(particleIdx);
+    ivec3 cell          = clamp(ivec3(floor((particlePos - gridOrigin) / gridCellSize)), ivec3(0), gridResolution - 1);
+    uint cellIdx        = uint(cell.x + gridResolution.x * (cell.y + gridResolution.y * cell.z));
+    cellKey             = uvec2(cellIdx, particleIdx);
+}
@@ -0,0 +1,28 @@
+#version 410
+
+uniform usampler2D keys;
+uniform uint stageWidth;    // Size of the sequences being merged in this stage
+uniform uint passDistance;  // Distance between the two keys compared in this pass
+
+layout(location = 0) out uvec2 sortedKey;
+
+uvec2 fetchKey(uint idx, uint texWidth) { return texelFetch(keys, ivec2(idx % texWidth, idx / texWidth), 0).xy; }
+
+// Keys are ordered by cell index first and particle index second, which keeps the sort deterministic
+bool keyLess(uvec2 lhs, uvec2 rhs) { return lhs.x < rhs.x || (lhs.x == rhs.x && lhs.y < rhs.y); }
+
+void main() {
+    // Fetch the key of this fragment and the key it is compared against
+    uint texWidth   = uint(textureSize(keys, 0).x);
+    uvec2 texel     = uvec2(gl_FragCoord.xy);
+    uint idx        = texel.y * texWidth + texel.x;
+    uint partnerIdx = idx ^ passDistance;
+    uvec2 key       = fetchKey(idx, texWidth);
+    uvec2 partner   = fetchKey(partnerIdx, texWidth);
+
+    // Within ascending sequences the lower index keeps the smaller key, within descending ones the larger key
+    bool ascending  = (idx & stageWidth) == 0u;
+    bool keepMin    = ascending == (idx < partnerIdx);
+    bool partnerLess = keyLess(partner, key);
+    sortedKey       = (keepMin == partnerLess) ? partner : key;
+}
@@ -0,0 +1,10 @@
+#version 410
+
+layout(location = 0) flat in uint rangeBound;
+
+layout(location = 0) out uvec2 cellRange;
+
+void main() {
+    // Color mask selects whether the start (R) or end (G) of the range is written
+    cellRange = uvec2(rangeBound);
+}
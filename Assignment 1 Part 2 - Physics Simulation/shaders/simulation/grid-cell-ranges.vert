@@ -0,0 +1,35 @@
+#version 410
+
+uniform usampler2D sortedParticles;
+uniform uint numParticles;
+uniform uint cellTableWidth;
+uniform bool writeCellEnd;
+
+layout(location = 0) flat out uint rangeBound;
+
+uint fetchCell(int idx) {
+    int texWidth = textureSize(sortedParticles, 0).x;
+    return texelFetch(sortedParticles, ivec2(idx % texWidth, idx / texWidth), 0).x;
+}
+
+void main() {
+    // One point per sorted key; compare its cell against the previous (for start) or next (for end) key
+    int idx         = gl_VertexID;
+    uint cell       = fetchCell(idx);
+    int neighbour   = writeCellEnd ? idx + 1 : idx - 1;
+    bool isBound    = neighbour < 0 || neighbour >= int(numParticles) || fetchCell(neighbour) != cell;
+
+    // Cell ranges are [start, end), so the last key of a cell stores one past its index
+    rangeBound      = writeCellEnd ? uint(idx + 1) : uint(idx);
+    gl_PointSize    = 1.0;
+
+    // Keys that are not on a cell boundary are moved outside the clip volume
+    if (!isBound) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    // Place the point at the center of the texel belonging to the cell
+    vec2 tableTexel = vec2(cell % cellTableWidth, cell / cellTableWidth) + 0.5;
+    gl_Position     = vec4((tableTexel / float(cellTableWidth)) * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 410
+
+// Level of the hierarchical-Z buffer: the farthest depth of the 2x2 block of the level below, which is the only level of
+// previousLevel that can be sampled. Levels halve rounding down, so the last texel of an odd-sized level below covers three texels
+
+uniform sampler2D previousLevel;
+
+float previousDepth(ivec2 texel) {
+    return texelFetch(previousLevel, texel, 0).r;
+}
+
+void main() {
+    ivec2 previousSize  = textureSize(previousLevel, 0);
+    ivec2 levelTexel    = ivec2(gl_FragCoord.xy);
+    ivec2 firstTexel    = 2 * levelTexel;
+    ivec2 lastTexel     = min(firstTexel + 1, previousSize - 1);
+    if (levelTexel.x == max(previousSize.x / 2, 1) - 1) { lastTexel.x = previousSize.x - 1; }
+    if (levelTexel.y == max(previousSize.y / 2, 1) - 1) { lastTexel.y = previousSize.y - 1; }
+
+    float farthest = 0.0;
+    for (int y = firstTexel.y; y <= lastTexel.y; y++) {
+        for (int x = firstTexel.x; x <= lastTexel.x; x++) {
+            farthest = max(farthest, previousDepth(ivec2(x, y)));
+        }
+    }
+    gl_FragDepth = farthest;
+}
@@ -0,0 +1,28 @@
+#version 410
+
+uniform sampler2D visibleCount;
+uniform uint numMeshIndices;
+
+// Captured as a DrawElementsIndirectCommand for instanced meshes, followed by a DrawArraysIndirectCommand for instanced quads
+flat out uint meshCount;
+flat out uint meshInstanceCount;
+flat out uint meshFirstIndex;
+flat out uint meshBaseVertex;
+flat out uint meshBaseInstance;
+flat out uint quadCount;
+flat out uint quadInstanceCount;
+flat out uint quadFirst;
+flat out uint quadBaseInstance;
+
+void main() {
+    uint numVisible     = uint(texelFetch(visibleCount, ivec2(0, 0), 0).r + 0.5);
+    meshCount           = numMeshIndices;
+    meshInstanceCount   = numVisible;
+    meshFirstIndex      = 0u;
+    meshBaseVertex      = 0u;
+    meshBaseInstance    = 0u;
+    quadCount           = 4u;
+    quadInstanceCount   = numVisible;
+    quadFirst           = 0u;
+    quadBaseInstance    = 0u;
+}
@@ -0,0 +1,34 @@
+#version 410
+
+uniform sampler2D positions;
+uniform samplerBuffer positionBuffer;  // Used instead of positions by the transform-feedback backend
+uniform bool positionsInBuffer;
+uniform samplerBuffer particleProperties;   // R channel is the radius of particle i, at element i
+
+layout(location = 0) flat out uint vertexParticleIdx;
+layout(location = 1) flat out uint vertexVisible;
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+// Defined in particle-culling.glsl
+bool particleVisible(vec3 center, float radius);
+
+// Particle i is stored at texel (i % width, i / width) of the state textures, or at element i of the state buffer
+vec3 fetchPosition(uint idx) {
+    if (positionsInBuffer) { return decodePosition(texelFetch(positionBuffer, int(idx))); }
+    int width = textureSize(positions, 0).x;
+    return decodePosition(texelFetch(positions, ivec2(int(idx) % width, int(idx) / width), 0));
+}
+
+void main() {
+    // One point per particle, tested by its bounding sphere
+    uint particleIdx    = uint(gl_VertexID);
+    bool visible        = particleVisible(fetchPosition(particleIdx), texelFetch(particleProperties, int(particleIdx)).r);
+
+    vertexParticleIdx   = particleIdx;
+    vertexVisible       = visible ? 1u : 0u;
+
+    // Only used by the count pass, which rasterizes every visible particle onto the single texel of the count texture where
+    // blending sums them; culled particles land outside the viewport
+    gl_Position = vec4(visible ? 0.0 : 2.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,52 @@
+#version 410
+
+// Visibility of the bounding sphere of a particle, shared by every pass that skips culled particles, which link this file into
+// the same shader stage as their entry point (uniforms are set by ParticleCulling::setCullingUniforms())
+
+uniform bool frustumCulling;
+uniform vec4 frustumPlanes[6];      // World-space planes of the view frustum with inward unit normals, as (normal, offset)
+uniform bool occlusionCulling;
+uniform sampler2D hiZ;              // Farthest depth of the particles drawn in the previous frame, reduced over 2x2 blocks per level
+uniform mat4 hiZViewProjection;     // View-projection of the previous frame
+
+bool insideFrustum(vec3 center, float radius) {
+    for (int plane = 0; plane < 6; plane++) {
+        if (dot(frustumPlanes[plane].xyz, center) + frustumPlanes[plane].w < -radius) { return false; }
+    }
+    return true;
+}
+
+// Conservative: only true if the nearest depth of the bounding box of the sphere lies behind the farthest depth drawn over its
+// screen rectangle in the previous frame
+bool occluded(vec3 center, float radius) {
+    vec3 ndcMin = vec3(1.0), ndcMax = vec3(-1.0);
+    for (int corner = 0; corner < 8; corner++) {
+        vec3 offset = vec3(corner & 1, (corner >> 1) & 1, corner >> 2) * 2.0 - 1.0;
+        vec4 clip   = hiZViewProjection * vec4(center + radius * offset, 1.0);
+        if (clip.w <= 0.0 || clip.z < -clip.w) { return false; }   // Crosses the near plane
+        vec3 ndc    = clip.xyz / clip.w;
+        ndcMin      = corner == 0 ? ndc : min(ndcMin, ndc);
+        ndcMax      = corner == 0 ? ndc : max(ndcMax, ndc);
+    }
+
+    // Texel i of a level covers texels 2i and 2i + 1 of the level below (and 2i + 2 for the last texel of an odd-sized level),
+    // so the coarsest level where the rectangle spans at most 2x2 texels is found by shifting its pixel bounds
+    ivec2 baseSize  = textureSize(hiZ, 0);
+    ivec2 pixelMin  = clamp(ivec2(floor((ndcMin.xy * 0.5 + 0.5) * vec2(baseSize))), ivec2(0), baseSize - 1);
+    ivec2 pixelMax  = clamp(ivec2(floor((ndcMax.xy * 0.5 + 0.5) * vec2(baseSize))), ivec2(0), baseSize - 1);
+    int numLevels   = int(log2(float(max(baseSize.x, baseSize.y)))) + 1;
+    int level       = 0;
+    while (level < numLevels - 1 && any(greaterThan((pixelMax >> level) - (pixelMin >> level), ivec2(1)))) { level++; }
+
+    ivec2 levelSize = textureSize(hiZ, level);
+    ivec2 texelMin  = min(pixelMin >> level, levelSize - 1);
+    ivec2 texelMax  = min(pixelMax >> level, levelSize - 1);
+    float farthest  = max(max(texelFetch(hiZ, texelMin, level).r, texelFetch(hiZ, ivec2(texelMax.x, texelMin.y), level).r),
+                          max(texelFetch(hiZ, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(hiZ, texelMax, level).r));
+    return ndcMin.z * 0.5 + 0.5 > farthest;
+}
+
+bool particleVisible(vec3 center, float radius) {
+    if (frustumCulling && !insideFrustum(center, radius)) { return false; }
+    return !(occlusionCulling && occluded(center, radius));
+}
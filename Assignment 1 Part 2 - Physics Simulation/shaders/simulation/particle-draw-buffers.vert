@@ -0,0 +1,49 @@
+#version 410
+
+uniform samplerBuffer particleProperties;   // R channel is the radius of particle i, at element i
+uniform mat4 viewProjection;
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+
+// Per-instance particle state, sourced directly from the transform-feedback state buffers
+layout(location = 3) in vec4 instancePosition;
+layout(location = 4) in vec4 instanceVelocity;
+layout(location = 5) in vec4 instanceBounceData;
+
+layout(location = 0) out vec3 fragPosition;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec3 fragVelocity;
+layout(location = 3) out vec3 fragBounceData;
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+
+void main() {
+    vec3 particlePosition   = decodePosition(instancePosition);
+    vec3 particleVelocity   = instanceVelocity.xyz;
+    vec3 particleBounceData = instanceBounceData.rgb;
+    float particleRadius    = texelFetch(particleProperties, gl_InstanceID).r;
+    
+    // Compute world-space and NDC coordinates
+    vec3 worldSpacePosition = (position * particleRadius) + particlePosition;
+    gl_Position             = viewProjection * vec4(worldSpacePosition, 1);
+    
+    // Set output variables
+    fragPosition    = worldSpacePosition;
+    fragNormal      = normal;
+    fragVelocity    = particleVelocity;
+    fragBounceData  = particleBounceData;
+}
@@ -0,0 +1,67 @@
+#version 410
+
+// Particle state, either in the state textures (particle i at texel (i % width, i / width)) or in the transform-feedback state buffers
+uniform sampler2D positions;
+uniform sampler2D velocities;
+uniform sampler2D bounceData;
+uniform samplerBuffer positionBuffer;
+uniform samplerBuffer velocityBuffer;
+uniform samplerBuffer bounceDataBuffer;
+uniform bool stateInBuffers;
+uniform samplerBuffer particleProperties;   // R channel is the radius of particle i, at element i
+
+uniform mat4 viewProjection;
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+
+// Index of the particle drawn by this instance, from the compacted index buffer of the LOD
+layout(location = 3) in uint instanceParticleIdx;
+
+layout(location = 0) out vec3 fragPosition;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec3 fragVelocity;
+layout(location = 3) out vec3 fragBounceData;
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+
+void main() {
+    int particleIdx = int(instanceParticleIdx);
+    vec3 particlePosition, particleVelocity, particleBounceData;
+    if (stateInBuffers) {
+        particlePosition    = decodePosition(texelFetch(positionBuffer, particleIdx));
+        particleVelocity    = texelFetch(velocityBuffer, particleIdx).xyz;
+        particleBounceData  = texelFetch(bounceDataBuffer, particleIdx).rgb;
+    } else {
+        int stateTexWidth   = textureSize(positions, 0).x;
+        ivec2 dataTexel     = ivec2(particleIdx % stateTexWidth, particleIdx / stateTexWidth);
+        particlePosition    = decodePosition(texelFetch(positions, dataTexel, 0));
+        particleVelocity    = texelFetch(velocities, dataTexel, 0).xyz;
+        particleBounceData  = texelFetch(bounceData, dataTexel, 0).rgb;
+    }
+
+    float particleRadius = texelFetch(particleProperties, particleIdx).r;
+
+    // Compute world-space and NDC coordinates
+    vec3 worldSpacePosition = (position * particleRadius) + particlePosition;
+    gl_Position             = viewProjection * vec4(worldSpacePosition, 1);
+
+    // Set output variables
+    fragPosition    = worldSpacePosition;
+    fragNormal      = normal;
+    fragVelocity    = particleVelocity;
+    fragBounceData  = particleBounceData;
+}
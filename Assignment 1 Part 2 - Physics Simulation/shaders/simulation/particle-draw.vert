@@ -3,9 +3,19 @@
 uniform sampler2D positions;
 uniform sampler2D velocities;
 uniform sampler2D bounceData;
+uniform samplerBuffer particleProperties;   // R channel is the radius of particle i, at element i
 uniform mat4 viewProjection;
-uniform uint numParticles;
-uniform float particleRadius;
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
@@ -16,14 +26,17 @@ layout(location = 1) out vec3 fragNormal;
 layout(location = 2) out vec3 fragVelocity;
 layout(location = 3) out vec3 fragBounceData;
 
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+
 void main() {
-    // Fetch position and velocity of particle from position texture
-    // Half texel step ensures that we sample at the center of the relevant texel
-    float halfTexelStep     = 1.0f / (numParticles * 2.0f);  // NOTE: 0.5 / Texture width
-    vec2 dataTexIdx         = vec2((float(gl_InstanceID) + halfTexelStep) / float(numParticles), 0);
-    vec3 particlePosition   = texture(positions, dataTexIdx).xyz;
-    vec3 particleVelocity   = texture(velocities, dataTexIdx).xyz;
-    vec3 particleBounceData = texture(bounceData, dataTexIdx).rgb;
+    // Fetch position and velocity of particle from the state textures, which store particle i at texel (i % width, i / width)
+    int stateTexWidth       = textureSize(positions, 0).x;
+    ivec2 dataTexel         = ivec2(gl_InstanceID % stateTexWidth, gl_InstanceID / stateTexWidth);
+    vec3 particlePosition   = decodePosition(texelFetch(positions, dataTexel, 0));
+    vec3 particleVelocity   = texelFetch(velocities, dataTexel, 0).xyz;
+    vec3 particleBounceData = texelFetch(bounceData, dataTexel, 0).rgb;
+    float particleRadius    = texelFetch(particleProperties, gl_InstanceID).r;
     
     // Compute world-space and NDC coordinates
     vec3 worldSpacePosition = (position * particleRadius) + particlePosition;
@@ -0,0 +1,47 @@
+#version 410
+
+// Implemented in particle-shading.glsl
+vec3 shadeParticle(vec3 position, vec3 normal, vec3 velocity, vec3 bounceData);
+
+uniform mat4 viewProjection;
+uniform vec3 cameraPosition;
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+layout(location = 0) in vec3 fragPosition;
+layout(location = 1) flat in vec3 fragCenter;
+layout(location = 2) flat in vec3 fragVelocity;
+layout(location = 3) flat in vec3 fragBounceData;
+layout(location = 4) flat in float fragRadius;
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+    // Intersect the camera ray through this fragment with the particle sphere, and discard the corners of the quad it misses
+    vec3 rayDirection   = normalize(fragPosition - cameraPosition);
+    vec3 centerToCamera = cameraPosition - fragCenter;
+    float b             = dot(centerToCamera, rayDirection);
+    float c             = dot(centerToCamera, centerToCamera) - fragRadius * fragRadius;
+    float discriminant  = b * b - c;
+    if (discriminant < 0.0) { discard; }
+
+    // Nearest hit on the sphere surface
+    vec3 surfacePosition    = cameraPosition + (-b - sqrt(discriminant)) * rayDirection;
+    vec3 surfaceNormal      = (surfacePosition - fragCenter) / fragRadius;
+
+    // Depth of the surface rather than of the quad, so impostors intersect each other and the container correctly
+    vec4 clipPosition   = viewProjection * vec4(surfacePosition, 1.0);
+    float ndcDepth      = clipPosition.z / clipPosition.w;
+    gl_FragDepth        = 0.5 * (gl_DepthRange.diff * ndcDepth + gl_DepthRange.near + gl_DepthRange.far);
+
+    fragColor = vec4(shadeParticle(surfacePosition, surfaceNormal, fragVelocity, fragBounceData), 1.0);
+}
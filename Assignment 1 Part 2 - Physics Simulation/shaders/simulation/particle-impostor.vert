@@ -0,0 +1,78 @@
+#version 410
+
+// Particle state, either in the state textures (particle i at texel (i % width, i / width)) or in the transform-feedback state buffers
+uniform sampler2D positions;
+uniform sampler2D velocities;
+uniform sampler2D bounceData;
+uniform samplerBuffer positionBuffer;
+uniform samplerBuffer velocityBuffer;
+uniform samplerBuffer bounceDataBuffer;
+uniform bool stateInBuffers;
+uniform samplerBuffer particleProperties;   // R channel is the radius of particle i, at element i
+
+uniform mat4 viewProjection;
+uniform vec3 cameraPosition;
+uniform bool instancesCulled;  // Instances draw the compacted visible particles rather than particle gl_InstanceID
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+// Index of the particle drawn by this instance, from the compacted visible list when instancesCulled
+layout(location = 0) in uint instanceParticleIdx;
+
+layout(location = 0) out vec3 fragPosition;
+layout(location = 1) flat out vec3 fragCenter;
+layout(location = 2) flat out vec3 fragVelocity;
+layout(location = 3) flat out vec3 fragBounceData;
+layout(location = 4) flat out float fragRadius;
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+
+void main() {
+    int particleIdx = instancesCulled ? int(instanceParticleIdx) : gl_InstanceID;
+    vec3 particlePosition, particleVelocity, particleBounceData;
+    if (stateInBuffers) {
+        particlePosition    = decodePosition(texelFetch(positionBuffer, particleIdx));
+        particleVelocity    = texelFetch(velocityBuffer, particleIdx).xyz;
+        particleBounceData  = texelFetch(bounceDataBuffer, particleIdx).rgb;
+    } else {
+        int stateTexWidth   = textureSize(positions, 0).x;
+        ivec2 dataTexel     = ivec2(particleIdx % stateTexWidth, particleIdx / stateTexWidth);
+        particlePosition    = decodePosition(texelFetch(positions, dataTexel, 0));
+        particleVelocity    = texelFetch(velocities, dataTexel, 0).xyz;
+        particleBounceData  = texelFetch(bounceData, dataTexel, 0).rgb;
+    }
+
+    float particleRadius = texelFetch(particleProperties, particleIdx).r;
+
+    // Corner of the quad, drawn as a 4-vertex triangle strip
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+
+    // The quad passes through the particle center, facing the camera. Its half size is where the cone of rays touching the sphere
+    // crosses that plane, which is slightly larger than the radius under perspective
+    vec3 toParticle     = particlePosition - cameraPosition;
+    float distance      = length(toParticle);
+    vec3 viewDirection  = toParticle / distance;
+    vec3 right          = normalize(cross(viewDirection, abs(viewDirection.y) < 0.99 ? vec3(0, 1, 0) : vec3(1, 0, 0)));
+    vec3 up             = cross(right, viewDirection);
+    float halfSize      = particleRadius * distance / sqrt(max(distance * distance - particleRadius * particleRadius, 1e-6));
+
+    vec3 worldSpacePosition = particlePosition + halfSize * (corner.x * right + corner.y * up);
+    gl_Position             = viewProjection * vec4(worldSpacePosition, 1);
+
+    // Set output variables
+    fragPosition    = worldSpacePosition;
+    fragCenter      = particlePosition;
+    fragVelocity    = particleVelocity;
+    fragBounceData  = particleBounceData;
+    fragRadius      = particleRadius;
+}
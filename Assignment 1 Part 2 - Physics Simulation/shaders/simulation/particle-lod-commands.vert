@@ -0,0 +1,20 @@
+#version 410
+
+uniform sampler2D lodCounts;
+uniform uint lodIndexCounts[3];
+
+// Captured as a DrawElementsIndirectCommand, one per LOD
+flat out uint commandCount;
+flat out uint commandInstanceCount;
+flat out uint commandFirstIndex;
+flat out uint commandBaseVertex;
+flat out uint commandBaseInstance;
+
+void main() {
+    int lod                 = gl_VertexID;
+    commandCount            = lodIndexCounts[lod];
+    commandInstanceCount    = uint(texelFetch(lodCounts, ivec2(lod, 0), 0).r + 0.5);
+    commandFirstIndex       = 0u;
+    commandBaseVertex       = 0u;
+    commandBaseInstance     = 0u;
+}
@@ -0,0 +1,7 @@
+#version 410
+
+layout(location = 0) out float count;
+
+void main() {
+    count = 1.0;
+}
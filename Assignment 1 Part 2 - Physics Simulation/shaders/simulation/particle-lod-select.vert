@@ -0,0 +1,42 @@
+#version 410
+
+uniform sampler2D positions;
+uniform samplerBuffer positionBuffer;  // Used instead of positions by the transform-feedback backend
+uniform bool positionsInBuffer;
+uniform samplerBuffer particleProperties;   // R channel is the radius of particle i, at element i
+uniform vec3 cameraPosition;
+uniform float screenScale;             // Projected size in pixels of a unit length at unit distance from the camera
+uniform vec2 lodSwitchPixelRadii;      // Projected radius in pixels below which the second and third LOD are used
+uniform uint numLods;
+
+layout(location = 0) flat out uint vertexParticleIdx;
+layout(location = 1) flat out uint vertexLod;
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+// Defined in particle-culling.glsl
+bool particleVisible(vec3 center, float radius);
+
+// Particle i is stored at texel (i % width, i / width) of the state textures, or at element i of the state buffer
+vec3 fetchPosition(uint idx) {
+    if (positionsInBuffer) { return decodePosition(texelFetch(positionBuffer, int(idx))); }
+    int width = textureSize(positions, 0).x;
+    return decodePosition(texelFetch(positions, ivec2(int(idx) % width, int(idx) / width), 0));
+}
+
+void main() {
+    // One point per particle, the level of detail follows from the projected radius of the particle. Culled particles get
+    // numLods, which no LOD draws
+    uint particleIdx    = uint(gl_VertexID);
+    vec3 position       = fetchPosition(particleIdx);
+    float radius        = texelFetch(particleProperties, int(particleIdx)).r;
+    float pixelRadius   = radius * screenScale / max(length(position - cameraPosition), 1e-4);
+
+    vertexParticleIdx   = particleIdx;
+    vertexLod           = pixelRadius >= lodSwitchPixelRadii.x ? 0u : (pixelRadius >= lodSwitchPixelRadii.y ? 1u : 2u);
+    if (!particleVisible(position, radius)) { vertexLod = numLods; }
+
+    // Only used by the count pass, which rasterizes every particle onto texel (lod, 0) of the count texture where blending sums
+    // them; culled particles land outside the viewport
+    gl_Position = vec4((float(vertexLod) + 0.5) / float(numLods) * 2.0 - 1.0, 0.0, 0.0, 1.0);
+}
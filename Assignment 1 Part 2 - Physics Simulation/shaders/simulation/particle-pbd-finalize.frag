@@ -0,0 +1,84 @@
+#version 410
+
+// Position-based dynamics, last pass of a step: derive the velocity from the corrected position and update the bounce data
+
+#define COLLISION_OFFSET 0.001
+
+uniform sampler2D previousPositions;
+uniform sampler2D previousBounceData;
+uniform sampler2D predictedPositions;  // Corrected positions of the last iteration; alpha holds the constraint count of the first iteration
+
+// Per-particle properties, constant over the simulation (R channel is radius, G channel is mass, B channel is species)
+uniform samplerBuffer particleProperties;
+
+// Sleeping: a particle whose kinetic energy stays below the threshold for sleepSteps consecutive steps is put to sleep
+uniform bool sleepingEnabled;
+uniform float sleepEnergyThreshold;    // Kinetic energy per unit mass
+uniform int sleepSteps;
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+layout(location = 0) out vec4 finalPosition;
+layout(location = 1) out vec4 finalVelocity;
+layout(location = 2) out vec4 finalBounceData;
+
+// Defined in container.glsl
+float containerDistance(vec3 pos);
+vec3 containerNormal(vec3 pos);
+
+// Defined in particle-position.glsl
+vec4 encodePosition(vec3 position);
+vec3 decodePosition(vec4 texel);
+
+void main() {
+    // Linear index of the particle stored in this texel; texels past the last particle are padding
+    uint curr_i = uint(gl_FragCoord.y) * uint(textureSize(previousPositions, 0).x) + uint(gl_FragCoord.x);
+    if (curr_i >= numParticles) { discard; }
+
+    ivec2 texel         = ivec2(gl_FragCoord.xy);
+    vec3 prevPos        = decodePosition(texelFetch(previousPositions, texel, 0));  // 0: main mipmap
+    vec3 prevBounceData = texelFetch(previousBounceData, texel, 0).xyz;
+    vec4 corrected      = texelFetch(predictedPositions, texel, 0);
+    float radius        = texelFetch(particleProperties, int(curr_i)).r;
+
+    // Averaged corrections may leave a particle pressed slightly into the container, so it is projected back exactly
+    vec3 newPos             = corrected.xyz;
+    float distanceToWall    = containerDistance(newPos);
+    if (distanceToWall > -radius) {
+        newPos -= (distanceToWall + radius + COLLISION_OFFSET) * containerNormal(newPos);
+    }
+    vec3 newVel = (newPos - prevPos) / timestep;
+
+    // The B channel counts the consecutive slow steps. Sleeping particles are only simulated when a neighbour woke them,
+    // which restarts the count; a particle falls asleep at rest
+    float sleepCounter = 0.0;
+    if (sleepingEnabled) {
+        bool wasAsleep  = prevBounceData.z >= float(sleepSteps);
+        bool isSlow     = 0.5 * dot(newVel, newVel) < sleepEnergyThreshold;
+        sleepCounter    = isSlow && !wasAsleep ? min(prevBounceData.z + 1.0, float(sleepSteps)) : 0.0;
+        if (sleepCounter >= float(sleepSteps)) { newVel = vec3(0.0); }
+    }
+
+    // ===== Task 3: Blink Logic =====
+    // The A channel keeps the collisions of this step alone, for the statistics
+    int collisionCount  = int(prevBounceData.x) + int(corrected.w);
+    int frameCounter    = int(prevBounceData.y);
+    if (collisionCount >= bounceThreshold) {
+        frameCounter    = bounceFrames;
+        collisionCount  = 0; // Reset collision count
+    }
+    frameCounter = max(frameCounter - 1, 0);
+
+    finalPosition   = encodePosition(newPos);
+    finalVelocity   = vec4(newVel, 0.0);
+    finalBounceData = vec4(float(collisionCount), float(frameCounter), sleepCounter, corrected.w);
+}
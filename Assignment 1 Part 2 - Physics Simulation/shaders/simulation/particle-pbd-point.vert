@@ -0,0 +1,15 @@
+#version 410
+
+// One point per simulated particle, rasterized onto the texel of the particle in the state textures, so the position-based
+// solver passes only touch the particles on the active list when sleeping particles are skipped
+
+layout(location = 0) in uint activeParticleIdx;
+
+uniform bool useActiveList;     // Otherwise every particle is drawn, and the vertex index is the particle index
+uniform ivec2 stateTexSize;
+
+void main() {
+    int particleIdx = useActiveList ? int(activeParticleIdx) : gl_VertexID;
+    vec2 texel      = vec2(particleIdx % stateTexSize.x, particleIdx / stateTexSize.x) + 0.5;
+    gl_Position     = vec4(texel / vec2(stateTexSize) * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,41 @@
+#version 410
+
+// Position-based dynamics, first pass of a step: move every particle to its predicted position without any constraints
+
+uniform sampler2D previousPositions;
+uniform sampler2D previousVelocities;
+uniform bool keepPositions;    // Write the previous positions unchanged, for sleeping particles that neighbours read from the predicted positions
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+layout(location = 0) out vec4 predictedPosition;
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+
+void main() {
+    // Linear index of the particle stored in this texel; texels past the last particle are padding
+    uint curr_i = uint(gl_FragCoord.y) * uint(textureSize(previousPositions, 0).x) + uint(gl_FragCoord.x);
+    if (curr_i >= numParticles) { discard; }
+
+    ivec2 texel     = ivec2(gl_FragCoord.xy);
+    vec3 prevPos    = decodePosition(texelFetch(previousPositions, texel, 0));  // 0: main mipmap
+    vec3 prevVel    = texelFetch(previousVelocities, texel, 0).rgb;
+    if (keepPositions) {
+        predictedPosition = vec4(prevPos, 0.0);
+        return;
+    }
+
+    // Symplectic Euler; the velocity is derived from the corrected position at the end of the step
+    vec3 gravity        = vec3(0.0, -9.81, 0.0);
+    predictedPosition   = vec4(prevPos + (prevVel + gravity * timestep) * timestep, 0.0);
+}
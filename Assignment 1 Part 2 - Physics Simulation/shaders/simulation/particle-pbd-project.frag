@@ -0,0 +1,110 @@
+#version 410
+
+// Position-based dynamics, one Jacobi iteration: every particle gathers the corrections of all contact and container
+// constraints it takes part in, from the positions of the previous iteration, and moves by their average
+// Averaging keeps the simultaneous corrections from overshooting in dense piles (Macklin et al., Unified Particle Physics)
+
+uniform sampler2D predictedPositions;  // Positions of the previous iteration; alpha holds the constraint count of the first iteration
+uniform uint iteration;
+uniform float relaxation;               // Over-relaxation of the averaged correction
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+// Per-particle properties, constant over the simulation (R channel is radius, G channel is mass, B channel is species)
+uniform samplerBuffer particleProperties;
+
+// Uniform grid broad phase, built over the predicted positions once the prediction pass has written them
+uniform bool useUniformGrid;
+uniform usampler2D sortedParticles;    // (cell index, particle index) keys sorted by cell
+uniform usampler2D cellRanges;         // Per-cell [start, end) range into sortedParticles
+uniform vec3 gridOrigin;
+uniform float gridCellSize;
+uniform ivec3 gridResolution;
+
+layout(location = 0) out vec4 correctedPosition;
+
+// Defined in container.glsl
+float containerDistance(vec3 pos);
+vec3 containerNormal(vec3 pos);
+
+ivec2 tableTexel(uint idx, int tableWidth) { return ivec2(int(idx) % tableWidth, int(idx) / tableWidth); }
+
+vec3 fetchPredictedPosition(uint idx) {
+    int width = textureSize(predictedPositions, 0).x;
+    return texelFetch(predictedPositions, ivec2(int(idx) % width, int(idx) / width), 0).xyz;
+}
+
+// Non-penetration constraint |x_i - x_j| >= r_i + r_j: each particle takes the share of the correction of its inverse mass
+// (half for equal masses)
+void projectContact(vec3 pos, float radius, float mass, uint otherIdx, inout vec3 correction, inout int numConstraints) {
+    vec3 toOther            = pos - fetchPredictedPosition(otherIdx);
+    float dist              = length(toOther);
+    vec2 otherProperties    = texelFetch(particleProperties, int(otherIdx)).rg;
+    float contactDistance   = radius + otherProperties.x;
+    if (dist < contactDistance && dist > 0.0) {
+        float share = otherProperties.y / (mass + otherProperties.y);
+        correction += (share * (contactDistance - dist) / dist) * toOther;
+        numConstraints++;
+    }
+}
+
+void main() {
+    // Linear index of the particle stored in this texel; texels past the last particle are padding
+    uint curr_i = uint(gl_FragCoord.y) * uint(textureSize(predictedPositions, 0).x) + uint(gl_FragCoord.x);
+    if (curr_i >= numParticles) { discard; }
+
+    vec4 predicted      = texelFetch(predictedPositions, ivec2(gl_FragCoord.xy), 0);
+    vec3 pos            = predicted.xyz;
+    vec3 correction     = vec3(0.0);
+    int numConstraints  = 0;
+    vec2 properties     = texelFetch(particleProperties, int(curr_i)).rg;
+
+    if (interParticleCollision && useUniformGrid) {
+        // The iterations only move particles by their small corrections, so the grid of the predicted positions still covers all contacts
+        int sortedWidth = textureSize(sortedParticles, 0).x;
+        int tableWidth  = textureSize(cellRanges, 0).x;
+        ivec3 cell      = clamp(ivec3(floor((pos - gridOrigin) / gridCellSize)), ivec3(0), gridResolution - 1);
+        ivec3 minCell   = max(cell - 1, ivec3(0));
+        ivec3 maxCell   = min(cell + 1, gridResolution - 1);
+        for (int z = minCell.z; z <= maxCell.z; ++z) {
+            for (int y = minCell.y; y <= maxCell.y; ++y) {
+                for (int x = minCell.x; x <= maxCell.x; ++x) {
+                    uint cellIdx = uint(x + gridResolution.x * (y + gridResolution.y * z));
+                    uvec2 range = texelFetch(cellRanges, tableTexel(cellIdx, tableWidth), 0).xy;
+                    for (uint s = range.x; s < range.y; ++s) {
+                        uint i = texelFetch(sortedParticles, tableTexel(s, sortedWidth), 0).y;
+                        if (i == curr_i) continue;  // skip self
+                        projectContact(pos, properties.x, properties.y, i, correction, numConstraints);
+                    }
+                }
+            }
+        }
+    } else if (interParticleCollision) {
+        // Brute-force reference mode: test against every other particle
+        for (uint i = 0; i < numParticles; ++i) {
+            if (i == curr_i) continue;  // skip self
+            projectContact(pos, properties.x, properties.y, i, correction, numConstraints);
+        }
+    }
+
+    // Container constraint d(x_i) <= -r, the container is immovable so the particle takes the full correction
+    float distanceToWall = containerDistance(pos);
+    if (distanceToWall > -properties.x) {
+        correction -= (distanceToWall + properties.x) * containerNormal(pos);
+        numConstraints++;
+    }
+
+    if (numConstraints > 0) { pos += (relaxation / float(numConstraints)) * correction; }
+
+    // The constraints violated by the prediction count as the collisions of this step
+    correctedPosition = vec4(pos, iteration == 0u ? float(numConstraints) : predicted.w);
+}
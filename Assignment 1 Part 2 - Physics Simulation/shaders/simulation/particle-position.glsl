@@ -0,0 +1,34 @@
+#version 410
+
+// Representation of the positions in the state textures and buffers, shared by every shader reading or writing them, which
+// link this file into the same shader stage as their entry point
+// With StatePrecision::TileRelative, a stored position is the offset from the center of its tile, with the tile ID in the
+// A channel; otherwise it is the world-space position (mirrors PositionTiling in position_tiling.h)
+
+#define TILE_ID_OFFSET 2048 // Tile IDs are stored shifted to be centered around zero, as half floats hold integers up to 2048 exactly
+
+// Fixed while the state textures exist (mirrors PositionTiling in position_tiling.h)
+layout(std140) uniform PositionTiling {
+    vec3 positionTileOrigin;    // Corner of the first tile
+    float positionTileSize;
+    int positionTilesPerAxis;   // 0 when positions are stored as world-space coordinates
+};
+
+vec3 positionTileCenter(ivec3 tile) {
+    return positionTileOrigin + (vec3(tile) + 0.5) * positionTileSize;
+}
+
+// Stored RGBA texel of a world-space position; positions outside the tiles are stored relative to the nearest one
+vec4 encodePosition(vec3 position) {
+    if (positionTilesPerAxis == 0) { return vec4(position, 1.0); }
+    ivec3 tile  = clamp(ivec3(floor((position - positionTileOrigin) / positionTileSize)), ivec3(0), ivec3(positionTilesPerAxis - 1));
+    int tileId  = tile.x + positionTilesPerAxis * (tile.y + positionTilesPerAxis * tile.z);
+    return vec4(position - positionTileCenter(tile), float(tileId - TILE_ID_OFFSET));
+}
+
+vec3 decodePosition(vec4 texel) {
+    if (positionTilesPerAxis == 0) { return texel.xyz; }
+    int tileId  = int(texel.w) + TILE_ID_OFFSET;
+    ivec3 tile  = ivec3(tileId % positionTilesPerAxis, (tileId / positionTilesPerAxis) % positionTilesPerAxis, tileId / (positionTilesPerAxis * positionTilesPerAxis));
+    return positionTileCenter(tile) + texel.xyz;
+}
@@ -0,0 +1,69 @@
+#version 410
+
+// Particle colouring shared by the mesh and impostor draw shaders, linked into their fragment stage
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+uniform vec3 minSpeedColor;
+uniform vec3 maxSpeedColor;
+uniform float maxSpeedThreshold;
+uniform bool useSpeedBasedColoring;
+
+uniform bool enableShading;
+uniform float ambientCoefficient;
+
+uniform bool enableBounce;
+// uniform int bounceThreshold;
+// uniform int bounceFrames;
+uniform vec3 bounceColor;
+
+vec3 shadeParticle(vec3 position, vec3 normal, vec3 velocity, vec3 bounceData) {
+    vec3 baseColor = vec3(1.0);
+
+    // ===== Task 2.1 Speed-based Colors =====
+
+    float speed = length(velocity);
+
+    if (useSpeedBasedColoring) {
+        float t = clamp(speed / maxSpeedThreshold, 0.0, 1.0);
+        baseColor = mix(minSpeedColor, maxSpeedColor, t);  // linear interpolation
+    }
+
+    // ===== Task 3.1 Blinking =====
+    int collisionCount = int(bounceData.x);
+    int frameCounter = int(bounceData.y);
+
+    if (enableBounce) {
+        if (frameCounter > 0) {
+            baseColor = bounceColor;
+            // frameCounter--;
+        }
+    }
+
+    vec3 finalColor = baseColor;
+
+    // ===== Task 2.2 Shading =====
+
+    if (enableShading) {
+        // ambient term
+        vec3 ambient = ambientCoefficient * finalColor;
+
+        // diffuse term: based on a single light at the center of the container
+        vec3 lightDir = normalize(containerCenter - position);
+        float diffuseIntensity = max(0, dot(lightDir, normalize(normal)));
+        vec3 diffuse = diffuseIntensity * finalColor;
+
+        finalColor = ambient + diffuse;
+    }
+
+    return finalColor;
+}
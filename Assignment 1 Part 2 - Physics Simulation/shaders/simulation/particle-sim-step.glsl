@@ -0,0 +1,161 @@
+#version 410
+
+// Particle update shared by the simulation backends: particle-sim.frag (state textures) and particle-sim-tf.vert (transform feedback),
+// and by the collision event capture of particle-collision-events.geom
+// All of them link this file and container.glsl into the same shader stage as their entry point, which provides the access to the previous particle state
+
+#define COLLISION_OFFSET 0.001
+#define CONTAINER_COLLISION 0xFFFFFFFFu  // Other index of a collision with the container wall (mirrors collision_events.h)
+
+// Static simulation parameters, only re-uploaded when the config changes (mirrors SimulationParameters in particles.h)
+layout(std140) uniform SimulationParameters {
+    vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint numParticles;
+    bool interParticleCollision;
+    int bounceThreshold;
+    int bounceFrames;
+};
+
+// Per-particle properties, constant over the simulation (R channel is radius, G channel is mass, B channel is species)
+uniform samplerBuffer particleProperties;
+
+// Uniform grid broad phase
+uniform bool useUniformGrid;
+uniform usampler2D sortedParticles;    // (cell index, particle index) keys sorted by cell
+uniform usampler2D cellRanges;         // Per-cell [start, end) range into sortedParticles
+uniform vec3 gridOrigin;
+uniform float gridCellSize;
+uniform ivec3 gridResolution;
+
+// Provided by the entry point
+vec3 fetchPreviousPosition(uint idx);
+// Called for every collision the particle resolves, with the contact point and the magnitude of the impulse it received.
+// Only particle-collision-events.geom does something with it, the simulation entry points leave it empty
+void recordCollision(uint otherIdx, vec3 contactPosition, float impulse);
+
+// Defined in container.glsl
+float containerDistance(vec3 pos);
+vec3 containerNormal(vec3 pos);
+
+// Defined in particle-position.glsl
+vec4 encodePosition(vec3 position);
+
+// Push the particle (of the given radius and mass) out of another particle it overlaps with and reflect its velocity
+void collideWithParticle(uint otherIdx, float radius, float mass, inout vec3 newPos, inout vec3 newVel, inout int collisionCount) {
+    // Check for collision
+    vec3 otherPos = fetchPreviousPosition(otherIdx);
+    vec3 toOther = newPos - otherPos;
+    float dist = length(toOther);
+    vec2 otherProperties = texelFetch(particleProperties, int(otherIdx)).rg;
+    float contactDistance = radius + otherProperties.x;
+    if (dist < contactDistance) {
+        vec3 normal = normalize(toOther);
+        vec3 velocityBefore = newVel;
+        // Push the particle away, by the share of the overlap opposite to its share of the total mass (half for equal masses)
+        float share = otherProperties.y / (mass + otherProperties.y);
+        newPos += normal * (contactDistance - dist + COLLISION_OFFSET) * share;
+        // Reflect velocity, fully off an equal or heavier particle and only partly off a lighter one
+        newVel -= min(2.0 * share, 1.0) * 2.0 * dot(newVel, normal) * normal;
+
+        collisionCount++;
+        recordCollision(otherIdx, otherPos + normal * otherProperties.x, mass * length(newVel - velocityBefore));
+    }
+}
+
+ivec2 tableTexel(uint idx, int tableWidth) { return ivec2(int(idx) % tableWidth, int(idx) / tableWidth); }
+
+// Advance particle curr_i by one timestep, given its previous state
+void stepParticle(uint curr_i, vec3 prevPos, vec3 prevVel, vec2 prevBounceData,
+                  out vec4 finalPosition, out vec4 finalVelocity, out vec4 finalBounceData) {
+    // ===== Task 1.1 Verlet Integration =====
+
+    // Unpack previous collision and frame counters
+    int collisionCount = int(prevBounceData.x);
+    int frameCounter = int(prevBounceData.y);
+    vec2 properties = texelFetch(particleProperties, int(curr_i)).rg;
+    float radius = properties.x;
+    float mass = properties.y;
+
+    // Define acceleration due to gravity (constant)
+    vec3 gravity = vec3(0.0, -9.81, 0.0);
+
+    // Compute new position using Velocity Verlet Integration
+    vec3 newPos = prevPos + prevVel * timestep + 0.5 * gravity * timestep * timestep;
+
+    // Compute velocity at the new position (same acceleration: a = g = -9.81)
+    vec3 newVel = prevVel + gravity * timestep;
+
+    // ===== Task 1.3 Inter-particle Collision =====
+
+    if (interParticleCollision && useUniformGrid) {
+        // Only visit the particles in the cells neighbouring the one this particle moved into.
+        // Cells are at least one diameter of the largest species wide, so these contain all particles it can collide with
+        int sortedWidth = textureSize(sortedParticles, 0).x;
+        int tableWidth = textureSize(cellRanges, 0).x;
+        ivec3 cell = clamp(ivec3(floor((newPos - gridOrigin) / gridCellSize)), ivec3(0), gridResolution - 1);
+        ivec3 minCell = max(cell - 1, ivec3(0));
+        ivec3 maxCell = min(cell + 1, gridResolution - 1);
+        for (int z = minCell.z; z <= maxCell.z; ++z) {
+            for (int y = minCell.y; y <= maxCell.y; ++y) {
+                for (int x = minCell.x; x <= maxCell.x; ++x) {
+                    uint cellIdx = uint(x + gridResolution.x * (y + gridResolution.y * z));
+                    uvec2 range = texelFetch(cellRanges, tableTexel(cellIdx, tableWidth), 0).xy;
+                    for (uint s = range.x; s < range.y; ++s) {
+                        uint i = texelFetch(sortedParticles, tableTexel(s, sortedWidth), 0).y;
+                        if (i == curr_i) continue;  // skip self
+
+                        collideWithParticle(i, radius, mass, newPos, newVel, collisionCount);
+                    }
+                }
+            }
+        }
+    } else if (interParticleCollision) {
+        // Brute-force reference mode: test against every other particle
+        for (uint i = 0; i < numParticles; ++i) {
+            if (i == curr_i) continue;  // skip self
+
+            collideWithParticle(i, radius, mass, newPos, newVel, collisionCount);
+        }
+    }
+    
+
+    // ===== Task 1.2 Container Collision =====
+
+    float distanceToWall = containerDistance(newPos);
+
+    if (distanceToWall > -radius) {
+        vec3 normal = containerNormal(newPos);
+        vec3 wallPoint = newPos - normal * distanceToWall;
+        vec3 velocityBefore = newVel;
+        // Push the particle back inside
+        newPos -= normal * (distanceToWall + radius + COLLISION_OFFSET);
+        // Reflect the velocity about the collision normal
+        newVel = reflect(newVel, normal);
+
+        collisionCount++;
+        recordCollision(CONTAINER_COLLISION, wallPoint, mass * length(newVel - velocityBefore));
+    }
+
+    // Collisions of this step alone, for the statistics
+    int stepCollisions = collisionCount - int(prevBounceData.x);
+
+    // ===== Task 3: Blink Logic =====
+
+    // If the collision count exceeds the threshold, set the frame counter and reset the collision count
+    if (collisionCount >= bounceThreshold) {
+        frameCounter = bounceFrames;
+        collisionCount = 0; // Reset collision count
+    }
+
+    // Decrement the frame counter if it's above zero
+    frameCounter = max(frameCounter - 1, 0);
+
+
+    finalPosition = encodePosition(newPos);
+    finalVelocity = vec4(newVel, 0.0);
+
+    // Pack the updated collision count and frame counter into the final bounce data
+    finalBounceData = vec4(float(collisionCount), float(frameCounter), 0.0, float(stepCollisions));
+}
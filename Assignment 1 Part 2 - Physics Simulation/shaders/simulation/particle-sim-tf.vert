@@ -0,0 +1,35 @@
+#version 410
+
+// Transform-feedback simulation backend: one vertex per particle (attribute-less GL_POINTS draw with the rasterizer disabled),
+// reading the previous state from buffer textures and capturing the outputs into the next state buffers
+
+uniform samplerBuffer previousPositions;
+uniform samplerBuffer previousVelocities;
+uniform samplerBuffer previousBounceData;
+
+out vec4 finalPosition;
+out vec4 finalVelocity;
+out vec4 finalBounceData;
+
+// Defined in particle-sim-step.glsl
+void stepParticle(uint curr_i, vec3 prevPos, vec3 prevVel, vec2 prevBounceData,
+                  out vec4 finalPosition, out vec4 finalVelocity, out vec4 finalBounceData);
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+
+vec3 fetchPreviousPosition(uint idx) { return decodePosition(texelFetch(previousPositions, int(idx))); }
+
+// Collision events are captured by a separate pass, see particle-collision-events.geom
+void recordCollision(uint otherIdx, vec3 contactPosition, float impulse) {}
+
+void main() {
+    uint curr_i = uint(gl_VertexID);
+
+    // Fetch the particle's previous position and velocity
+    vec3 prevPos = decodePosition(texelFetch(previousPositions, gl_VertexID));
+    vec3 prevVel = texelFetch(previousVelocities, gl_VertexID).rgb;
+    vec2 prevBounceData = texelFetch(previousBounceData, gl_VertexID).xy;
+
+    stepParticle(curr_i, prevPos, prevVel, prevBounceData, finalPosition, finalVelocity, finalBounceData);
+}
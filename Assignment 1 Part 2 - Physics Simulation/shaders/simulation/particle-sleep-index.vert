@@ -0,0 +1,9 @@
+#version 410
+
+// One point per particle (attribute-less GL_POINTS draw), handing the particle index to the geometry shader
+
+layout(location = 0) flat out uint vertexParticleIdx;
+
+void main() {
+    vertexParticleIdx = uint(gl_VertexID);
+}
@@ -0,0 +1,7 @@
+#version 410
+
+layout(location = 0) out float woken;
+
+void main() {
+    woken = 1.0;
+}
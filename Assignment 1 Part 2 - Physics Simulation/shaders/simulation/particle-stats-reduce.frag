@@ -0,0 +1,28 @@
+#version 410
+
+// Further levels of the statistics reduction: combines the partial results of a blockSize x blockSize block of the previous level
+
+uniform sampler2D partialMassMoments;
+uniform sampler2D partialMotion;
+uniform int blockSize;
+
+layout(location = 0) out vec4 massMoments;     // (sum of m*x, m*y, m*z, m)
+layout(location = 1) out vec4 motion;          // (sum of 0.5*m*|v|^2, max |v|, sum of collisions, sum of |v|)
+
+void main() {
+    ivec2 partialSize = textureSize(partialMassMoments, 0);  // 0: main mipmap
+    ivec2 firstTexel = ivec2(gl_FragCoord.xy) * blockSize;
+
+    massMoments = vec4(0.0);
+    motion = vec4(0.0);
+    for (int y = 0; y < blockSize; ++y) {
+        for (int x = 0; x < blockSize; ++x) {
+            ivec2 texel = firstTexel + ivec2(x, y);
+            if (texel.x >= partialSize.x || texel.y >= partialSize.y) continue;
+
+            vec4 partial = texelFetch(partialMotion, texel, 0);
+            massMoments += texelFetch(partialMassMoments, texel, 0);
+            motion = vec4(motion.x + partial.x, max(motion.y, partial.y), motion.zw + partial.zw);
+        }
+    }
+}
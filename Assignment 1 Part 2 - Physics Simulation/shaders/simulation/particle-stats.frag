@@ -0,0 +1,59 @@
+#version 410
+
+// First level of the statistics reduction: sums the per-particle quantities of a blockSize x blockSize block of state texels
+
+uniform sampler2D positions;
+uniform sampler2D velocities;
+uniform sampler2D bounceData;          // A channel is the number of collisions in the latest step
+uniform samplerBuffer positionBuffer;  // Used instead of the state textures by the transform-feedback backend
+uniform samplerBuffer velocityBuffer;
+uniform samplerBuffer bounceDataBuffer;
+uniform bool stateInBuffers;
+uniform ivec2 stateSize;               // Dimensions of the state textures; blocks are laid out over them for both backends
+uniform int blockSize;
+uniform uint numParticles;
+
+// Per-particle properties, constant over the simulation (R channel is radius, G channel is mass, B channel is species)
+uniform samplerBuffer particleProperties;
+
+layout(location = 0) out vec4 massMoments;     // (sum of m*x, m*y, m*z, m)
+layout(location = 1) out vec4 motion;          // (sum of 0.5*m*|v|^2, max |v|, sum of collisions, sum of |v|)
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+
+void main() {
+    ivec2 firstTexel = ivec2(gl_FragCoord.xy) * blockSize;
+
+    massMoments = vec4(0.0);
+    motion = vec4(0.0);
+    for (int y = 0; y < blockSize; ++y) {
+        for (int x = 0; x < blockSize; ++x) {
+            // Texels past the last particle are padding
+            ivec2 texel = firstTexel + ivec2(x, y);
+            uint idx = uint(texel.y) * uint(stateSize.x) + uint(texel.x);
+            if (texel.x >= stateSize.x || texel.y >= stateSize.y || idx >= numParticles) continue;
+
+            // Particle i is stored at texel (i % width, i / width) of the state textures, or at element i of the state buffers
+            vec3 pos, vel;
+            float collisions;
+            if (stateInBuffers) {
+                pos = decodePosition(texelFetch(positionBuffer, int(idx)));
+                vel = texelFetch(velocityBuffer, int(idx)).rgb;
+                collisions = texelFetch(bounceDataBuffer, int(idx)).a;
+            } else {
+                pos = decodePosition(texelFetch(positions, texel, 0));
+                vel = texelFetch(velocities, texel, 0).rgb;
+                collisions = texelFetch(bounceData, texel, 0).a;
+            }
+            float mass = texelFetch(particleProperties, int(idx)).g;
+            float speed = length(vel);
+
+            massMoments += vec4(mass * pos, mass);
+            motion.x += 0.5 * mass * speed * speed;
+            motion.y = max(motion.y, speed);
+            motion.z += collisions;
+            motion.w += speed;
+        }
+    }
+}
@@ -0,0 +1,11 @@
+#version 410
+
+uniform vec3 trailColor;
+
+layout(location = 0) in float fragAge;    // 0 at the newest position, 1 at the oldest
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+    fragColor = vec4(trailColor, 1.0 - fragAge);
+}
@@ -0,0 +1,24 @@
+#version 410
+
+// One line strip per particle (instance) through its last numPoints positions, newest first (vertex)
+
+uniform sampler2DArray trailPositions; // Ring of past (stored) positions, one layer per recorded frame, laid out like the state textures
+uniform int newestLayer;
+uniform int capacity;
+uniform int numPoints;
+uniform mat4 viewProjection;
+
+layout(location = 0) out float fragAge;
+
+// Defined in particle-position.glsl
+vec3 decodePosition(vec4 texel);
+
+void main() {
+    int stateTexWidth   = textureSize(trailPositions, 0).x;
+    ivec2 dataTexel     = ivec2(gl_InstanceID % stateTexWidth, gl_InstanceID / stateTexWidth);
+    int layer           = (newestLayer - gl_VertexID + capacity) % capacity;
+    vec3 position       = decodePosition(texelFetch(trailPositions, ivec3(dataTexel, layer), 0));
+
+    gl_Position = viewProjection * vec4(position, 1.0);
+    fragAge     = float(gl_VertexID) / float(numPoints - 1);
+}
@@ -0,0 +1,312 @@
+#include "simulation/cpu_particles.h"
+#include "simulation/particles.h"
+#include "utils/config.h"
+#include "utils/constants.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <fmt/format.h>
+#include <glad/glad.h>
+DISABLE_WARNINGS_POP()
+
+#include <framework/window.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Inter-particle collision handling of a benchmark configuration
+enum class CollisionMode : int {
+    None = 0,   // Container collisions only
+    BruteForce,
+    UniformGrid
+};
+
+// Parameters swept by the benchmark; every combination of the lists is one configuration
+struct SweepOptions {
+    std::vector<SimulationBackend> backends     = { SimulationBackend::GPU, SimulationBackend::CPU };
+    std::vector<uint32_t> particleCounts        = { 1000U, 4000U };
+    std::vector<float> radii                    = { 0.05f, 0.1f };
+    std::vector<float> timesteps                = { 0.014f };
+    std::vector<CollisionMode> collisionModes   = { CollisionMode::UniformGrid, CollisionMode::BruteForce, CollisionMode::None };
+    uint32_t warmupSteps    = 10U;
+    uint32_t timedSteps     = 100U;
+    std::filesystem::path jsonPath, csvPath;    // No file is written if empty
+    std::filesystem::path baselinePath;         // CSV of an earlier run to compare the throughput against, if not empty
+    float maxSlowdown       = 0.1f;             // Fraction of the baseline steps/s a configuration may lose before it counts as a regression
+};
+
+// Timings of the timed steps of one configuration
+struct BenchmarkResult {
+    SimulationBackend backend;
+    uint32_t numParticles;
+    float radius;
+    float timestep;
+    CollisionMode collisionMode;
+    double wallSeconds;
+    std::optional<double> gpuSeconds;   // GL_TIME_ELAPSED of the steps, not measured for the CPU backend
+
+    double stepsPerSecond(uint32_t numSteps) const { return static_cast<double>(numSteps) / wallSeconds; }
+    double nsPerParticleStep(double seconds, uint32_t numSteps) const { return seconds * 1e9 / (static_cast<double>(numSteps) * numParticles); }
+};
+
+static const char* backendName(SimulationBackend backend) {
+    switch (backend) {
+        case SimulationBackend::GPU:                return "gpu";
+        case SimulationBackend::CPU:                return "cpu";
+        case SimulationBackend::TransformFeedback:  return "tf";
+    }
+    return "";
+}
+
+static const char* collisionModeName(CollisionMode collisionMode) {
+    switch (collisionMode) {
+        case CollisionMode::None:           return "none";
+        case CollisionMode::BruteForce:     return "brute";
+        case CollisionMode::UniformGrid:    return "grid";
+    }
+    return "";
+}
+
+// Columns identifying a configuration, which a baseline is matched on
+static std::string configurationKey(const BenchmarkResult& result) {
+    return fmt::format("{},{},{},{},{}", backendName(result.backend), result.numParticles, result.radius, result.timestep, collisionModeName(result.collisionMode));
+}
+
+void printUsage(const char* executable) {
+    std::cerr << "Usage: " << executable << " [--backend LIST] [--particles LIST] [--radius LIST] [--timestep LIST] [--collision LIST]" << std::endl
+              << "       [--warmup M] [--steps N] [--json FILE] [--csv FILE] [--baseline FILE] [--max-slowdown FRACTION]" << std::endl
+              << "  Every combination of the comma-separated lists is run for M warm-up steps and N timed steps" << std::endl
+              << "  --backend       gpu, tf and/or cpu; the CPU solver runs without an OpenGL context, the others on any driver" << std::endl
+              << "                  with OpenGL 4.1 (e.g. Mesa llvmpipe)" << std::endl
+              << "  --collision     none, brute and/or grid inter-particle collisions" << std::endl
+              << "  --json, --csv   Write steps/s and ns per particle-step of every configuration to FILE" << std::endl
+              << "  --baseline      CSV of an earlier run; exits with code 2 if a configuration lost more than --max-slowdown" << std::endl
+              << "                  (default 0.1) of its steps/s" << std::endl;
+}
+
+template <typename T>
+static std::vector<T> parseList(const std::string& list, const std::function<T(const std::string&)>& parseItem) {
+    std::vector<T> items;
+    std::istringstream stream(list);
+    for (std::string item; std::getline(stream, item, ',');) { items.push_back(parseItem(item)); }
+    if (items.empty()) { throw std::invalid_argument("Empty list"); }
+    return items;
+}
+
+// Returns false on invalid arguments
+bool parseArguments(int argc, char* argv[], SweepOptions& options) {
+    try {
+        for (int argIdx = 1; argIdx < argc; argIdx++) {
+            const std::string arg = argv[argIdx];
+            if (argIdx + 1 >= argc) { return false; }   // Every option takes a value
+            const std::string value = argv[++argIdx];
+            if (arg == "--backend") {
+                options.backends = parseList<SimulationBackend>(value, [](const std::string& item) {
+                    if (item == "gpu")  { return SimulationBackend::GPU; }
+                    if (item == "cpu")  { return SimulationBackend::CPU; }
+                    if (item == "tf")   { return SimulationBackend::TransformFeedback; }
+                    throw std::invalid_argument(item);
+                });
+            } else if (arg == "--collision") {
+                options.collisionModes = parseList<CollisionMode>(value, [](const std::string& item) {
+                    if (item == "none")     { return CollisionMode::None; }
+                    if (item == "brute")    { return CollisionMode::BruteForce; }
+                    if (item == "grid")     { return CollisionMode::UniformGrid; }
+                    throw std::invalid_argument(item);
+                });
+            }
+            else if (arg == "--particles")      { options.particleCounts = parseList<uint32_t>(value, [](const std::string& item) { return static_cast<uint32_t>(std::stoul(item)); }); }
+            else if (arg == "--radius")         { options.radii = parseList<float>(value, [](const std::string& item) { return std::stof(item); }); }
+            else if (arg == "--timestep")       { options.timesteps = parseList<float>(value, [](const std::string& item) { return std::stof(item); }); }
+            else if (arg == "--warmup")         { options.warmupSteps = static_cast<uint32_t>(std::stoul(value)); }
+            else if (arg == "--steps")          { options.timedSteps = static_cast<uint32_t>(std::stoul(value)); }
+            else if (arg == "--json")           { options.jsonPath = value; }
+            else if (arg == "--csv")            { options.csvPath = value; }
+            else if (arg == "--baseline")       { options.baselinePath = value; }
+            else if (arg == "--max-slowdown")   { options.maxSlowdown = std::stof(value); }
+            else                                { return false; }
+        }
+    } catch (const std::exception&) { return false; }  // Malformed numbers and unknown list items
+
+    for (uint32_t numParticles : options.particleCounts) { if (numParticles == 0U) { return false; } }
+    for (float radius : options.radii) { if (radius <= 0.0f) { return false; } }
+    for (float timestep : options.timesteps) { if (timestep <= 0.0f) { return false; } }
+    return options.timedSteps > 0U;
+}
+
+static void applyConfiguration(Config& config, const BenchmarkResult& configuration) {
+    config.simulationBackend        = configuration.backend;
+    config.numParticles             = configuration.numParticles;
+    config.particleRadius           = configuration.radius;
+    config.particleSimTimestep      = configuration.timestep;
+    config.particleInterCollision   = configuration.collisionMode != CollisionMode::None;
+    config.broadPhase               = configuration.collisionMode == CollisionMode::BruteForce ? BroadPhase::BruteForce : BroadPhase::UniformGrid;
+}
+
+// The CPU solver is timed on its own, without the state upload the interactive CPU backend adds for drawing
+static void runOnCpu(const Config& config, const SweepOptions& options, BenchmarkResult& result) {
+    CpuParticleSolver solver(config, config.cpuSolverThreads);
+    for (uint32_t step = 0U; step < options.warmupSteps; step++) { solver.step(); }
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t step = 0U; step < options.timedSteps; step++) { solver.step(); }
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// All timed steps are issued as a single frame, and both clocks stop once the GPU has finished them
+static void runOnGpu(ParticlesSimulator& simulator, const SweepOptions& options, BenchmarkResult& result) {
+    simulator.resetSimulation();
+    simulator.step(options.warmupSteps);
+    glFinish();
+
+    GLuint timerQuery;
+    glGenQueries(1, &timerQuery);
+    const auto start = std::chrono::steady_clock::now();
+    glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+    simulator.step(options.timedSteps);
+    glEndQuery(GL_TIME_ELAPSED);
+    glFinish();
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    GLuint64 gpuNanoseconds;
+    glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &gpuNanoseconds);
+    glDeleteQueries(1, &timerQuery);
+    result.gpuSeconds = static_cast<double>(gpuNanoseconds) * 1e-9;
+}
+
+static bool writeCsv(const std::filesystem::path& filePath, const std::vector<BenchmarkResult>& results, const SweepOptions& options) {
+    std::ofstream file(filePath);
+    file << "backend,particles,radius,timestep,collision,warmup_steps,timed_steps,wall_seconds,steps_per_second,ns_per_particle_step,gpu_seconds,gpu_ns_per_particle_step\n";
+    for (const BenchmarkResult& result : results) {
+        file << fmt::format("{},{},{},{},{},{}", configurationKey(result), options.warmupSteps, options.timedSteps, result.wallSeconds,
+                            result.stepsPerSecond(options.timedSteps), result.nsPerParticleStep(result.wallSeconds, options.timedSteps));
+        if (result.gpuSeconds)  { file << fmt::format(",{},{}\n", *result.gpuSeconds, result.nsPerParticleStep(*result.gpuSeconds, options.timedSteps)); }
+        else                    { file << ",,\n"; }
+    }
+    return static_cast<bool>(file);
+}
+
+static bool writeJson(const std::filesystem::path& filePath, const std::vector<BenchmarkResult>& results, const SweepOptions& options, const std::string& renderer) {
+    std::ofstream file(filePath);
+    file << "{\n  \"renderer\": \"" << renderer << "\",\n  \"warmup_steps\": " << options.warmupSteps << ",\n  \"timed_steps\": " << options.timedSteps << ",\n  \"results\": [\n";
+    for (size_t resultIdx = 0UL; resultIdx < results.size(); resultIdx++) {
+        const BenchmarkResult& result = results[resultIdx];
+        file << fmt::format("    {{\"backend\": \"{}\", \"particles\": {}, \"radius\": {}, \"timestep\": {}, \"collision\": \"{}\", \"wall_seconds\": {}, "
+                            "\"steps_per_second\": {}, \"ns_per_particle_step\": {}, ",
+                            backendName(result.backend), result.numParticles, result.radius, result.timestep, collisionModeName(result.collisionMode),
+                            result.wallSeconds, result.stepsPerSecond(options.timedSteps), result.nsPerParticleStep(result.wallSeconds, options.timedSteps));
+        if (result.gpuSeconds)  { file << fmt::format("\"gpu_seconds\": {}, \"gpu_ns_per_particle_step\": {}}}", *result.gpuSeconds, result.nsPerParticleStep(*result.gpuSeconds, options.timedSteps)); }
+        else                    { file << "\"gpu_seconds\": null, \"gpu_ns_per_particle_step\": null}"; }
+        file << (resultIdx + 1UL < results.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+// Steps/s of every configuration in a CSV written by an earlier run, by configurationKey()
+static std::optional<std::map<std::string, double>> readBaseline(const std::filesystem::path& filePath) {
+    std::ifstream file(filePath);
+    if (!file) { return {}; }
+
+    constexpr size_t KEY_COLUMNS = 5UL, STEPS_PER_SECOND_COLUMN = 8UL;
+    std::map<std::string, double> stepsPerSecond;
+    std::string line;
+    std::getline(file, line);   // Header
+    while (std::getline(file, line)) {
+        std::vector<std::string> columns;
+        std::istringstream stream(line);
+        for (std::string column; std::getline(stream, column, ',');) { columns.push_back(column); }
+        if (columns.size() <= STEPS_PER_SECOND_COLUMN) { continue; }
+
+        std::string key = columns[0];
+        for (size_t columnIdx = 1UL; columnIdx < KEY_COLUMNS; columnIdx++) { key += "," + columns[columnIdx]; }
+        try {
+            stepsPerSecond[key] = std::stod(columns[STEPS_PER_SECOND_COLUMN]);
+        } catch (const std::exception&) { return {}; }
+    }
+    return stepsPerSecond;
+}
+
+int main(int argc, char* argv[]) {
+    SweepOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The OpenGL context, and the simulator with its shaders, are only created if a GPU backend is benchmarked, and shared by
+    // all of its configurations; the simulator is reset for every configuration instead
+    Config config;
+    std::unique_ptr<Window> window;
+    std::unique_ptr<ParticlesSimulator> simulator;
+    std::string renderer = "CPU only";
+
+    std::vector<BenchmarkResult> results;
+    for (SimulationBackend backend : options.backends) {
+        if (backend != SimulationBackend::CPU && !window) {
+            window      = std::make_unique<Window>("Particle Simulation Benchmark", glm::ivec2(utils::WIDTH, utils::HEIGHT), OpenGLVersion::GL41, false);
+            simulator   = std::make_unique<ParticlesSimulator>(config);
+            renderer    = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+            std::cout << "Renderer: " << renderer << std::endl;
+        }
+        for (uint32_t numParticles : options.particleCounts) {
+            for (float radius : options.radii) {
+                for (float timestep : options.timesteps) {
+                    for (CollisionMode collisionMode : options.collisionModes) {
+                        BenchmarkResult result { .backend = backend, .numParticles = numParticles, .radius = radius, .timestep = timestep,
+                                                 .collisionMode = collisionMode, .wallSeconds = 0.0, .gpuSeconds = {} };
+                        applyConfiguration(config, result);
+                        if (backend == SimulationBackend::CPU)  { runOnCpu(config, options, result); }
+                        else                                    { runOnGpu(*simulator, options, result); }
+                        results.push_back(result);
+
+                        std::cout << fmt::format("{:<3} {:>7} particles  radius {:<6} dt {:<6} {:<5} {:>10.1f} steps/s {:>9.2f} ns/particle-step",
+                                                 backendName(backend), numParticles, radius, timestep, collisionModeName(collisionMode),
+                                                 result.stepsPerSecond(options.timedSteps), result.nsPerParticleStep(result.wallSeconds, options.timedSteps));
+                        if (result.gpuSeconds) { std::cout << fmt::format(" (GPU {:.2f})", result.nsPerParticleStep(*result.gpuSeconds, options.timedSteps)); }
+                        std::cout << std::endl;
+                    }
+                }
+            }
+        }
+    }
+
+    if (!options.csvPath.empty() && !writeCsv(options.csvPath, results, options)) {
+        std::cerr << "Could not write " << options.csvPath.string() << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!options.jsonPath.empty() && !writeJson(options.jsonPath, results, options, renderer)) {
+        std::cerr << "Could not write " << options.jsonPath.string() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Configurations missing from the baseline are new, and cannot regress
+    if (options.baselinePath.empty()) { return EXIT_SUCCESS; }
+    const std::optional<std::map<std::string, double>> baseline = readBaseline(options.baselinePath);
+    if (!baseline) {
+        std::cerr << "Could not read baseline " << options.baselinePath.string() << std::endl;
+        return EXIT_FAILURE;
+    }
+    bool regressed = false;
+    for (const BenchmarkResult& result : results) {
+        const auto baselineIt = baseline->find(configurationKey(result));
+        if (baselineIt == baseline->end()) { continue; }
+        const double stepsPerSecond = result.stepsPerSecond(options.timedSteps);
+        if (stepsPerSecond < baselineIt->second * (1.0 - static_cast<double>(options.maxSlowdown))) {
+            std::cerr << fmt::format("Regression: {} runs {:.1f} steps/s, baseline {:.1f}", baselineIt->first, stepsPerSecond, baselineIt->second) << std::endl;
+            regressed = true;
+        }
+    }
+    return regressed ? 2 : EXIT_SUCCESS;
+}
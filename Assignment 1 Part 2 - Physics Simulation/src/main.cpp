@@ -1,9 +1,12 @@
 #include "render/mesh.h"
+#include "simulation/container.h"
 #include "simulation/particles.h"
-#include "simulation/sphere_container.h"
+#include "simulation/snapshot.h"
+#include "simulation/state_dump.h"
 #include "ui/camera.h"
 #include "ui/menu.h"
 #include "utils/constants.h"
+#include "utils/gpu_profiler.h"
 
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
@@ -14,19 +17,185 @@ DISABLE_WARNINGS_PUSH()
 #include <imgui/imgui.h>
 DISABLE_WARNINGS_POP()
 
+#include <framework/frame_capture.h>
 #include <framework/window.h>
 
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
 
 
+// Options of a headless batch run
+struct BatchOptions {
+    bool headless           = false;
+    uint32_t numSteps       = 1000U;
+    uint32_t dumpInterval   = 10U;  // Number of steps between state dump frames
+    uint32_t dumpRingSize   = 0U;   // Number of frame slots in the state dump, 0 to keep all frames
+    std::filesystem::path dumpPath; // No state dump is written if empty
+    bool saveSnapshot       = false;// Write a snapshot to Config::snapshotFile after the last step
+};
+
+void printUsage(const char* executable) {
+    std::cerr << "Usage: " << executable << " [--headless] [--steps N] [--particles N] [--timestep DT] [--backend gpu|cpu|tf] [--precision half|full|tile]" << std::endl
+              << "       [--init spiral|poisson|lattice] [--init-file FILE] [--seed N] [--container FILE] [--dump FILE] [--dump-every N] [--dump-ring N]" << std::endl
+              << "       [--snapshot FILE] [--resume FILE] [--autosave SECONDS] [--collision-events FILE] [--record DIR] [--record-command CMD]" << std::endl
+              << "  --headless     Run the given number of steps without a visible window, then exit" << std::endl
+              << "  --precision    State storage: half floats, full floats, or half floats relative to tiles of the container" << std::endl
+              << "  --init         Initial placement: random spiral (may overlap), Poisson-disk packed or lattice packed" << std::endl
+              << "  --init-file    Start from the latest frame of a state dump, which also sets the particle count" << std::endl
+              << "  --container    Keep the particles in the closed mesh of an OBJ file, fitted into the container sphere" << std::endl
+              << "  --dump FILE    Write particle positions and velocities to FILE every --dump-every steps (headless only)" << std::endl
+              << "  --dump-ring N  Overwrite the oldest of N frames in the dump instead of appending" << std::endl
+              << "  --snapshot     File that snapshots are saved to; headless runs save one after the last step" << std::endl
+              << "  --resume       Continue from a snapshot, which also sets the particle count" << std::endl
+              << "  --autosave     Save a snapshot every SECONDS of wall-clock time" << std::endl
+              << "  --collision-events  Log every collision of the impulse solver on the GPU backends to a binary FILE" << std::endl
+              << "  --record       Capture every rendered frame as numbered PNG files into DIR" << std::endl
+              << "  --record-command    Capture every rendered frame by piping raw RGBA frames to an encoder, e.g." << std::endl
+              << "                 \"ffmpeg -y -f rawvideo -pix_fmt rgba -s {width}x{height} -r 60 -i - -pix_fmt yuv420p capture.mp4\"" << std::endl;
+}
+
+// Particle count, timestep and backend also apply to interactive runs. Returns false on invalid arguments
+bool parseArguments(int argc, char* argv[], Config& config, BatchOptions& options) {
+    try {
+        for (int argIdx = 1; argIdx < argc; argIdx++) {
+            const std::string arg   = argv[argIdx];
+            const bool hasValue     = argIdx + 1 < argc;
+            if (arg == "--headless")                    { options.headless = true; }
+            else if (arg == "--steps" && hasValue)      { options.numSteps = static_cast<uint32_t>(std::stoul(argv[++argIdx])); }
+            else if (arg == "--particles" && hasValue)  { config.numParticles = static_cast<uint32_t>(std::stoul(argv[++argIdx])); }
+            else if (arg == "--timestep" && hasValue)   { config.particleSimTimestep = std::stof(argv[++argIdx]); }
+            else if (arg == "--dump" && hasValue)       { options.dumpPath = argv[++argIdx]; }
+            else if (arg == "--dump-every" && hasValue) { options.dumpInterval = static_cast<uint32_t>(std::stoul(argv[++argIdx])); }
+            else if (arg == "--dump-ring" && hasValue)  { options.dumpRingSize = static_cast<uint32_t>(std::stoul(argv[++argIdx])); }
+            else if (arg == "--seed" && hasValue)       { config.initialSeed = static_cast<uint32_t>(std::stoul(argv[++argIdx])); }
+            else if (arg == "--autosave" && hasValue)   { config.autosaveInterval = std::stof(argv[++argIdx]); }
+            else if (arg == "--collision-events" && hasValue) {
+                config.collisionEventFile       = argv[++argIdx];
+                config.recordCollisionEvents    = true;
+            }
+            else if (arg == "--record" && hasValue) {
+                config.frameCaptureDirectory    = argv[++argIdx];
+                config.recordFrames             = true;
+            } else if (arg == "--record-command" && hasValue) {
+                config.frameEncoderCommand      = argv[++argIdx];
+                config.recordFrames             = true;
+            }
+            else if (arg == "--snapshot" && hasValue) {
+                config.snapshotFile         = argv[++argIdx];
+                options.saveSnapshot        = true;
+            } else if (arg == "--resume" && hasValue) {
+                config.snapshotFile         = argv[++argIdx];
+                config.doLoadState          = true;
+            }
+            else if (arg == "--container" && hasValue) {
+                config.containerShape       = ContainerShape::Mesh;
+                config.containerMeshFile    = argv[++argIdx];
+            } else if (arg == "--init-file" && hasValue) {
+                config.initialDistribution  = InitialDistribution::File;
+                config.initialStateFile     = argv[++argIdx];
+            } else if (arg == "--init" && hasValue) {
+                const std::string distribution = argv[++argIdx];
+                if (distribution == "spiral")       { config.initialDistribution = InitialDistribution::Spiral; }
+                else if (distribution == "poisson") { config.initialDistribution = InitialDistribution::PoissonDisk; }
+                else if (distribution == "lattice") { config.initialDistribution = InitialDistribution::Lattice; }
+                else                                { return false; }
+            }
+            else if (arg == "--backend" && hasValue) {
+                const std::string backend = argv[++argIdx];
+                if (backend == "gpu")       { config.simulationBackend = SimulationBackend::GPU; }
+                else if (backend == "cpu")  { config.simulationBackend = SimulationBackend::CPU; }
+                else if (backend == "tf")   { config.simulationBackend = SimulationBackend::TransformFeedback; }
+                else                        { return false; }
+            } else if (arg == "--precision" && hasValue) {
+                const std::string precision = argv[++argIdx];
+                if (precision == "half")        { config.statePrecision = StatePrecision::Half; }
+                else if (precision == "full")   { config.statePrecision = StatePrecision::Full; }
+                else if (precision == "tile")   { config.statePrecision = StatePrecision::TileRelative; }
+                else                            { return false; }
+            } else { return false; }
+        }
+    } catch (const std::exception&) { return false; }  // Malformed numbers
+
+    return config.numParticles > 0U && config.particleSimTimestep > 0.0f && options.dumpInterval > 0U;
+}
+
+int runBatch(Config& config, const BatchOptions& options) {
+    // A hidden window still provides the OpenGL context and the default framebuffer transform feedback draws need
+    Window window("Particle Simulation", glm::ivec2(utils::WIDTH, utils::HEIGHT), OpenGLVersion::GL41, false);
+    ParticlesSimulator particlesSimulator(config);
+
+    try {
+        if (config.doLoadState) {
+            particlesSimulator.loadState(config.snapshotFile);
+            config.doLoadState = false;
+        }
+
+        // The initial state may have changed the particle count
+        std::optional<StateDumpWriter> stateDump;
+        if (!options.dumpPath.empty()) {
+            stateDump.emplace(options.dumpPath, config.numParticles, config.particleSimTimestep, options.dumpInterval, options.dumpRingSize);
+            stateDump->writeFrame(0UL, particlesSimulator.readState());
+        }
+
+        // Step in chunks of the dump interval; reading back the state for a frame waits for all steps so far
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t stepsDone = 0U; stepsDone < options.numSteps;) {
+            const uint32_t numSteps = std::min(options.dumpInterval, options.numSteps - stepsDone);
+            particlesSimulator.step(numSteps);
+            stepsDone += numSteps;
+            if (stateDump) { stateDump->writeFrame(stepsDone, particlesSimulator.readState()); }
+        }
+        glFinish();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (options.saveSnapshot) { particlesSimulator.saveState(config.snapshotFile); }  // Written by the time the simulator is destroyed
+
+        std::cout << "Simulated " << options.numSteps << " steps of " << config.numParticles << " particles in " << elapsed.count() << " s ("
+                  << static_cast<double>(options.numSteps) / elapsed.count() << " steps/s)" << std::endl;
+    } catch (const StateDumpException& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    } catch (const SnapshotException& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Start or stop the frame capture when recording is toggled; stopping waits for the captured frames to be written
+void updateFrameCapture(const Config& config, std::optional<FrameCapture>& frameCapture) {
+    if (config.recordFrames == frameCapture.has_value()) { return; }
+    if (config.recordFrames) {
+        frameCapture.emplace(FrameCaptureSettings { .outputDirectory = config.frameCaptureDirectory, .encoderCommand = config.frameEncoderCommand });
+        return;
+    }
+    frameCapture->finish();
+    std::cout << "Captured " << frameCapture->numFramesCaptured() << " frames (" << frameCapture->numFramesDropped() << " dropped while the encoder fell behind)" << std::endl;
+    frameCapture.reset();
+}
+
 int main(int argc, char* argv[]) {
     // Init core objects
     Config m_config;
+    BatchOptions batchOptions;
+    if (!parseArguments(argc, argv, m_config, batchOptions)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (batchOptions.headless) { return runBatch(m_config, batchOptions); }
+
     Window m_window("Particle Simulation", glm::ivec2(utils::WIDTH, utils::HEIGHT), OpenGLVersion::GL41);
     Camera mainCamera(&m_window, utils::START_POSITION, utils::START_LOOK_AT);
-    Menu menu(m_config);
+    GpuProfiler profiler;
     ParticlesSimulator particlesSimulator(m_config);
-    SphereContainer sphereContainer(m_config);
+    Menu menu(m_config, profiler, particlesSimulator.statistics(), particlesSimulator.collisionEvents());
+    Container container(m_config);
+    std::optional<FrameCapture> frameCapture;
 
     // Bind main draw framebuffer for option setting
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -38,7 +207,14 @@ int main(int argc, char* argv[]) {
     glEnable(GL_DEPTH_TEST);
 
     // Main loop
+    double previousFrameStart = glfwGetTime();
     while (!m_window.shouldClose()) {
+        // Time elapsed since the previous frame, which drives real-time simulation stepping
+        const double frameStart = glfwGetTime();
+        const float frameTime   = static_cast<float>(frameStart - previousFrameStart);
+        previousFrameStart      = frameStart;
+        profiler.beginFrame();
+
         // Process user input
         m_window.updateInput();
 
@@ -58,11 +234,36 @@ int main(int argc, char* argv[]) {
             m_config.doResetSimulation = false;
         }
 
+        // Save or restore the particle state if requested
+        if (m_config.doSaveState) {
+            particlesSimulator.saveState(m_config.snapshotFile);
+            m_config.doSaveState = false;
+        }
+        if (m_config.doLoadState) {
+            try {
+                particlesSimulator.loadState(m_config.snapshotFile);
+            } catch (const SnapshotException& e) {
+                std::cerr << e.what() << std::endl;
+            }
+            m_config.doLoadState = false;
+        }
+
         // Particle simulation and rendering
-        particlesSimulator.render(m_viewProjection);
+        profiler.beginSection("Simulation");
+        particlesSimulator.update(frameTime);
+        profiler.endSection();
+        profiler.beginSection("Particle draw");
+        particlesSimulator.draw(m_viewProjection, mainCamera.cameraPos());
+        profiler.endSection();
 
         // Render container
-        sphereContainer.draw(m_viewProjection);
+        profiler.beginSection("Container draw");
+        container.draw(m_viewProjection);
+        profiler.endSection();
+
+        // Capture the frame before the menu, which is only rendered when the buffers are swapped
+        updateFrameCapture(m_config, frameCapture);
+        if (frameCapture) { frameCapture->captureFrame(m_window.getFrameBufferSize()); }
 
         // Controls and UI
         ImGuiIO io = ImGui::GetIO();
@@ -70,7 +271,9 @@ int main(int argc, char* argv[]) {
         if (!io.WantCaptureMouse) { mainCamera.updateInput(); }
 
         // Processes input and swaps the window buffer
+        profiler.beginSection("UI and swap");
         m_window.swapBuffers();
+        profiler.endSection();
     }
 
     return EXIT_SUCCESS;
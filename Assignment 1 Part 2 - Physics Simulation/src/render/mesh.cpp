@@ -4,7 +4,11 @@
 DISABLE_WARNINGS_PUSH()
 #include <fmt/format.h>
 DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <utility>
 #include <vector>
 
 GPUMesh::GPUMesh(std::filesystem::path filePath, bool normalize)
@@ -13,8 +17,68 @@ GPUMesh::GPUMesh(std::filesystem::path filePath, bool normalize)
         throw MeshLoadingException(fmt::format("File {} does not exist", filePath.string().c_str()));
 
     // Defined in <framework/mesh.h>
-    const auto cpuMesh = mergeMeshes(loadMesh(filePath, normalize));
+    upload(mergeMeshes(loadMesh(filePath, normalize)));
+}
+
+GPUMesh::GPUMesh(const Mesh& cpuMesh)
+{
+    upload(cpuMesh);
+}
+
+GPUMesh GPUMesh::icosphere(uint32_t subdivisions)
+{
+    // Icosahedron spanned by three orthogonal golden rectangles
+    const float phi = (1.0f + std::sqrt(5.0f)) / 2.0f;
+    std::vector<glm::vec3> positions = {
+        { -1, phi, 0 }, { 1, phi, 0 }, { -1, -phi, 0 }, { 1, -phi, 0 },
+        { 0, -1, phi }, { 0, 1, phi }, { 0, -1, -phi }, { 0, 1, -phi },
+        { phi, 0, -1 }, { phi, 0, 1 }, { -phi, 0, -1 }, { -phi, 0, 1 }
+    };
+    std::vector<glm::uvec3> triangles = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+    };
+
+    // Split every edge at its midpoint; edges shared by two triangles reuse the same midpoint vertex
+    for (uint32_t subdivision = 0; subdivision < subdivisions; subdivision++) {
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> midpoints;
+        const auto midpoint = [&](uint32_t a, uint32_t b) {
+            const auto edge = std::minmax(a, b);
+            auto [iter, inserted] = midpoints.try_emplace(edge, static_cast<uint32_t>(positions.size()));
+            if (inserted)
+                positions.push_back((positions[a] + positions[b]) * 0.5f);
+            return iter->second;
+        };
+
+        std::vector<glm::uvec3> subdividedTriangles;
+        subdividedTriangles.reserve(4 * triangles.size());
+        for (const glm::uvec3& triangle : triangles) {
+            const uint32_t ab = midpoint(triangle.x, triangle.y);
+            const uint32_t bc = midpoint(triangle.y, triangle.z);
+            const uint32_t ca = midpoint(triangle.z, triangle.x);
+            subdividedTriangles.push_back({ triangle.x, ab, ca });
+            subdividedTriangles.push_back({ triangle.y, bc, ab });
+            subdividedTriangles.push_back({ triangle.z, ca, bc });
+            subdividedTriangles.push_back({ ab, bc, ca });
+        }
+        triangles = std::move(subdividedTriangles);
+    }
+
+    // Project onto the unit sphere, where the normal equals the position
+    Mesh cpuMesh;
+    cpuMesh.triangles = std::move(triangles);
+    cpuMesh.vertices.reserve(positions.size());
+    for (const glm::vec3& position : positions) {
+        const glm::vec3 normal = glm::normalize(position);
+        cpuMesh.vertices.push_back({ normal, normal, glm::vec2(0.0f) });
+    }
+    return GPUMesh(cpuMesh);
+}
 
+void GPUMesh::upload(const Mesh& cpuMesh)
+{
     // Create VAO and bind it so subsequent creations of VBO and IBO are bound to this VAO
     glGenVertexArrays(1, &m_vao);
     glBindVertexArray(m_vao);
@@ -67,6 +131,11 @@ bool GPUMesh::hasTextureCoords() const
     return m_hasTextureCoords;
 }
 
+GLsizei GPUMesh::numIndices() const
+{
+    return m_numIndices;
+}
+
 void GPUMesh::draw() const
 {
     glBindVertexArray(m_vao);
@@ -79,6 +148,30 @@ void GPUMesh::drawInstanced(GLsizei instanceCount)
     glDrawElementsInstanced(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, 0, instanceCount);
 }
 
+void GPUMesh::drawInstancedIndirect(GLintptr commandOffset)
+{
+    glBindVertexArray(m_vao);
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(commandOffset));
+}
+
+void GPUMesh::setInstanceAttribute(GLuint location, GLuint buffer)
+{
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), nullptr);
+    glVertexAttribDivisor(location, 1);
+}
+
+void GPUMesh::setInstanceIndexAttribute(GLuint location, GLuint buffer)
+{
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(location);
+    glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+    glVertexAttribDivisor(location, 1);
+}
+
 void GPUMesh::moveInto(GPUMesh&& other)
 {
     freeGpuMemory();
@@ -1,8 +1,11 @@
 #pragma once
 #include <exception>
+#include <stdint.h>
 #include <filesystem>
 #include <framework/opengl_includes.h>
 
+struct Mesh;
+
 struct MeshLoadingException : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
@@ -10,6 +13,7 @@ struct MeshLoadingException : public std::runtime_error {
 class GPUMesh {
 public:
     GPUMesh(std::filesystem::path filePath, bool normalize = false);
+    GPUMesh(const Mesh& cpuMesh);
     // Cannot copy a GPU mesh because it would require reference counting of GPU resources.
     GPUMesh(const GPUMesh&) = delete;
     GPUMesh(GPUMesh&&);
@@ -19,7 +23,11 @@ public:
     GPUMesh& operator=(const GPUMesh&) = delete;
     GPUMesh& operator=(GPUMesh&&);
 
+    // Unit sphere made by subdividing every triangle of an icosahedron into four, the given number of times.
+    static GPUMesh icosphere(uint32_t subdivisions);
+
     bool hasTextureCoords() const;
+    GLsizei numIndices() const;
 
     // Bind VAO and call glDrawElements.
     void draw() const;
@@ -27,7 +35,16 @@ public:
     // Bind VAO and call glDrawElementsInstanced with the given number of instances.
     void drawInstanced(GLsizei instanceCount);
 
+    // Bind VAO and call glDrawElementsIndirect with the command at the given offset into the bound GL_DRAW_INDIRECT_BUFFER.
+    void drawInstancedIndirect(GLintptr commandOffset);
+
+    // Source the vertex attribute at the given location from a buffer of tightly packed vec4s, advancing once per instance.
+    void setInstanceAttribute(GLuint location, GLuint buffer);
+    // Same as above for a buffer of uints, read as an integer attribute.
+    void setInstanceIndexAttribute(GLuint location, GLuint buffer);
+
 private:
+    void upload(const Mesh& cpuMesh);
     void moveInto(GPUMesh&&);
     void freeGpuMemory();
 
@@ -0,0 +1,343 @@
+#include "particle_culling.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+#include <glm/gtc/type_ptr.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <utils/constants.h>
+#include <utils/render_utils.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+
+// Mirror the layouts the indirect draws read from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;    // Reserved before OpenGL 4.2, must be zero
+};
+struct DrawArraysIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;    // Reserved before OpenGL 4.2, must be zero
+};
+struct CullingCommands {
+    DrawElementsIndirectCommand meshes;
+    DrawArraysIndirectCommand quads;
+};
+
+ParticleCulling::ParticleCulling(const Config& config, GLsizei meshIndexCount)
+    : config(config)
+    , numMeshIndices(meshIndexCount) {
+    initShaders();
+    initBuffersAndTextures();
+}
+
+ParticleCulling::~ParticleCulling() {
+    deleteHiZ();
+    deleteBuffersAndTextures();
+}
+
+bool ParticleCulling::enabled() const {
+    return config.frustumCulling || config.occlusionCulling;
+}
+
+void ParticleCulling::setView(const glm::mat4& viewProjection) {
+    // Planes of the clip-space inequalities -w <= x, y, z <= w, transformed to world space by the rows of the view-projection
+    const glm::mat4 rows = glm::transpose(viewProjection);
+    for (size_t axis = 0UL; axis < 3UL; axis++) {
+        frustumPlanes[2UL * axis]       = rows[3] + rows[static_cast<glm::length_t>(axis)];
+        frustumPlanes[2UL * axis + 1UL] = rows[3] - rows[static_cast<glm::length_t>(axis)];
+    }
+    for (glm::vec4& plane : frustumPlanes) { plane /= glm::length(glm::vec3(plane)); }
+}
+
+void ParticleCulling::setCullingUniforms(const Shader& pass) const {
+    glUniform1i(pass.getUniformLocation("frustumCulling"), config.frustumCulling);
+    glUniform4fv(pass.getUniformLocation("frustumPlanes"), static_cast<GLsizei>(frustumPlanes.size()), glm::value_ptr(frustumPlanes[0]));
+
+    // The pyramid is only built while occlusion culling is on, so the first frame after enabling it is only frustum culled
+    const bool occlusionCulling = config.occlusionCulling && hiZValid;
+    glUniform1i(pass.getUniformLocation("occlusionCulling"), occlusionCulling);
+    if (!occlusionCulling) { return; }
+    glUniformMatrix4fv(pass.getUniformLocation("hiZViewProjection"), 1, GL_FALSE, glm::value_ptr(hiZViewProjection));
+    glActiveTexture(GL_TEXTURE0 + HI_Z_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, hiZTex);
+}
+
+void ParticleCulling::cull(GLuint positionTex, GLenum positionTexTarget, GLuint particlePropertiesTex) {
+    ensureIndexBufferCapacity();
+
+    // Both position samplers need their own unit, since samplers of different types may not share one
+    glActiveTexture(positionTexTarget == GL_TEXTURE_BUFFER ? GL_TEXTURE0 + 1 : GL_TEXTURE0);
+    glBindTexture(positionTexTarget, positionTex);
+    glActiveTexture(GL_TEXTURE0 + 2);
+    glBindTexture(GL_TEXTURE_BUFFER, particlePropertiesTex);
+    for (const Shader* pass : { &compactPass, &countPass }) {
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("positionsInBuffer"), positionTexTarget == GL_TEXTURE_BUFFER);
+        setCullingUniforms(*pass);
+    }
+
+    compact();
+    count();
+    writeCommands();
+}
+
+void ParticleCulling::drawMeshes(GPUMesh& mesh, GLuint particleIndexLocation) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    mesh.setInstanceIndexAttribute(particleIndexLocation, visibleBuffer);
+    mesh.drawInstancedIndirect(static_cast<GLintptr>(offsetof(CullingCommands, meshes)));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void ParticleCulling::drawQuads(GLuint particleIndexLocation) {
+    glBindVertexArray(quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, visibleBuffer);
+    glEnableVertexAttribArray(particleIndexLocation);
+    glVertexAttribIPointer(particleIndexLocation, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+    glVertexAttribDivisor(particleIndexLocation, 1);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glDrawArraysIndirect(GL_TRIANGLE_STRIP, reinterpret_cast<const void*>(offsetof(CullingCommands, quads)));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void ParticleCulling::updateHiZ(const glm::mat4& viewProjection, const std::array<GLint, 4UL>& viewport) {
+    if (!config.occlusionCulling) {
+        hiZValid = false;
+        return;
+    }
+    ensureHiZ(viewport[2], viewport[3]);
+
+    // The finest level is a copy of the depth buffer; its format may differ, but depth-to-depth copies convert
+    glBindTexture(GL_TEXTURE_2D, hiZTex);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    // Every further level keeps the farthest depth of the level below, written as the fragment depth. Only the level below is
+    // sampled, so the level rendered to is outside the sampled range and does not form a feedback loop
+    GLint previousDepthFunc;
+    glGetIntegerv(GL_DEPTH_FUNC, &previousDepthFunc);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_ALWAYS);
+    hiZReducePass.bind();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, hiZTex);
+    GLsizei levelWidth = hiZWidth, levelHeight = hiZHeight;
+    for (size_t level = 1UL; level <= hiZFramebuffers.size(); level++) {
+        levelWidth  = std::max(levelWidth / 2, 1);
+        levelHeight = std::max(levelHeight / 2, 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level - 1UL));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(level - 1UL));
+        glBindFramebuffer(GL_FRAMEBUFFER, hiZFramebuffers[level - 1UL]);
+        glViewport(0, 0, levelWidth, levelHeight);
+        utils::renderQuad(hiZReducePass);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(hiZFramebuffers.size()));
+    glDepthFunc(static_cast<GLenum>(previousDepthFunc));
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    hiZViewProjection   = viewProjection;
+    hiZValid            = true;
+}
+
+void ParticleCulling::initShaders() {
+    // Compaction shader, capturing the indices of the visible particles
+    try {
+        ShaderBuilder compactBuilder;
+        compactBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-cull.vert");
+        compactBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-culling.glsl");
+        compactBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        compactBuilder.addStage(GL_GEOMETRY_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-cull-compact.geom");
+        compactBuilder.setTransformFeedbackVaryings({ "visibleParticleIdx" }, GL_INTERLEAVED_ATTRIBS);
+        compactPass = compactBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Count shader, testing every particle again to add the visible ones to the count
+    try {
+        ShaderBuilder countBuilder;
+        countBuilder.addStage(GL_VERTEX_SHADER,     utils::SHADERS_DIR_PATH / "simulation" / "particle-cull.vert");
+        countBuilder.addStage(GL_VERTEX_SHADER,     utils::SHADERS_DIR_PATH / "simulation" / "particle-culling.glsl");
+        countBuilder.addStage(GL_VERTEX_SHADER,     utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        countBuilder.addStage(GL_FRAGMENT_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-lod-count.frag");
+        countPass = countBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Indirect command shader
+    try {
+        ShaderBuilder commandsBuilder;
+        commandsBuilder.addStage(GL_VERTEX_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-cull-commands.vert");
+        commandsBuilder.setTransformFeedbackVaryings({ "meshCount", "meshInstanceCount", "meshFirstIndex", "meshBaseVertex", "meshBaseInstance",
+                                                       "quadCount", "quadInstanceCount", "quadFirst", "quadBaseInstance" }, GL_INTERLEAVED_ATTRIBS);
+        commandsPass = commandsBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Hierarchical-Z reduction shader
+    try {
+        ShaderBuilder hiZReduceBuilder;
+        hiZReduceBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "screen-quad.vert");
+        hiZReduceBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "hi-z-reduce.frag");
+        hiZReducePass = hiZReduceBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Texture units and the index count of the mesh never change; the buffer of the stored position representation is bound by ParticlesSimulator
+    for (const Shader* pass : { &compactPass, &countPass }) {
+        pass->setUniformBlockBinding("PositionTiling", utils::POSITION_TILING_BINDING);
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("positions"), 0);
+        glUniform1i(pass->getUniformLocation("positionBuffer"), 1);
+        glUniform1i(pass->getUniformLocation("particleProperties"), 2);
+        glUniform1i(pass->getUniformLocation("hiZ"), HI_Z_TEXTURE_UNIT);
+    }
+    commandsPass.bind();
+    glUniform1i(commandsPass.getUniformLocation("visibleCount"), 0);
+    glUniform1ui(commandsPass.getUniformLocation("numMeshIndices"), static_cast<GLuint>(numMeshIndices));
+    hiZReducePass.bind();
+    glUniform1i(hiZReducePass.getUniformLocation("previousLevel"), 0);
+}
+
+void ParticleCulling::initBuffersAndTextures() {
+    // The visible list is sized on first use, once the particle count is known
+    glGenBuffers(1, &visibleBuffer);
+    glGenTransformFeedbacks(1, &compactTransformFeedback);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, compactTransformFeedback);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, visibleBuffer);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+
+    // A float count is exact up to 2^24 particles, and float targets support the additive blending used to count
+    glGenTextures(1, &countTex);
+    glBindTexture(GL_TEXTURE_2D, countTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenFramebuffers(1, &countFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, countFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, countTex, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise culling count framebuffer" << std::endl; }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Draw nothing until the first culling pass
+    const CullingCommands emptyCommands {};
+    glGenBuffers(1, &commandBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(emptyCommands), &emptyCommands, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenVertexArrays(1, &emptyVAO);
+    glGenVertexArrays(1, &quadVAO);
+}
+
+void ParticleCulling::deleteBuffersAndTextures() {
+    glDeleteBuffers(1, &visibleBuffer);
+    glDeleteTransformFeedbacks(1, &compactTransformFeedback);
+    glDeleteFramebuffers(1, &countFramebuffer);
+    glDeleteTextures(1, &countTex);
+    glDeleteBuffers(1, &commandBuffer);
+    glDeleteVertexArrays(1, &emptyVAO);
+    glDeleteVertexArrays(1, &quadVAO);
+}
+
+void ParticleCulling::ensureIndexBufferCapacity() {
+    // Every particle could be visible
+    if (indexBufferCapacity >= config.numParticles) { return; }
+    indexBufferCapacity = config.numParticles;
+    glBindBuffer(GL_ARRAY_BUFFER, visibleBuffer);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(indexBufferCapacity * sizeof(GLuint)), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleCulling::ensureHiZ(GLsizei width, GLsizei height) {
+    if (hiZTex != 0U && width == hiZWidth && height == hiZHeight) { return; }
+    deleteHiZ();
+    hiZWidth    = width;
+    hiZHeight   = height;
+
+    // Levels halve down to 1x1, rounding down; the last texel of a level with an odd size below covers three texels of it
+    glGenTextures(1, &hiZTex);
+    glBindTexture(GL_TEXTURE_2D, hiZTex);
+    GLsizei levelWidth = width, levelHeight = height;
+    GLint numLevels = 0;
+    while (true) {
+        glTexImage2D(GL_TEXTURE_2D, numLevels++, GL_DEPTH_COMPONENT32F, levelWidth, levelHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        if (levelWidth == 1 && levelHeight == 1) { break; }
+        levelWidth  = std::max(levelWidth / 2, 1);
+        levelHeight = std::max(levelHeight / 2, 1);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+
+    hiZFramebuffers.resize(static_cast<size_t>(numLevels - 1));
+    glGenFramebuffers(static_cast<GLsizei>(hiZFramebuffers.size()), hiZFramebuffers.data());
+    for (size_t level = 1UL; level <= hiZFramebuffers.size(); level++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, hiZFramebuffers[level - 1UL]);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, hiZTex, static_cast<GLint>(level));
+        glDrawBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise hierarchical-Z framebuffer of level " << level << std::endl; }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ParticleCulling::deleteHiZ() {
+    if (hiZTex == 0U) { return; }
+    glDeleteFramebuffers(static_cast<GLsizei>(hiZFramebuffers.size()), hiZFramebuffers.data());
+    hiZFramebuffers.clear();
+    glDeleteTextures(1, &hiZTex);
+    hiZTex      = 0U;
+    hiZValid    = false;
+}
+
+void ParticleCulling::compact() {
+    compactPass.bind();
+
+    // One point per particle, only captured and never rasterized
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(emptyVAO);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, compactTransformFeedback);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
+    glEndTransformFeedback();
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void ParticleCulling::count() {
+    glBindFramebuffer(GL_FRAMEBUFFER, countFramebuffer);
+    glViewport(0, 0, 1, 1);
+    constexpr std::array<GLfloat, 4UL> zeroCount = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, zeroCount.data());
+
+    // Visible particles land on the single texel, culled ones outside the viewport
+    countPass.bind();
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
+    glDisable(GL_BLEND);
+}
+
+void ParticleCulling::writeCommands() {
+    commandsPass.bind();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, countTex);
+
+    // A single vertex, captured as both indirect draw commands
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(emptyVAO);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, commandBuffer);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, 1);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
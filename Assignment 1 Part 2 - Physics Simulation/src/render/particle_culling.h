@@ -0,0 +1,91 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <framework/opengl_includes.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/shader.h>
+
+#include <render/mesh.h>
+#include <utils/config.h>
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+
+// Frustum and occlusion culling of the particle instances
+// Every frame, the bounding sphere of every particle is tested against the planes of the view frustum and, optionally, against
+// a hierarchical-Z buffer (a pyramid of the farthest depth of every 2x2 block of the level below) of the particles drawn in the
+// previous frame. Without any readback to the CPU, a transform-feedback pass compacts the indices of the visible particles, a
+// second pass counts them into a single texel by blending, and a last transform-feedback pass turns that count into indirect
+// draw commands. Passes of other classes link particle-culling.glsl to skip culled particles themselves (see ParticleLods)
+class ParticleCulling {
+public:
+    // Texture unit of the hierarchical-Z buffer in every pass linking particle-culling.glsl
+    static constexpr GLint HI_Z_TEXTURE_UNIT = 3;
+
+    // meshIndexCount is the index count of the mesh drawn by drawMeshes()
+    ParticleCulling(const Config& config, GLsizei meshIndexCount);
+    ~ParticleCulling();
+
+    ParticleCulling(const ParticleCulling&) = delete;
+    ParticleCulling& operator=(const ParticleCulling&) = delete;
+
+    // Indicates whether any culling is enabled, otherwise every particle is visible
+    bool enabled() const;
+
+    // Frustum of the frame about to be drawn
+    void setView(const glm::mat4& viewProjection);
+    // Set the uniforms of particle-culling.glsl of the bound pass and bind the hierarchical-Z buffer
+    void setCullingUniforms(const Shader& pass) const;
+
+    // Positions are read from a state texture (GL_TEXTURE_2D) or a buffer texture over a state buffer (GL_TEXTURE_BUFFER)
+    // The radius of every particle is read from the buffer texture over the particle properties
+    void cull(GLuint positionTex, GLenum positionTexTarget, GLuint particlePropertiesTex);
+
+    // One indirect instanced draw of the visible particles with the bound shader, which reads the particle index of every
+    // instance from the given attribute: of the mesh, or of a 4-vertex triangle strip per particle
+    void drawMeshes(GPUMesh& mesh, GLuint particleIndexLocation);
+    void drawQuads(GLuint particleIndexLocation);
+
+    // Build the hierarchical-Z buffer from the depth of the bound framebuffer within the given viewport, once the particles of
+    // the frame are drawn, to test the particles of the next frame against
+    void updateHiZ(const glm::mat4& viewProjection, const std::array<GLint, 4UL>& viewport);
+
+private:
+    // Shared state
+    const Config& config;
+
+    // Internal variables
+    GLsizei numMeshIndices;
+    std::array<glm::vec4, 6UL> frustumPlanes;               // World-space planes with inward unit normals, as (normal, offset)
+    uint32_t indexBufferCapacity = 0U;                      // Number of particle indices the visible list can hold
+    GLuint visibleBuffer;                                   // Compacted indices of the visible particles
+    GLuint compactTransformFeedback;                        // Captures the compaction pass into the visible list
+    GLuint countFramebuffer, countTex;                      // 1x1 texture holding the number of visible particles
+    GLuint commandBuffer;                                   // DrawElementsIndirectCommand for meshes, then DrawArraysIndirectCommand for quads
+    GLuint emptyVAO;                                        // Attribute-less VAO for the passes that only use gl_VertexID
+    GLuint quadVAO;                                         // Instanced particle indices for drawQuads()
+    GLuint hiZTex = 0U;                                     // Depth pyramid (farthest depth of the level below), 0 until first built
+    std::vector<GLuint> hiZFramebuffers;                    // Render to every level of the pyramid but the first
+    GLsizei hiZWidth = 0, hiZHeight = 0;
+    glm::mat4 hiZViewProjection;                            // View-projection of the frame the pyramid was built from
+    bool hiZValid = false;                                  // Indicates whether the pyramid holds the depth of the previous frame
+    Shader compactPass, countPass, commandsPass, hiZReducePass;
+
+    // Setup
+    void initShaders();
+    void initBuffersAndTextures();
+    void deleteBuffersAndTextures();
+    void ensureIndexBufferCapacity();
+    void ensureHiZ(GLsizei width, GLsizei height);
+    void deleteHiZ();
+
+    // Culling steps
+    void compact();
+    void count();
+    void writeCommands();
+};
@@ -0,0 +1,207 @@
+#include "particle_lods.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/type_ptr.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <iostream>
+
+
+// Mirrors the layout the indirect draw reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;    // Reserved before OpenGL 4.2, must be zero
+};
+
+ParticleLods::ParticleLods(const Config& config)
+    : config(config) {
+    for (uint32_t lod = 0U; lod < utils::NUM_PARTICLE_LODS; lod++) {
+        meshes.push_back(GPUMesh::icosphere(utils::NUM_PARTICLE_LODS - 1U - lod));
+    }
+    initShaders();
+    initBuffersAndTextures();
+}
+
+ParticleLods::~ParticleLods() {
+    deleteBuffersAndTextures();
+}
+
+void ParticleLods::bin(GLuint positionTex, GLenum positionTexTarget, GLuint particlePropertiesTex, const glm::vec3& cameraPosition, float screenScale, const ParticleCulling& culling) {
+    ensureIndexBufferCapacity();
+
+    // Both position samplers need their own unit, since samplers of different types may not share one
+    glActiveTexture(positionTexTarget == GL_TEXTURE_BUFFER ? GL_TEXTURE0 + 1 : GL_TEXTURE0);
+    glBindTexture(positionTexTarget, positionTex);
+    glActiveTexture(GL_TEXTURE0 + 2);
+    glBindTexture(GL_TEXTURE_BUFFER, particlePropertiesTex);
+    for (const Shader* pass : { &compactPass, &countPass }) {
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("positionsInBuffer"), positionTexTarget == GL_TEXTURE_BUFFER);
+        glUniform3fv(pass->getUniformLocation("cameraPosition"), 1, glm::value_ptr(cameraPosition));
+        glUniform1f(pass->getUniformLocation("screenScale"), screenScale);
+        glUniform2fv(pass->getUniformLocation("lodSwitchPixelRadii"), 1, glm::value_ptr(config.lodSwitchPixelRadii));
+        culling.setCullingUniforms(*pass);
+    }
+
+    compact();
+    count();
+    writeCommands();
+}
+
+void ParticleLods::draw(GLuint particleIndexLocation) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    for (uint32_t lod = 0U; lod < utils::NUM_PARTICLE_LODS; lod++) {
+        meshes[lod].setInstanceIndexAttribute(particleIndexLocation, indexBuffers[lod]);
+        meshes[lod].drawInstancedIndirect(static_cast<GLintptr>(lod * sizeof(DrawElementsIndirectCommand)));
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void ParticleLods::initShaders() {
+    // Compaction shader, sorting particle indices into one stream per LOD
+    try {
+        ShaderBuilder compactBuilder;
+        compactBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-lod-select.vert");
+        compactBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        compactBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-culling.glsl");
+        compactBuilder.addStage(GL_GEOMETRY_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-lod-compact.geom");
+        compactBuilder.setTransformFeedbackVaryings({ "lod0ParticleIdx", "gl_NextBuffer", "lod1ParticleIdx", "gl_NextBuffer", "lod2ParticleIdx" }, GL_INTERLEAVED_ATTRIBS);
+        compactPass = compactBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Count shader, selecting the LOD of every particle again to add it to the count of that LOD
+    try {
+        ShaderBuilder countBuilder;
+        countBuilder.addStage(GL_VERTEX_SHADER,     utils::SHADERS_DIR_PATH / "simulation" / "particle-lod-select.vert");
+        countBuilder.addStage(GL_VERTEX_SHADER,     utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        countBuilder.addStage(GL_VERTEX_SHADER,     utils::SHADERS_DIR_PATH / "simulation" / "particle-culling.glsl");
+        countBuilder.addStage(GL_FRAGMENT_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-lod-count.frag");
+        countPass = countBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Indirect command shader
+    try {
+        ShaderBuilder commandsBuilder;
+        commandsBuilder.addStage(GL_VERTEX_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-lod-commands.vert");
+        commandsBuilder.setTransformFeedbackVaryings({ "commandCount", "commandInstanceCount", "commandFirstIndex", "commandBaseVertex", "commandBaseInstance" }, GL_INTERLEAVED_ATTRIBS);
+        commandsPass = commandsBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Texture units and the index counts of the meshes never change; the buffer of the stored position representation is bound by ParticlesSimulator
+    for (const Shader* pass : { &compactPass, &countPass }) {
+        pass->setUniformBlockBinding("PositionTiling", utils::POSITION_TILING_BINDING);
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("positions"), 0);
+        glUniform1i(pass->getUniformLocation("positionBuffer"), 1);
+        glUniform1i(pass->getUniformLocation("particleProperties"), 2);
+        glUniform1i(pass->getUniformLocation("hiZ"), ParticleCulling::HI_Z_TEXTURE_UNIT);
+        glUniform1ui(pass->getUniformLocation("numLods"), utils::NUM_PARTICLE_LODS);
+    }
+    std::array<GLuint, utils::NUM_PARTICLE_LODS> lodIndexCounts;
+    for (uint32_t lod = 0U; lod < utils::NUM_PARTICLE_LODS; lod++) { lodIndexCounts[lod] = static_cast<GLuint>(meshes[lod].numIndices()); }
+    commandsPass.bind();
+    glUniform1i(commandsPass.getUniformLocation("lodCounts"), 0);
+    glUniform1uiv(commandsPass.getUniformLocation("lodIndexCounts"), utils::NUM_PARTICLE_LODS, lodIndexCounts.data());
+}
+
+void ParticleLods::initBuffersAndTextures() {
+    // Index buffers are sized on first use, once the particle count is known
+    glGenBuffers(static_cast<GLsizei>(indexBuffers.size()), indexBuffers.data());
+    glGenTransformFeedbacks(1, &compactTransformFeedback);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, compactTransformFeedback);
+    for (uint32_t lod = 0U; lod < utils::NUM_PARTICLE_LODS; lod++) {
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, lod, indexBuffers[lod]);
+    }
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+
+    // Float counts are exact up to 2^24 particles per LOD, and float targets support the additive blending used to count
+    glGenTextures(1, &countTex);
+    glBindTexture(GL_TEXTURE_2D, countTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, utils::NUM_PARTICLE_LODS, 1, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenFramebuffers(1, &countFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, countFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, countTex, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise LOD count framebuffer" << std::endl; }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Draw nothing until the first binning pass
+    const std::array<DrawElementsIndirectCommand, utils::NUM_PARTICLE_LODS> emptyCommands {};
+    glGenBuffers(1, &commandBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(emptyCommands), emptyCommands.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+void ParticleLods::deleteBuffersAndTextures() {
+    glDeleteBuffers(static_cast<GLsizei>(indexBuffers.size()), indexBuffers.data());
+    glDeleteTransformFeedbacks(1, &compactTransformFeedback);
+    glDeleteFramebuffers(1, &countFramebuffer);
+    glDeleteTextures(1, &countTex);
+    glDeleteBuffers(1, &commandBuffer);
+    glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void ParticleLods::ensureIndexBufferCapacity() {
+    // Every particle could end up in the same LOD
+    if (indexBufferCapacity >= config.numParticles) { return; }
+    indexBufferCapacity = config.numParticles;
+    for (GLuint indexBuffer : indexBuffers) {
+        glBindBuffer(GL_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(indexBufferCapacity * sizeof(GLuint)), nullptr, GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleLods::compact() {
+    compactPass.bind();
+
+    // One point per particle, only captured and never rasterized
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(emptyVAO);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, compactTransformFeedback);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
+    glEndTransformFeedback();
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void ParticleLods::count() {
+    glBindFramebuffer(GL_FRAMEBUFFER, countFramebuffer);
+    glViewport(0, 0, utils::NUM_PARTICLE_LODS, 1);
+    constexpr std::array<GLfloat, 4UL> zeroCounts = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, zeroCounts.data());
+
+    // Counting is done in a pass of its own rather than by replaying the captured points with glDrawTransformFeedbackStream,
+    // whose vertex count is unreliable for interleaved multi-stream captures on some drivers
+    countPass.bind();
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
+    glDisable(GL_BLEND);
+}
+
+void ParticleLods::writeCommands() {
+    commandsPass.bind();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, countTex);
+
+    // One vertex per LOD, each captured as a complete indirect draw command
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(emptyVAO);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, commandBuffer);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, utils::NUM_PARTICLE_LODS);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
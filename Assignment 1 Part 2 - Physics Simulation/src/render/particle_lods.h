@@ -0,0 +1,63 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <framework/opengl_includes.h>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/shader.h>
+
+#include <render/mesh.h>
+#include <render/particle_culling.h>
+#include <utils/config.h>
+#include <utils/constants.h>
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+
+// Icosphere levels of detail for instanced particle drawing
+// Every frame, particles are binned by their projected radius without any readback to the CPU: a transform-feedback pass
+// compacts the indices of the particles of every LOD into their own buffer (one geometry shader stream per LOD), a second pass
+// over the particles sums the count of every LOD into a tiny texture by blending, and a last transform-feedback pass turns
+// those counts into one indirect draw command per LOD
+class ParticleLods {
+public:
+    ParticleLods(const Config& config);
+    ~ParticleLods();
+
+    // Positions are read from a state texture (GL_TEXTURE_2D) or a buffer texture over a state buffer (GL_TEXTURE_BUFFER)
+    // The radius of every particle is read from the buffer texture over the particle properties
+    // screenScale is the projected size in pixels of a unit length at unit distance from the camera
+    // Particles the culling rejects are left out of every LOD
+    void bin(GLuint positionTex, GLenum positionTexTarget, GLuint particlePropertiesTex, const glm::vec3& cameraPosition, float screenScale, const ParticleCulling& culling);
+
+    // One indirect instanced draw per LOD with the bound shader, which reads the particle index of every instance from the given attribute
+    void draw(GLuint particleIndexLocation);
+
+private:
+    // Shared state
+    const Config& config;
+
+    // Internal variables
+    std::vector<GPUMesh> meshes;                                            // Finest LOD first
+    uint32_t indexBufferCapacity = 0U;                                      // Number of particle indices every index buffer can hold
+    std::array<GLuint, utils::NUM_PARTICLE_LODS> indexBuffers;              // Compacted indices of the particles drawn with every LOD
+    GLuint compactTransformFeedback;                                        // Captures the compaction pass into the index buffers
+    GLuint countFramebuffer, countTex;                                      // NUM_PARTICLE_LODS x 1 texture holding the particle count per LOD
+    GLuint commandBuffer;                                                   // One DrawElementsIndirectCommand per LOD
+    GLuint emptyVAO;                                                        // Attribute-less VAO for the passes that only use gl_VertexID
+    Shader compactPass, countPass, commandsPass;
+
+    // Setup
+    void initShaders();
+    void initBuffersAndTextures();
+    void deleteBuffersAndTextures();
+    void ensureIndexBufferCapacity();
+
+    // Binning steps
+    void compact();
+    void count();
+    void writeCommands();
+};
@@ -0,0 +1,144 @@
+#include "particle_trails.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/type_ptr.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <utils/constants.h>
+
+#include <algorithm>
+#include <iostream>
+
+
+ParticleTrails::ParticleTrails(const Config& config)
+    : config(config) {
+    initShaders();
+    glGenFramebuffers(1, &copyFramebuffer);
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+ParticleTrails::~ParticleTrails() {
+    deleteRing();
+    glDeleteFramebuffers(1, &copyFramebuffer);
+    glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void ParticleTrails::reset(uint32_t width, uint32_t height) {
+    stateTexWidth   = width;
+    stateTexHeight  = height;
+    deleteRing();
+}
+
+void ParticleTrails::record(GLuint positionTex) {
+    if (!beginRecord()) { return; }
+
+    // Copy within the GPU: the position texture is read through a framebuffer straight into the ring layer
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFramebuffer);
+    glFramebufferTexture(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, positionTex, 0);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ringTex);
+    glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(newestLayer), 0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight));
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void ParticleTrails::recordFromBuffer(GLuint positionBuffer) {
+    if (!beginRecord()) { return; }
+
+    // Copy within the GPU: the state buffer is uploaded into the ring layer through the pixel unpack target
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, positionBuffer);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ringTex);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(newestLayer), static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), 1, GL_RGBA, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+bool ParticleTrails::beginRecord() {
+    // The ring only takes up memory while trails are drawn
+    if (!config.drawTrails) {
+        deleteRing();
+        return false;
+    }
+    ensureRing();
+    if (capacity == 0U) { return false; }
+
+    newestLayer = (newestLayer + 1U) % capacity;
+    numRecorded = std::min(numRecorded + 1U, capacity);
+    return true;
+}
+
+void ParticleTrails::draw(const glm::mat4& viewProjection) {
+    // A line strip needs at least two points
+    const uint32_t numPoints = std::min(static_cast<uint32_t>(std::max(config.trailLength, 0)), numRecorded);
+    if (!config.drawTrails || numPoints < 2U) { return; }
+
+    drawPass.bind();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ringTex);
+    glUniformMatrix4fv(drawPass.getUniformLocation("viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform1i(drawPass.getUniformLocation("newestLayer"), static_cast<GLint>(newestLayer));
+    glUniform1i(drawPass.getUniformLocation("capacity"), static_cast<GLint>(capacity));
+    glUniform1i(drawPass.getUniformLocation("numPoints"), static_cast<GLint>(numPoints));
+    glUniform3fv(drawPass.getUniformLocation("trailColor"), 1, glm::value_ptr(config.trailColor));
+
+    // Trails fade out with age, so they are blended over the scene without occluding each other
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(emptyVAO);
+    glDrawArraysInstanced(GL_LINE_STRIP, 0, static_cast<GLsizei>(numPoints), static_cast<GLsizei>(config.numParticles));
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
+
+void ParticleTrails::ensureRing() {
+    if (allocatedBudgetMb == config.trailMemoryBudgetMb) { return; }
+    deleteRing();
+
+    // As many layers as fit in the budget, but at least two so a trail can be drawn at all
+    GLint maxLayers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    const size_t layerBytes     = static_cast<size_t>(stateTexWidth) * stateTexHeight * 4UL * sizeof(uint16_t);
+    const size_t budgetBytes    = static_cast<size_t>(std::max(config.trailMemoryBudgetMb, 0)) * 1024UL * 1024UL;
+    allocatedBudgetMb           = config.trailMemoryBudgetMb;
+    capacity                    = static_cast<uint32_t>(std::min({ budgetBytes / std::max(layerBytes, 1UL), static_cast<size_t>(utils::TRAIL_MAX_LENGTH), static_cast<size_t>(maxLayers) }));
+    if (capacity < 2U) {
+        std::cerr << "Trail memory budget is too small for " << config.numParticles << " particles" << std::endl;
+        capacity = 0U;
+        return;
+    }
+
+    // Half precision suffices for drawing and halves the memory of every layer
+    glGenTextures(1, &ringTex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ringTex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA16F, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), static_cast<GLsizei>(capacity), 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    newestLayer = 0U;
+    numRecorded = 0U;
+}
+
+void ParticleTrails::deleteRing() {
+    glDeleteTextures(1, &ringTex);
+    ringTex             = 0U;
+    capacity            = 0U;
+    numRecorded         = 0U;
+    allocatedBudgetMb   = -1;
+}
+
+void ParticleTrails::initShaders() {
+    try {
+        ShaderBuilder drawBuilder;
+        drawBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-trail.vert");
+        drawBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        drawBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-trail.frag");
+        drawPass = drawBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // The texture unit never changes, so it is assigned once here instead of every frame. The ring holds positions as stored
+    // in the state, the buffer of their representation is bound by ParticlesSimulator
+    drawPass.setUniformBlockBinding("PositionTiling", utils::POSITION_TILING_BINDING);
+    drawPass.bind();
+    glUniform1i(drawPass.getUniformLocation("trailPositions"), 0);
+}
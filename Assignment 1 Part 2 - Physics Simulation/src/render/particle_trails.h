@@ -0,0 +1,58 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <framework/opengl_includes.h>
+#include <glm/mat4x4.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/shader.h>
+
+#include <utils/config.h>
+
+#include <stdint.h>
+
+
+// Motion trails through the last positions of every particle
+// Positions are copied on the GPU into a ring buffer of position textures (the layers of a 2D array texture, laid out like the
+// state textures) after every frame's steps. The ring holds as many layers as fit in the memory budget of the config, of which
+// the trail length selects the most recent ones. Trails are drawn straight from the ring as one line strip per particle, so both
+// memory and drawing cost scale with the particle count times the trail length
+class ParticleTrails {
+public:
+    ParticleTrails(const Config& config);
+    ~ParticleTrails();
+
+    ParticleTrails(const ParticleTrails&) = delete;
+    ParticleTrails& operator=(const ParticleTrails&) = delete;
+
+    // Size the ring for state textures of the given dimensions and forget the recorded positions
+    void reset(uint32_t width, uint32_t height);
+    // Append the latest positions, from a state texture or from a state buffer laid out like its texels
+    void record(GLuint positionTex);
+    void recordFromBuffer(GLuint positionBuffer);
+
+    void draw(const glm::mat4& viewProjection);
+
+private:
+    // Shared state
+    const Config& config;
+
+    // Internal variables
+    uint32_t stateTexWidth = 0U, stateTexHeight = 0U;
+    int allocatedBudgetMb = -1;                         // Memory budget the ring was sized for (-1 if not sized), to detect config changes
+    uint32_t capacity = 0U;                             // Number of layers of the ring, 0 while no ring is allocated
+    uint32_t newestLayer = 0U;
+    uint32_t numRecorded = 0U;                          // Number of layers holding recorded positions (at most capacity)
+    GLuint ringTex = 0U;                                // Past positions (RGB), one layer per recorded frame
+    GLuint copyFramebuffer;                             // Reads the position textures that are copied into the ring
+    GLuint emptyVAO;                                    // Attribute-less VAO for drawing, which only uses gl_VertexID and gl_InstanceID
+    Shader drawPass;
+
+    // Setup
+    void initShaders();
+    void ensureRing();
+    void deleteRing();
+
+    // Advances the ring to the layer the next positions are written to; returns false if trails are off
+    bool beginRecord();
+};
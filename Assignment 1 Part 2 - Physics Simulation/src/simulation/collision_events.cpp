@@ -0,0 +1,227 @@
+#include "collision_events.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <fmt/format.h>
+DISABLE_WARNINGS_POP()
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+
+CollisionEventRecorder::CollisionEventRecorder(const Config& config)
+    : config(config) {
+    for (Capture& capture : captures) {
+        glGenBuffers(1, &capture.buffer);
+        glGenTransformFeedbacks(1, &capture.transformFeedback);
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, capture.transformFeedback);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, capture.buffer);
+    }
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+}
+
+CollisionEventRecorder::~CollisionEventRecorder() {
+    closeLogFile();
+    for (Capture& capture : captures) {
+        glDeleteQueries(static_cast<GLsizei>(capture.writtenQueries.size()), capture.writtenQueries.data());
+        glDeleteQueries(static_cast<GLsizei>(capture.generatedQueries.size()), capture.generatedQueries.data());
+        glDeleteTransformFeedbacks(1, &capture.transformFeedback);
+        glDeleteBuffers(1, &capture.buffer);
+    }
+}
+
+void CollisionEventRecorder::update() {
+    updateLogFile();
+    collect(false);
+}
+
+void CollisionEventRecorder::beginFrame(uint64_t firstStep) {
+    capturing = logFile.is_open();
+    if (!capturing) { return; }
+
+    // Captures are used round-robin, so the next one is the oldest frame still in flight, if any
+    Capture& capture = captures[nextCapture];
+    if (capture.fence != nullptr) {
+        collectCapture(capture, true);
+        writePendingChunks(false);
+    }
+
+    const size_t capacity = static_cast<size_t>(std::max(config.collisionEventCapacity, 1));
+    if (capture.capacity != capacity) {
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, capture.buffer);
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(CollisionEvent)), nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+        capture.capacity = capacity;
+    }
+    capture.firstStep   = firstStep;
+    capture.numSteps    = 0U;
+
+    // Started right away and paused, so every step of the frame appends to the events of the previous ones
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, capture.transformFeedback);
+    glBeginTransformFeedback(GL_POINTS);
+    glPauseTransformFeedback();
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+}
+
+bool CollisionEventRecorder::isCapturing() const {
+    return capturing;
+}
+
+void CollisionEventRecorder::captureStep(uint32_t numParticles) {
+    Capture& capture = captures[nextCapture];
+    if (capture.numSteps == capture.writtenQueries.size()) {
+        capture.writtenQueries.emplace_back();
+        capture.generatedQueries.emplace_back();
+        glGenQueries(1, &capture.writtenQueries.back());
+        glGenQueries(1, &capture.generatedQueries.back());
+    }
+
+    // Primitives that did not fit in the buffer are generated but not written
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, capture.transformFeedback);
+    glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, capture.writtenQueries[capture.numSteps]);
+    glBeginQuery(GL_PRIMITIVES_GENERATED, capture.generatedQueries[capture.numSteps]);
+    glResumeTransformFeedback();
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(numParticles));
+    glPauseTransformFeedback();
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+    glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    capture.numSteps++;
+}
+
+void CollisionEventRecorder::endFrame() {
+    if (!capturing) { return; }
+    capturing = false;
+
+    Capture& capture = captures[nextCapture];
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, capture.transformFeedback);
+    glEndTransformFeedback();
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    capture.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();  // Make sure the fence is submitted, so polling it without flushing eventually succeeds
+    nextCapture = (nextCapture + 1UL) % CAPTURE_BUFFER_COUNT;
+}
+
+uint64_t CollisionEventRecorder::numEventsRecorded() const {
+    return eventsRecorded;
+}
+
+uint64_t CollisionEventRecorder::numEventsDropped() const {
+    return eventsDropped;
+}
+
+void CollisionEventRecorder::updateLogFile() {
+    const std::string logFilePath = config.recordCollisionEvents ? config.collisionEventFile : std::string();
+    if (logFilePath == openedLogFile) { return; }
+
+    // Everything captured so far belongs to the previous log
+    closeLogFile();
+    openedLogFile = logFilePath;
+    if (logFilePath.empty()) { return; }
+
+    logFile.open(logFilePath, std::ios::binary | std::ios::trunc);
+    if (!logFile) {
+        std::cerr << "Could not open " << logFilePath << " for writing" << std::endl;
+        logFile.close();
+        return;
+    }
+    CollisionEventLogHeader header;
+    std::memcpy(header.magic.data(), "PSIMEVNT", header.magic.size());
+    header.version      = COLLISION_EVENT_LOG_VERSION;
+    header.eventSize    = static_cast<uint32_t>(sizeof(CollisionEvent));
+    logFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    eventsRecorded  = 0UL;
+    eventsDropped   = 0UL;
+}
+
+void CollisionEventRecorder::closeLogFile() {
+    collect(true);
+    if (logFile.is_open()) { logFile.close(); }
+}
+
+bool CollisionEventRecorder::collectCapture(Capture& capture, bool wait) {
+    if (capture.fence == nullptr) { return true; }
+    const GLenum syncStatus = wait ? glClientWaitSync(capture.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED) : glClientWaitSync(capture.fence, 0, 0);
+    if (syncStatus == GL_TIMEOUT_EXPIRED) { return false; }
+    glDeleteSync(capture.fence);
+    capture.fence = nullptr;
+    if (syncStatus == GL_WAIT_FAILED) {
+        std::cerr << "Failed to read back the collision events of step " << capture.firstStep << std::endl;
+        return true;
+    }
+
+    // The queries finished before the fence, so their results are available without waiting
+    Chunk chunk;
+    chunk.header = CollisionEventChunkHeader { .firstStep = capture.firstStep, .numSteps = capture.numSteps, .numEvents = 0U, .numDropped = 0U, .padding = 0U };
+    for (uint32_t stepIdx = 0U; stepIdx < capture.numSteps; stepIdx++) {
+        GLuint written, generated;
+        glGetQueryObjectuiv(capture.writtenQueries[stepIdx], GL_QUERY_RESULT, &written);
+        glGetQueryObjectuiv(capture.generatedQueries[stepIdx], GL_QUERY_RESULT, &generated);
+        chunk.header.numEvents  += written;
+        chunk.header.numDropped += generated - written;
+    }
+    chunk.events.resize(chunk.header.numEvents);
+    glBindBuffer(GL_COPY_READ_BUFFER, capture.buffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, static_cast<GLsizeiptr>(chunk.events.size() * sizeof(CollisionEvent)), chunk.events.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    // Particles with more collisions in a step than the geometry shader can emit end their events with a marker holding the
+    // number of the others, which counts them as dropped instead
+    std::erase_if(chunk.events, [&chunk](const CollisionEvent& event) {
+        if (event.otherIdx != TRUNCATED_COLLISIONS) { return false; }
+        chunk.header.numDropped += static_cast<uint32_t>(event.impulse);
+        return true;
+    });
+    chunk.header.numEvents = static_cast<uint32_t>(chunk.events.size());
+
+    if (chunk.header.numDropped > 0U) {
+        std::cerr << "Dropped " << chunk.header.numDropped << " collision events of steps " << capture.firstStep << " to " << capture.firstStep + capture.numSteps - 1UL
+                  << " (capacity " << capture.capacity << " events per frame)" << std::endl;
+    }
+    eventsRecorded  += chunk.header.numEvents;
+    eventsDropped   += chunk.header.numDropped;
+    pendingChunks.push_back(std::move(chunk));
+    return true;
+}
+
+void CollisionEventRecorder::collect(bool wait) {
+    // Oldest capture first, so the chunks stay ordered by step
+    for (size_t offset = 0UL; offset < CAPTURE_BUFFER_COUNT; offset++) {
+        if (!collectCapture(captures[(nextCapture + offset) % CAPTURE_BUFFER_COUNT], wait)) { break; }
+    }
+    writePendingChunks(wait);
+}
+
+void CollisionEventRecorder::writePendingChunks(bool wait) {
+    if (logWrite.valid()) {
+        if (!wait && logWrite.wait_for(std::chrono::seconds(0)) != std::future_status::ready) { return; }
+        try {
+            logWrite.get();
+        } catch (const CollisionEventLogException& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+    if (pendingChunks.empty() || !logFile.is_open()) {
+        pendingChunks.clear();
+        return;
+    }
+
+    logWrite = std::async(std::launch::async, [this, chunks = std::move(pendingChunks), logFilePath = openedLogFile]() {
+        for (const Chunk& chunk : chunks) {
+            logFile.write(reinterpret_cast<const char*>(&chunk.header), sizeof(chunk.header));
+            logFile.write(reinterpret_cast<const char*>(chunk.events.data()), static_cast<std::streamsize>(chunk.events.size() * sizeof(CollisionEvent)));
+        }
+        if (!logFile.flush()) { throw CollisionEventLogException(fmt::format("Failed to write {}", logFilePath)); }
+    });
+    pendingChunks.clear();  // Moved from, but in an unspecified state
+
+    if (wait) {
+        try {
+            logWrite.get();
+        } catch (const CollisionEventLogException& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+}
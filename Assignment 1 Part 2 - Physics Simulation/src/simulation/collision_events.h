@@ -0,0 +1,129 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <framework/opengl_includes.h>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <utils/config.h>
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+struct CollisionEventLogException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Other index of a collision with the container wall
+constexpr uint32_t CONTAINER_COLLISION = 0xFFFFFFFFU;
+// Other index of the marker particle-collision-events.geom emits for a particle with more collisions in a step than it can emit
+// The marker holds the number of unrecorded collisions as its impulse; it is counted as dropped and never written to the log
+constexpr uint32_t TRUNCATED_COLLISIONS = 0xFFFFFFFEU;
+
+// One collision resolved by a particle in a step, as captured from particle-collision-events.geom. A collision between two
+// particles is resolved by both of them, so it appears twice, once from either side
+struct CollisionEvent {
+    uint32_t particleIdx;
+    uint32_t otherIdx;              // CONTAINER_COLLISION for the container wall
+    glm::vec3 contactPosition;      // Surface point of the other particle, or the wall point, closest to the particle
+    float impulse;                  // Mass times the change of velocity of the particle
+    uint32_t step;                  // Number of steps since the initial state, including the one the collision happened in
+};
+static_assert(sizeof(CollisionEvent) == 28UL, "CollisionEvent must match the interleaved transform feedback layout");
+
+// Header at the start of a collision event log. All values are stored in native byte order
+struct CollisionEventLogHeader {
+    std::array<char, 8UL> magic;    // "PSIMEVNT"
+    uint32_t version;
+    uint32_t eventSize;             // sizeof(CollisionEvent)
+};
+static_assert(sizeof(CollisionEventLogHeader) == 16UL, "CollisionEventLogHeader must not contain implicit padding");
+
+// The log header is followed by one chunk per recorded frame: this header, then numEvents CollisionEvent records ordered by step
+struct CollisionEventChunkHeader {
+    uint64_t firstStep;
+    uint32_t numSteps;
+    uint32_t numEvents;
+    uint32_t numDropped;            // Events of these steps that did not fit in the capture buffer (see Config::collisionEventCapacity), or
+                                    // were not emitted as a particle had more collisions in a step than the geometry shader can emit
+    uint32_t padding;
+};
+static_assert(sizeof(CollisionEventChunkHeader) == 24UL, "CollisionEventChunkHeader must not contain implicit padding");
+
+constexpr uint32_t COLLISION_EVENT_LOG_VERSION = 1U;
+
+// Streams the collision events of the GPU impulse solver to the binary log in Config::collisionEventFile
+// OpenGL 4.1 has no atomic counters or storage buffers to append events from the simulation shader, so the events are emitted by
+// a geometry shader that repeats the particle update, and transform feedback appends them to a capture buffer. The capture is
+// paused between the steps of a frame, so all steps land in one buffer, and per-step queries count the written and the dropped
+// events. The buffer is fenced and only read once the GPU has finished it; a worker thread then appends it to the log.
+// CAPTURE_BUFFER_COUNT frames can be in flight, a new frame waits for the oldest rather than losing its events
+class CollisionEventRecorder {
+public:
+    CollisionEventRecorder(const Config& config);
+    // Writes out all captured events before closing the log
+    ~CollisionEventRecorder();
+
+    CollisionEventRecorder(const CollisionEventRecorder&) = delete;
+    CollisionEventRecorder& operator=(const CollisionEventRecorder&) = delete;
+
+    // Open or close the log as configured, and collect the captures the GPU has finished
+    void update();
+
+    // Start capturing the steps of a frame that begins with the given step, if events are recorded (see isCapturing())
+    // The program emitting the events must be bound, since transform feedback is only resumed with the program it was started with
+    void beginFrame(uint64_t firstStep);
+    bool isCapturing() const;
+    // Append the events emitted by the bound program for one step (numParticles points, with the rasterizer discarded)
+    void captureStep(uint32_t numParticles);
+    void endFrame();
+
+    // Totals of the current log
+    uint64_t numEventsRecorded() const;
+    uint64_t numEventsDropped() const;
+
+private:
+    static constexpr size_t CAPTURE_BUFFER_COUNT = 3UL;
+
+    struct Capture {
+        GLuint buffer = 0, transformFeedback = 0;
+        size_t capacity = 0UL;                                  // Events that fit in buffer
+        std::vector<GLuint> writtenQueries, generatedQueries;   // One per step of the frame, grown on demand
+        uint64_t firstStep = 0UL;
+        uint32_t numSteps = 0U;
+        GLsync fence = nullptr;                                 // Signaled once the GPU has written all steps, nullptr if unused
+    };
+    struct Chunk {
+        CollisionEventChunkHeader header;
+        std::vector<CollisionEvent> events;
+    };
+
+    // Shared state
+    const Config& config;
+
+    // Internal variables
+    std::array<Capture, CAPTURE_BUFFER_COUNT> captures;
+    size_t nextCapture = 0UL;                               // Capture the next frame goes to; captures are used round-robin
+    bool capturing = false;
+    std::ofstream logFile;
+    std::string openedLogFile;                              // Log file of the last attempt to open one (successful or not), so a failure is only reported once
+    std::vector<Chunk> pendingChunks;                       // Read back but not yet handed to the writer
+    std::future<void> logWrite;                             // Chunks being appended to logFile; one write at a time, so they land in order
+    uint64_t eventsRecorded = 0UL, eventsDropped = 0UL;
+
+    void updateLogFile();
+    void closeLogFile();
+    // Read back the given capture once the GPU has finished it (waiting for it if asked), returns false if it is still in flight
+    bool collectCapture(Capture& capture, bool wait);
+    // Completes the captures the GPU has finished (or all of them, when waiting) and hands them to the writer
+    void collect(bool wait);
+    void writePendingChunks(bool wait);
+};
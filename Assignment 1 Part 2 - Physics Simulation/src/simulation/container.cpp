@@ -0,0 +1,57 @@
+#include "container.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/type_ptr.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <utils/constants.h>
+
+#include <iostream>
+
+
+Container::Container(const Config& config)
+    : config(config)
+    , sphereModel(utils::RESOURCES_DIR_PATH / "sphere.obj", true) {
+    try {
+        ShaderBuilder containerDrawBuilder;
+        containerDrawBuilder.addStage(GL_VERTEX_SHADER,     utils::SHADERS_DIR_PATH / "container" / "draw-container.vert");
+        containerDrawBuilder.addStage(GL_FRAGMENT_SHADER,   utils::SHADERS_DIR_PATH / "container" / "draw-container.frag");
+        drawContainerPass = containerDrawBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+}
+
+void Container::draw(const glm::mat4 viewProjection) {
+    // The container mesh may have been changed in the menu since the previous frame
+    updateMeshModel();
+    const GPUMesh& model = config.containerShape == ContainerShape::Mesh && meshModel ? *meshModel : sphereModel;
+
+    // Toggle on wireframe
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+    // Bind main framebuffer and drawing shader
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    drawContainerPass.bind();
+
+    // Set uniforms and draw; both models are normalized into the unit sphere
+    glUniformMatrix4fv(drawContainerPass.getUniformLocation("viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform3fv(drawContainerPass.getUniformLocation("center"), 1, glm::value_ptr(config.sphereCenter));
+    glUniform1f(drawContainerPass.getUniformLocation("radius"), config.sphereRadius);
+    glUniform3fv(drawContainerPass.getUniformLocation("color"), 1, glm::value_ptr(config.sphereColor));
+    model.draw();
+
+    // Toggle wireframe back off
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+void Container::updateMeshModel() {
+    if (config.containerShape != ContainerShape::Mesh || config.containerMeshFile == loadedMeshFile) { return; }
+    loadedMeshFile = config.containerMeshFile;
+    meshModel.reset();
+
+    // Normalized like the signed distance field of the simulation, which reports why a mesh cannot be used
+    try {
+        meshModel.emplace(loadedMeshFile, true);
+    } catch (const std::exception&) {}
+}
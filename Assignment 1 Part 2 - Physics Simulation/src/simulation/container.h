@@ -0,0 +1,27 @@
+#pragma once
+
+#include <framework/shader.h>
+
+#include <render/mesh.h>
+#include <utils/config.h>
+
+#include <optional>
+#include <string>
+
+
+// Wireframe of the container: the container sphere, or the mesh of a mesh container placed in it (see containerDistance())
+class Container {
+public:
+    Container(const Config& config);
+
+    void draw(const glm::mat4 viewProjection);
+private:
+    const Config& config;
+    
+    GPUMesh sphereModel;
+    std::optional<GPUMesh> meshModel;   // Mesh of the mesh container, if it could be loaded
+    std::string loadedMeshFile;         // Mesh file of the last load (successful or not), so it is only loaded again when it changes
+    Shader drawContainerPass;
+
+    void updateMeshModel();
+};
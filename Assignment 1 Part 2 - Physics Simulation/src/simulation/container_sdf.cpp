@@ -0,0 +1,230 @@
+#include "container_sdf.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/mesh.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+// Voxels of empty space around the mesh, so the gradient at the wall is never cut off by the bounds of the field
+static constexpr int32_t SDF_PADDING        = 2;
+// Voxels around every triangle whose distances are computed exactly, before they are propagated to the rest of the grid
+static constexpr int32_t SDF_EXACT_BAND     = 1;
+// Sweeps over the grid in all 8 diagonal directions, each propagating the closest triangle of the neighbours
+static constexpr int SDF_SWEEP_PASSES       = 2;
+
+
+// Closest point on triangle abc (Ericson, Real-Time Collision Detection, section 5.1.5)
+static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    const glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    const float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) { return a; }
+
+    const glm::vec3 bp = p - b;
+    const float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) { return b; }
+    const float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) { return a + (d1 / (d1 - d3)) * ab; }
+
+    const glm::vec3 cp = p - c;
+    const float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) { return c; }
+    const float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) { return a + (d2 / (d2 - d6)) * ac; }
+    const float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) { return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b); }
+
+    // Inside the face; degenerate triangles have no face region
+    const float sum = va + vb + vc;
+    if (sum <= 0.0f) { return a; }
+    return a + (vb / sum) * ab + (vc / sum) * ac;
+}
+
+// Whether q lies on the left of edge uv of a counter-clockwise triangle. Points exactly on the edge only count for one of
+// the two directions an edge can be traversed in, so a ray through an edge shared by two triangles crosses exactly one of them
+static bool insideEdge(const glm::dvec2& u, const glm::dvec2& v, const glm::dvec2& q) {
+    const glm::dvec2 edge   = v - u;
+    const double side       = edge.x * (q.y - u.y) - edge.y * (q.x - u.x);
+    return side > 0.0 || (side == 0.0 && (edge.y > 0.0 || (edge.y == 0.0 && edge.x < 0.0)));
+}
+
+ContainerSdf bakeContainerSdf(const std::filesystem::path& filePath, int32_t resolution) {
+    // loadMesh() reports its own errors and throws a plain std::exception
+    if (!std::filesystem::exists(filePath)) { throw ContainerSdfException("Container mesh " + filePath.string() + " does not exist"); }
+    std::vector<Mesh> meshes;
+    try {
+        meshes = loadMesh(filePath, true);
+    } catch (const std::exception&) {
+        throw ContainerSdfException("Failed to load container mesh " + filePath.string());
+    }
+    if (meshes.empty()) { throw ContainerSdfException("Container mesh " + filePath.string() + " contains no triangles"); }
+    const Mesh mesh = mergeMeshes(meshes);
+    if (mesh.triangles.empty()) { throw ContainerSdfException("Container mesh " + filePath.string() + " contains no triangles"); }
+
+    std::vector<glm::vec3> positions;
+    positions.reserve(mesh.vertices.size());
+    glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(std::numeric_limits<float>::lowest());
+    for (const Vertex& vertex : mesh.vertices) {
+        positions.push_back(vertex.position);
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+
+    // Cubic voxels, the longest side of the mesh plus its padding spans the requested resolution
+    const int32_t requestedResolution   = std::max(resolution, 2 * SDF_PADDING + 2);
+    const glm::vec3 extent              = glm::max(boundsMax - boundsMin, glm::vec3(1e-6f));
+    ContainerSdf sdf;
+    sdf.voxelSize   = std::max({ extent.x, extent.y, extent.z }) / static_cast<float>(requestedResolution - 2 * SDF_PADDING);
+    sdf.resolution  = glm::ivec3(glm::ceil(extent / sdf.voxelSize)) + 2 * SDF_PADDING;
+    sdf.origin      = boundsMin - static_cast<float>(SDF_PADDING) * sdf.voxelSize;
+
+    const glm::ivec3 res        = sdf.resolution;
+    const size_t numVoxels      = static_cast<size_t>(res.x) * static_cast<size_t>(res.y) * static_cast<size_t>(res.z);
+    const auto voxelIndex       = [&](int32_t x, int32_t y, int32_t z) { return static_cast<size_t>(x) + static_cast<size_t>(res.x) * (static_cast<size_t>(y) + static_cast<size_t>(res.y) * static_cast<size_t>(z)); };
+    const auto voxelCenter      = [&](int32_t x, int32_t y, int32_t z) { return sdf.origin + (glm::vec3(x, y, z) + 0.5f) * sdf.voxelSize; };
+    const auto distanceToTri    = [&](const glm::vec3& point, uint32_t tri) {
+        const glm::uvec3& triangle = mesh.triangles[tri];
+        return glm::distance(point, closestPointOnTriangle(point, positions[triangle.x], positions[triangle.y], positions[triangle.z]));
+    };
+
+    // Exact unsigned distances in a narrow band around every triangle, and the windings of the triangles crossing rows along x
+    std::vector<float> distances(numVoxels, static_cast<float>(res.x + res.y + res.z) * sdf.voxelSize);
+    std::vector<int32_t> closestTris(numVoxels, -1);
+    std::vector<int32_t> crossings(numVoxels, 0);
+    for (uint32_t tri = 0U; tri < mesh.triangles.size(); tri++) {
+        const glm::vec3& a = positions[mesh.triangles[tri].x];
+        const glm::vec3& b = positions[mesh.triangles[tri].y];
+        const glm::vec3& c = positions[mesh.triangles[tri].z];
+        const glm::vec3 triMin = (glm::min(a, glm::min(b, c)) - sdf.origin) / sdf.voxelSize - 0.5f;
+        const glm::vec3 triMax = (glm::max(a, glm::max(b, c)) - sdf.origin) / sdf.voxelSize - 0.5f;
+
+        const glm::ivec3 bandMin = glm::clamp(glm::ivec3(glm::floor(triMin)) - SDF_EXACT_BAND, glm::ivec3(0), res - 1);
+        const glm::ivec3 bandMax = glm::clamp(glm::ivec3(glm::ceil(triMax)) + SDF_EXACT_BAND, glm::ivec3(0), res - 1);
+        for (int32_t z = bandMin.z; z <= bandMax.z; z++) {
+            for (int32_t y = bandMin.y; y <= bandMax.y; y++) {
+                for (int32_t x = bandMin.x; x <= bandMax.x; x++) {
+                    const float distance = distanceToTri(voxelCenter(x, y, z), tri);
+                    if (distance < distances[voxelIndex(x, y, z)]) {
+                        distances[voxelIndex(x, y, z)]      = distance;
+                        closestTris[voxelIndex(x, y, z)]    = static_cast<int32_t>(tri);
+                    }
+                }
+            }
+        }
+
+        // Rows through the voxel centers the triangle covers in the yz plane cross it once; front and back faces cross in opposite directions
+        std::array<glm::dvec2, 3UL> projected = { glm::dvec2(a.y, a.z), glm::dvec2(b.y, b.z), glm::dvec2(c.y, c.z) };
+        std::array<double, 3UL> depths = { a.x, b.x, c.x };
+        const glm::dvec2 e1 = projected[1] - projected[0], e2 = projected[2] - projected[0];
+        const double area   = e1.x * e2.y - e1.y * e2.x;
+        if (area == 0.0) { continue; }
+        const int32_t winding = area > 0.0 ? 1 : -1;
+        if (area < 0.0) { std::swap(projected[1], projected[2]); std::swap(depths[1], depths[2]); }
+
+        const int32_t yMin = std::max(static_cast<int32_t>(std::ceil(triMin.y)), 0), yMax = std::min(static_cast<int32_t>(std::floor(triMax.y)), res.y - 1);
+        const int32_t zMin = std::max(static_cast<int32_t>(std::ceil(triMin.z)), 0), zMax = std::min(static_cast<int32_t>(std::floor(triMax.z)), res.z - 1);
+        for (int32_t z = zMin; z <= zMax; z++) {
+            for (int32_t y = yMin; y <= yMax; y++) {
+                const glm::vec3 rowStart = voxelCenter(0, y, z);
+                const glm::dvec2 q(rowStart.y, rowStart.z);
+                if (!insideEdge(projected[0], projected[1], q) || !insideEdge(projected[1], projected[2], q) || !insideEdge(projected[2], projected[0], q)) { continue; }
+
+                // Interpolate the depth of the crossing, which lies before all voxel centers from crossingX onwards
+                const glm::dvec2 p0 = projected[0], p1 = projected[1], p2 = projected[2];
+                const double w1     = ((q.x - p0.x) * (p2.y - p0.y) - (q.y - p0.y) * (p2.x - p0.x)) / std::abs(area);
+                const double w2     = ((p1.x - p0.x) * (q.y - p0.y) - (p1.y - p0.y) * (q.x - p0.x)) / std::abs(area);
+                const double depth  = (1.0 - w1 - w2) * depths[0] + w1 * depths[1] + w2 * depths[2];
+                const int32_t crossingX = static_cast<int32_t>(std::ceil((depth - static_cast<double>(sdf.origin.x)) / static_cast<double>(sdf.voxelSize) - 0.5));
+                if (crossingX < res.x) { crossings[voxelIndex(std::max(crossingX, 0), y, z)] += winding; }
+            }
+        }
+    }
+
+    // Propagate the closest triangles from the band to the rest of the grid
+    for (int pass = 0; pass < SDF_SWEEP_PASSES; pass++) {
+        for (int direction = 0; direction < 8; direction++) {
+            const glm::ivec3 step((direction & 1) ? -1 : 1, (direction & 2) ? -1 : 1, (direction & 4) ? -1 : 1);
+            const glm::ivec3 first(step.x > 0 ? 1 : res.x - 2, step.y > 0 ? 1 : res.y - 2, step.z > 0 ? 1 : res.z - 2);
+            for (int32_t z = first.z; z >= 0 && z < res.z; z += step.z) {
+                for (int32_t y = first.y; y >= 0 && y < res.y; y += step.y) {
+                    for (int32_t x = first.x; x >= 0 && x < res.x; x += step.x) {
+                        const glm::vec3 center = voxelCenter(x, y, z);
+                        for (int neighbour = 1; neighbour < 8; neighbour++) {
+                            const int32_t tri = closestTris[voxelIndex(x - ((neighbour & 1) ? step.x : 0), y - ((neighbour & 2) ? step.y : 0), z - ((neighbour & 4) ? step.z : 0))];
+                            if (tri < 0 || tri == closestTris[voxelIndex(x, y, z)]) { continue; }
+                            const float distance = distanceToTri(center, static_cast<uint32_t>(tri));
+                            if (distance < distances[voxelIndex(x, y, z)]) {
+                                distances[voxelIndex(x, y, z)]      = distance;
+                                closestTris[voxelIndex(x, y, z)]    = tri;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Voxels with a nonzero winding number along their row are inside the mesh
+    for (int32_t z = 0; z < res.z; z++) {
+        for (int32_t y = 0; y < res.y; y++) {
+            int32_t windingNumber = 0;
+            for (int32_t x = 0; x < res.x; x++) {
+                windingNumber += crossings[voxelIndex(x, y, z)];
+                if (windingNumber != 0) { distances[voxelIndex(x, y, z)] = -distances[voxelIndex(x, y, z)]; }
+            }
+        }
+    }
+
+    sdf.distances = std::move(distances);
+    return sdf;
+}
+
+float ContainerSdf::distance(const glm::vec3& position) const {
+    // Texture coordinates outside the field are clamped to its border texels, like GL_CLAMP_TO_EDGE
+    const glm::vec3 clamped     = glm::clamp(position, origin, origin + size());
+    const glm::vec3 voxelCoord  = (clamped - origin) / voxelSize - 0.5f;
+    const glm::ivec3 lower      = glm::ivec3(glm::floor(voxelCoord));
+    const glm::vec3 weight      = voxelCoord - glm::vec3(lower);
+    const auto fetch = [&](int32_t x, int32_t y, int32_t z) {
+        const glm::ivec3 voxel = glm::clamp(glm::ivec3(x, y, z), glm::ivec3(0), resolution - 1);
+        return distances[static_cast<size_t>(voxel.x) + static_cast<size_t>(resolution.x) * (static_cast<size_t>(voxel.y) + static_cast<size_t>(resolution.y) * static_cast<size_t>(voxel.z))];
+    };
+
+    float interpolated = 0.0f;
+    for (int corner = 0; corner < 8; corner++) {
+        const glm::ivec3 offset((corner & 1), (corner & 2) >> 1, (corner & 4) >> 2);
+        const glm::vec3 cornerWeight = glm::mix(glm::vec3(1.0f) - weight, weight, glm::vec3(offset));
+        interpolated += cornerWeight.x * cornerWeight.y * cornerWeight.z * fetch(lower.x + offset.x, lower.y + offset.y, lower.z + offset.z);
+    }
+    return interpolated + glm::distance(position, clamped);
+}
+
+glm::vec3 ContainerSdf::normal(const glm::vec3& position) const {
+    const glm::vec3 gradient(
+        distance(position + glm::vec3(voxelSize, 0.0f, 0.0f)) - distance(position - glm::vec3(voxelSize, 0.0f, 0.0f)),
+        distance(position + glm::vec3(0.0f, voxelSize, 0.0f)) - distance(position - glm::vec3(0.0f, voxelSize, 0.0f)),
+        distance(position + glm::vec3(0.0f, 0.0f, voxelSize)) - distance(position - glm::vec3(0.0f, 0.0f, voxelSize)));
+    const float length = glm::length(gradient);
+    return length > 0.0f ? gradient / length : glm::vec3(0.0f);
+}
+
+float containerDistance(const Config& config, const ContainerSdf* containerSdf, const glm::vec3& position) {
+    if (containerSdf) { return containerSdf->distance((position - config.sphereCenter) / config.sphereRadius) * config.sphereRadius; }
+    return glm::distance(position, config.sphereCenter) - config.sphereRadius;
+}
+
+glm::vec3 containerNormal(const Config& config, const ContainerSdf* containerSdf, const glm::vec3& position) {
+    // Flat regions of the field (far from the mesh) fall back to the direction away from the container center
+    if (containerSdf) {
+        const glm::vec3 normal = containerSdf->normal((position - config.sphereCenter) / config.sphereRadius);
+        if (normal != glm::vec3(0.0f)) { return normal; }
+    }
+    return glm::normalize(position - config.sphereCenter);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <utils/config.h>
+
+#include <filesystem>
+#include <stdexcept>
+#include <stdint.h>
+#include <vector>
+
+
+struct ContainerSdfException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Signed distance field of a closed triangle mesh, sampled at the centers of cubic voxels (negative inside the mesh)
+// The field is baked in the normalized space of the mesh and uploaded as-is to a 3D texture, so distance() matches the
+// trilinear fetches of the simulation shaders
+struct ContainerSdf {
+    glm::vec3 origin;               // Corner of the first voxel; voxel (x, y, z) is centered at origin + (x + 0.5, y + 0.5, z + 0.5) * voxelSize
+    float voxelSize;
+    glm::ivec3 resolution;
+    std::vector<float> distances;   // x-major, like the texels of a 3D texture
+
+    glm::vec3 size() const { return glm::vec3(resolution) * voxelSize; }
+
+    // Trilinearly interpolated distance, growing with the distance to the bounds of the field outside of them
+    float distance(const glm::vec3& position) const;
+    // Outward normal of the surface closest to the position, from central differences one voxel apart (zero where the field is flat)
+    glm::vec3 normal(const glm::vec3& position) const;
+};
+
+// Bakes the field of the mesh in an OBJ file, normalized like GPUMesh(filePath, true) into the unit sphere. The longest
+// side of the field, the mesh plus a small margin, spans the given number of voxels
+// Throws a ContainerSdfException if the mesh cannot be loaded
+ContainerSdf bakeContainerSdf(const std::filesystem::path& filePath, int32_t resolution);
+
+// Signed distance from the container wall and its outward normal. With a field, the container is its mesh placed in the
+// container sphere of the config (scaled by sphereRadius around sphereCenter, like the drawn mesh), so moving or resizing
+// the container needs no new field; without one, the container is the sphere itself
+// Same as containerDistance() and containerNormal() in container.glsl
+float containerDistance(const Config& config, const ContainerSdf* containerSdf, const glm::vec3& position);
+glm::vec3 containerNormal(const Config& config, const ContainerSdf* containerSdf, const glm::vec3& position);
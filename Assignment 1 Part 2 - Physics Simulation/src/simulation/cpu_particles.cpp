@@ -0,0 +1,341 @@
+#include "cpu_particles.h"
+#include "initial_state.h"
+#include "particle_species.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPU_SOLVER_SSE2
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+// Same constants as particle-sim.frag
+static constexpr float COLLISION_OFFSET = 0.001f;
+static constexpr glm::vec3 GRAVITY      = glm::vec3(0.0f, -9.81f, 0.0f);
+
+// Marks a cell without an assigned range in CpuParticleSolver::cellFill
+static constexpr uint32_t EMPTY_CELL    = std::numeric_limits<uint32_t>::max();
+
+
+// Index of the first position in [begin, end) of the given components whose squared distance to position is at most
+// thresholdSq, or end if there is none
+static size_t findFirstCandidate(const float* posX, const float* posY, const float* posZ, size_t begin, size_t end, const glm::vec3& position, float thresholdSq) {
+    size_t idx = begin;
+
+#if defined(__AVX2__)
+    const __m256 px = _mm256_set1_ps(position.x), py = _mm256_set1_ps(position.y), pz = _mm256_set1_ps(position.z);
+    const __m256 threshold = _mm256_set1_ps(thresholdSq);
+    for (; idx + 8UL <= end; idx += 8UL) {
+        const __m256 dx     = _mm256_sub_ps(px, _mm256_loadu_ps(posX + idx));
+        const __m256 dy     = _mm256_sub_ps(py, _mm256_loadu_ps(posY + idx));
+        const __m256 dz     = _mm256_sub_ps(pz, _mm256_loadu_ps(posZ + idx));
+        const __m256 distSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        const int mask      = _mm256_movemask_ps(_mm256_cmp_ps(distSq, threshold, _CMP_LE_OQ));
+        if (mask != 0) { return idx + static_cast<size_t>(std::countr_zero(static_cast<uint32_t>(mask))); }
+    }
+#elif defined(CPU_SOLVER_SSE2)
+    const __m128 px = _mm_set1_ps(position.x), py = _mm_set1_ps(position.y), pz = _mm_set1_ps(position.z);
+    const __m128 threshold = _mm_set1_ps(thresholdSq);
+    for (; idx + 4UL <= end; idx += 4UL) {
+        const __m128 dx     = _mm_sub_ps(px, _mm_loadu_ps(posX + idx));
+        const __m128 dy     = _mm_sub_ps(py, _mm_loadu_ps(posY + idx));
+        const __m128 dz     = _mm_sub_ps(pz, _mm_loadu_ps(posZ + idx));
+        const __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        const int mask      = _mm_movemask_ps(_mm_cmple_ps(distSq, threshold));
+        if (mask != 0) { return idx + static_cast<size_t>(std::countr_zero(static_cast<uint32_t>(mask))); }
+    }
+#endif
+
+    // Scalar remainder (or the whole range without SIMD support)
+    for (; idx < end; idx++) {
+        const float dx = position.x - posX[idx];
+        const float dy = position.y - posY[idx];
+        const float dz = position.z - posZ[idx];
+        if (dx * dx + dy * dy + dz * dz <= thresholdSq) { return idx; }
+    }
+    return end;
+}
+
+
+void ParticleStateSoA::resize(size_t numParticles) {
+    for (std::vector<float>* component : { &posX, &posY, &posZ, &velX, &velY, &velZ }) { component->resize(numParticles); }
+    collisionCounts.resize(numParticles);
+    frameCounters.resize(numParticles);
+    sleepCounters.resize(numParticles);
+    stepCollisions.resize(numParticles);
+    species.resize(numParticles);
+}
+
+size_t ParticleStateSoA::size() const {
+    return posX.size();
+}
+
+
+CpuParticleSolver::CpuParticleSolver(const Config& config, uint32_t numThreads)
+    : config(config)
+    , threadPool(numThreads) {
+    resetSimulation();
+}
+
+void CpuParticleSolver::resetSimulation() {
+    setState(generateInitialState(config, containerSdf));
+}
+
+void CpuParticleSolver::step() {
+    assert(current.size() == config.numParticles && "The particle count changed without resetting the simulation");
+    next.resize(current.size());
+    next.species = current.species;
+    updateParticleProperties();
+
+    // Integrate all particles, then resolve collisions against the previous positions (like the GPU, every particle
+    // only reads the previous state, so the particles can be processed in parallel)
+    threadPool.parallelFor(current.size(), [this](size_t begin, size_t end) { integrate(begin, end); });
+    if (config.particleInterCollision && config.broadPhase == BroadPhase::UniformGrid) { buildGrid(); }
+    threadPool.parallelFor(current.size(), [this](size_t begin, size_t end) { resolveParticles(begin, end); });
+
+    std::swap(current, next);
+}
+
+void CpuParticleSolver::setContainerSdf(const ContainerSdf* newContainerSdf) {
+    containerSdf = newContainerSdf;
+}
+
+void CpuParticleSolver::setState(ParticleStateSoA state) {
+    current = std::move(state);
+    next.resize(current.size());
+}
+
+const ParticleStateSoA& CpuParticleSolver::state() const {
+    return current;
+}
+
+void CpuParticleSolver::packPositions(std::vector<float>& rgba, size_t numTexels) const {
+    rgba.assign(4UL * std::max(numTexels, current.size()), 0.0f);
+    for (size_t idx = 0UL; idx < current.size(); idx++) {
+        rgba[4UL * idx]     = current.posX[idx];
+        rgba[4UL * idx + 1] = current.posY[idx];
+        rgba[4UL * idx + 2] = current.posZ[idx];
+    }
+}
+
+void CpuParticleSolver::packVelocities(std::vector<float>& rgba, size_t numTexels) const {
+    rgba.assign(4UL * std::max(numTexels, current.size()), 0.0f);
+    for (size_t idx = 0UL; idx < current.size(); idx++) {
+        rgba[4UL * idx]     = current.velX[idx];
+        rgba[4UL * idx + 1] = current.velY[idx];
+        rgba[4UL * idx + 2] = current.velZ[idx];
+    }
+}
+
+void CpuParticleSolver::packBounceData(std::vector<float>& rgba, size_t numTexels) const {
+    rgba.assign(4UL * std::max(numTexels, current.size()), 0.0f);
+    for (size_t idx = 0UL; idx < current.size(); idx++) {
+        rgba[4UL * idx]     = static_cast<float>(current.collisionCounts[idx]);
+        rgba[4UL * idx + 1] = static_cast<float>(current.frameCounters[idx]);
+        rgba[4UL * idx + 2] = static_cast<float>(current.sleepCounters[idx]);
+        rgba[4UL * idx + 3] = static_cast<float>(current.stepCollisions[idx]);
+    }
+}
+
+void CpuParticleSolver::packProperties(std::vector<float>& rgba, size_t numTexels) const {
+    rgba.assign(4UL * std::max(numTexels, current.size()), 0.0f);
+    for (size_t idx = 0UL; idx < current.size(); idx++) {
+        rgba[4UL * idx]     = speciesRadius(config, current.species[idx]);
+        rgba[4UL * idx + 1] = speciesMass(config, current.species[idx]);
+        rgba[4UL * idx + 2] = static_cast<float>(current.species[idx]);
+    }
+}
+
+void CpuParticleSolver::updateParticleProperties() {
+    // The species may be edited in the menu between steps
+    radii.resize(current.size());
+    masses.resize(current.size());
+    for (size_t idx = 0UL; idx < current.size(); idx++) {
+        radii[idx]  = speciesRadius(config, current.species[idx]);
+        masses[idx] = speciesMass(config, current.species[idx]);
+    }
+    maxRadius = maxParticleRadius(config);
+}
+
+void CpuParticleSolver::buildGrid() {
+    // Counting sort of the particles by the cell of their previous position. Particles are visited in index order,
+    // so within a cell they are ordered by index, exactly like the (cell, particle) keys of the GPU bitonic sort. The
+    // ranges of the cells are laid out in order of their first particle, which only changes where a cell is stored
+    const GridLayout newLayout = computeGridLayout(config);
+    if (newLayout.numCells() != cellCounts.size()) {
+        cellCounts.assign(newLayout.numCells(), 0U);
+        cellStarts.resize(newLayout.numCells());
+        cellFill.assign(newLayout.numCells(), EMPTY_CELL);
+    } else {
+        // Most cells are empty, so only the cells of the previous step are cleared
+        for (uint32_t cellIdx : occupiedCells) {
+            cellCounts[cellIdx] = 0U;
+            cellFill[cellIdx]   = EMPTY_CELL;
+        }
+    }
+    gridLayout = newLayout;
+    occupiedCells.clear();
+    particleCells.resize(current.size());
+    sortedParticles.resize(current.size());
+    for (std::vector<float>* component : { &sortedPosX, &sortedPosY, &sortedPosZ }) { component->resize(current.size()); }
+
+    // Cell of every particle and number of particles per cell
+    threadPool.parallelFor(current.size(), [this](size_t begin, size_t end) {
+        for (size_t idx = begin; idx < end; idx++) {
+            const glm::vec3 position    = glm::vec3(current.posX[idx], current.posY[idx], current.posZ[idx]);
+            particleCells[idx]          = gridLayout.cellIndex(gridLayout.cellOf(position));
+            std::atomic_ref<uint32_t>(cellCounts[particleCells[idx]]).fetch_add(1U, std::memory_order_relaxed);
+        }
+    });
+
+    // Assign every cell its range when its first particle is reached, and place the particles in index order
+    uint32_t numSorted = 0U;
+    for (size_t idx = 0UL; idx < current.size(); idx++) {
+        const uint32_t cellIdx = particleCells[idx];
+        if (cellFill[cellIdx] == EMPTY_CELL) {
+            cellStarts[cellIdx] = cellFill[cellIdx] = numSorted;
+            numSorted += cellCounts[cellIdx];
+            occupiedCells.push_back(cellIdx);
+        }
+        sortedParticles[cellFill[cellIdx]++] = static_cast<uint32_t>(idx);
+    }
+
+    threadPool.parallelFor(current.size(), [this](size_t begin, size_t end) {
+        for (size_t sortedIdx = begin; sortedIdx < end; sortedIdx++) {
+            sortedPosX[sortedIdx] = current.posX[sortedParticles[sortedIdx]];
+            sortedPosY[sortedIdx] = current.posY[sortedParticles[sortedIdx]];
+            sortedPosZ[sortedIdx] = current.posZ[sortedParticles[sortedIdx]];
+        }
+    });
+}
+
+float CpuParticleSolver::candidateThresholdSq(size_t particleIdx) const {
+    // Slightly inflated, so that the exact test in collideWithParticle() has the final say
+    const float maxContact = radii[particleIdx] + maxRadius;
+    return maxContact * maxContact * 1.0001f + 1e-12f;
+}
+
+void CpuParticleSolver::integrate(size_t begin, size_t end) {
+    // ===== Task 1.1 Verlet Integration =====
+    // Plain loops over the SoA buffers, which the compiler vectorizes
+    const float timestep = config.particleSimTimestep;
+    for (size_t idx = begin; idx < end; idx++) { next.posX[idx] = current.posX[idx] + current.velX[idx] * timestep + 0.5f * GRAVITY.x * timestep * timestep; }
+    for (size_t idx = begin; idx < end; idx++) { next.posY[idx] = current.posY[idx] + current.velY[idx] * timestep + 0.5f * GRAVITY.y * timestep * timestep; }
+    for (size_t idx = begin; idx < end; idx++) { next.posZ[idx] = current.posZ[idx] + current.velZ[idx] * timestep + 0.5f * GRAVITY.z * timestep * timestep; }
+    for (size_t idx = begin; idx < end; idx++) { next.velX[idx] = current.velX[idx] + GRAVITY.x * timestep; }
+    for (size_t idx = begin; idx < end; idx++) { next.velY[idx] = current.velY[idx] + GRAVITY.y * timestep; }
+    for (size_t idx = begin; idx < end; idx++) { next.velZ[idx] = current.velZ[idx] + GRAVITY.z * timestep; }
+}
+
+void CpuParticleSolver::collideWithParticle(size_t particleIdx, size_t otherIdx, glm::vec3& newPos, glm::vec3& newVel, int32_t& collisionCount) const {
+    // Check for collision
+    const glm::vec3 otherPos    = glm::vec3(current.posX[otherIdx], current.posY[otherIdx], current.posZ[otherIdx]);
+    const glm::vec3 toOther     = newPos - otherPos;
+    const float dist            = glm::length(toOther);
+    const float contactDistance = radii[particleIdx] + radii[otherIdx];
+    if (dist < contactDistance) {
+        const glm::vec3 normal = glm::normalize(toOther);
+        // Push the particle away, by the share of the overlap opposite to its share of the total mass (half for equal masses)
+        const float share = masses[otherIdx] / (masses[particleIdx] + masses[otherIdx]);
+        newPos += normal * (contactDistance - dist + COLLISION_OFFSET) * share;
+        // Reflect velocity, fully off an equal or heavier particle and only partly off a lighter one
+        newVel -= std::min(2.0f * share, 1.0f) * 2.0f * glm::dot(newVel, normal) * normal;
+
+        collisionCount++;
+    }
+}
+
+void CpuParticleSolver::collideBruteForce(size_t particleIdx, glm::vec3& newPos, glm::vec3& newVel, int32_t& collisionCount) const {
+    // The SIMD kernel skips ahead to the next particle that may be colliding. Every collision moves newPos, so the
+    // search restarts after each candidate, which keeps the same sequential semantics as the shader loop
+    const float thresholdSq = candidateThresholdSq(particleIdx);
+    const float *posX = current.posX.data(), *posY = current.posY.data(), *posZ = current.posZ.data();
+    for (size_t otherIdx = findFirstCandidate(posX, posY, posZ, 0UL, current.size(), newPos, thresholdSq); otherIdx < current.size();
+         otherIdx = findFirstCandidate(posX, posY, posZ, otherIdx + 1UL, current.size(), newPos, thresholdSq)) {
+        if (otherIdx == particleIdx) { continue; } // skip self
+        collideWithParticle(particleIdx, otherIdx, newPos, newVel, collisionCount);
+    }
+}
+
+void CpuParticleSolver::collideUniformGrid(size_t particleIdx, glm::vec3& newPos, glm::vec3& newVel, int32_t& collisionCount) const {
+    // Visit the neighbouring cells in the same order as particle-sim.frag, searching each cell with the same SIMD kernel
+    // as the brute-force broad phase, over the positions stored in cell order
+    const float thresholdSq     = candidateThresholdSq(particleIdx);
+    const glm::ivec3 cell       = gridLayout.cellOf(newPos);
+    const glm::ivec3 minCell    = glm::max(cell - 1, glm::ivec3(0));
+    const glm::ivec3 maxCell    = glm::min(cell + 1, gridLayout.resolution - 1);
+    for (int32_t z = minCell.z; z <= maxCell.z; z++) {
+        for (int32_t y = minCell.y; y <= maxCell.y; y++) {
+            for (int32_t x = minCell.x; x <= maxCell.x; x++) {
+                const uint32_t cellIdx = gridLayout.cellIndex(glm::ivec3(x, y, z));
+                if (cellCounts[cellIdx] == 0U) { continue; }
+                const size_t cellBegin = cellStarts[cellIdx], cellEnd = cellBegin + cellCounts[cellIdx];
+                for (size_t sortedIdx = findFirstCandidate(sortedPosX.data(), sortedPosY.data(), sortedPosZ.data(), cellBegin, cellEnd, newPos, thresholdSq); sortedIdx < cellEnd;
+                     sortedIdx = findFirstCandidate(sortedPosX.data(), sortedPosY.data(), sortedPosZ.data(), sortedIdx + 1UL, cellEnd, newPos, thresholdSq)) {
+                    const uint32_t otherIdx = sortedParticles[sortedIdx];
+                    if (otherIdx == particleIdx) { continue; } // skip self
+                    collideWithParticle(particleIdx, otherIdx, newPos, newVel, collisionCount);
+                }
+            }
+        }
+    }
+}
+
+void CpuParticleSolver::resolveParticles(size_t begin, size_t end) {
+    for (size_t idx = begin; idx < end; idx++) {
+        glm::vec3 newPos        = glm::vec3(next.posX[idx], next.posY[idx], next.posZ[idx]);
+        glm::vec3 newVel        = glm::vec3(next.velX[idx], next.velY[idx], next.velZ[idx]);
+        int32_t collisionCount  = current.collisionCounts[idx];
+        int32_t frameCounter    = current.frameCounters[idx];
+
+        // ===== Task 1.3 Inter-particle Collision =====
+        if (config.particleInterCollision) {
+            if (config.broadPhase == BroadPhase::UniformGrid)   { collideUniformGrid(idx, newPos, newVel, collisionCount); }
+            else                                                { collideBruteForce(idx, newPos, newVel, collisionCount); }
+        }
+
+        // ===== Task 1.2 Container Collision =====
+        const float distanceToWall = containerDistance(config, containerSdf, newPos);
+        if (distanceToWall > -radii[idx]) {
+            const glm::vec3 normal = containerNormal(config, containerSdf, newPos);
+            // Push the particle back inside
+            newPos -= normal * (distanceToWall + radii[idx] + COLLISION_OFFSET);
+            // Reflect the velocity about the collision normal
+            newVel = glm::reflect(newVel, normal);
+
+            collisionCount++;
+        }
+
+        // ===== Task 3: Blink Logic =====
+        const int32_t stepCollisions = collisionCount - current.collisionCounts[idx];
+        if (collisionCount >= config.bounceThreshold) {
+            frameCounter    = config.bounceFrames;
+            collisionCount  = 0;
+        }
+        frameCounter = std::max(frameCounter - 1, 0);
+
+        next.posX[idx]              = newPos.x;
+        next.posY[idx]              = newPos.y;
+        next.posZ[idx]              = newPos.z;
+        next.velX[idx]              = newVel.x;
+        next.velY[idx]              = newVel.y;
+        next.velZ[idx]              = newVel.z;
+        next.collisionCounts[idx]   = collisionCount;
+        next.frameCounters[idx]     = frameCounter;
+        next.sleepCounters[idx]     = 0;
+        next.stepCollisions[idx]    = stepCollisions;
+    }
+}
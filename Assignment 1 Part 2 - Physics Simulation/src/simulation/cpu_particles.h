@@ -0,0 +1,86 @@
+#pragma once
+
+#include <simulation/container_sdf.h>
+#include <simulation/grid_layout.h>
+#include <utils/config.h>
+#include <utils/thread_pool.h>
+
+#include <stdint.h>
+#include <vector>
+
+
+// Structure-of-arrays particle state, so the solver kernels can load consecutive particles into SIMD registers
+struct ParticleStateSoA {
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> velX, velY, velZ;
+    std::vector<int32_t> collisionCounts;   // Number of bounces since the last blink
+    std::vector<int32_t> frameCounters;     // Number of frames left for the bounce color to be active
+    std::vector<int32_t> sleepCounters;     // Number of consecutive steps at rest in the position-based solver (the CPU solver does not sleep)
+    std::vector<int32_t> stepCollisions;    // Number of collisions in the latest step, for the statistics (not stored in snapshots)
+    std::vector<uint32_t> species;          // Index into Config::particleSpecies, fixed for the whole simulation
+
+    void resize(size_t numParticles);
+    size_t size() const;
+};
+
+// CPU implementation of the Verlet integration, container collision, inter-particle collision and bounce counting
+// logic of particle-sim.frag. It does not touch OpenGL, so it can run headless, and serves as a golden reference
+// and throughput baseline for the GPU simulation
+class CpuParticleSolver {
+public:
+    CpuParticleSolver(const Config& config, uint32_t numThreads = 0U);
+
+    // Place particles according to the initial distribution of the config
+    void resetSimulation();
+    // Advance the current state, which keeps its particle count: after changing Config::numParticles, the caller resets
+    // the simulation or sets a new state
+    void step();
+
+    // Collide with the wall of the given mesh container instead of the container sphere (nullptr), see containerDistance()
+    // The field is owned by the caller and must stay alive until it is replaced
+    void setContainerSdf(const ContainerSdf* containerSdf);
+
+    // Replace the current state, e.g. with data read back from the GPU
+    void setState(ParticleStateSoA state);
+    const ParticleStateSoA& state() const;
+
+    // Interleave the current state as RGBA texels, as expected by the state textures (numTexels >= particle count, the rest is zero padding)
+    void packPositions(std::vector<float>& rgba, size_t numTexels) const;
+    void packVelocities(std::vector<float>& rgba, size_t numTexels) const;
+    void packBounceData(std::vector<float>& rgba, size_t numTexels) const;
+    // Radius, mass and species of every particle as RGBA texels, as expected by the particle properties buffer
+    void packProperties(std::vector<float>& rgba, size_t numTexels) const;
+
+private:
+    // Shared state
+    const Config& config;
+
+    // Internal variables
+    ThreadPool threadPool;
+    ParticleStateSoA current, next;
+    const ContainerSdf* containerSdf = nullptr;
+    std::vector<float> radii, masses;       // Per-particle radius and mass of the current step, looked up from the species of the config
+    float maxRadius = 0.0f;
+
+    // Uniform grid over the previous positions, visiting the particles of a cell in the same order as UniformGrid
+    // The per-cell tables are kept between steps, and only the cells occupied in the previous step are cleared
+    GridLayout gridLayout;
+    std::vector<uint32_t> particleCells;    // Cell index of every particle
+    std::vector<uint32_t> cellCounts;       // Number of particles per cell; cell c spans [cellStarts[c], cellStarts[c] + cellCounts[c])
+    std::vector<uint32_t> cellStarts;       // Per-cell start into sortedParticles, only valid for occupied cells
+    std::vector<uint32_t> cellFill;         // Per-cell insertion point while sorting, EMPTY_CELL for cells not reached yet
+    std::vector<uint32_t> occupiedCells;    // Cells holding at least one particle
+    std::vector<uint32_t> sortedParticles;  // Particle indices grouped by cell (by index within a cell)
+    std::vector<float> sortedPosX, sortedPosY, sortedPosZ; // Previous positions in the order of sortedParticles, for the SIMD search
+
+    void updateParticleProperties();
+    void buildGrid();
+    float candidateThresholdSq(size_t particleIdx) const;
+
+    // Solver kernels operating on [begin, end)
+    void integrate(size_t begin, size_t end);
+    void collideBruteForce(size_t particleIdx, glm::vec3& newPos, glm::vec3& newVel, int32_t& collisionCount) const;
+    void collideUniformGrid(size_t particleIdx, glm::vec3& newPos, glm::vec3& newVel, int32_t& collisionCount) const;
+    void collideWithParticle(size_t particleIdx, size_t otherIdx, glm::vec3& newPos, glm::vec3& newVel, int32_t& collisionCount) const;
+    void resolveParticles(size_t begin, size_t end);
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <simulation/particle_species.h>
+#include <utils/config.h>
+#include <utils/constants.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+// Layout of the uniform grid spanning the container, shared by the GPU and CPU broad phases
+struct GridLayout {
+    glm::vec3 origin;
+    float cellSize;
+    glm::ivec3 resolution;
+
+    uint32_t numCells() const { return static_cast<uint32_t>(resolution.x * resolution.y * resolution.z); }
+
+    // Cell containing the given position, clamped so positions outside the container still map to a (boundary) cell
+    glm::ivec3 cellOf(const glm::vec3& position) const { return glm::clamp(glm::ivec3(glm::floor((position - origin) / cellSize)), glm::ivec3(0), resolution - 1); }
+    uint32_t cellIndex(const glm::ivec3& cell) const { return static_cast<uint32_t>(cell.x + resolution.x * (cell.y + resolution.y * cell.z)); }
+};
+
+// Cells must be at least one diameter of the largest species wide, so that all colliding pairs lie in neighbouring cells.
+// Cells are made larger when the container would otherwise need more than MAX_GRID_RESOLUTION cells per axis
+inline GridLayout computeGridLayout(const Config& config) {
+    const float containerDiameter = 2.0f * config.sphereRadius;
+
+    GridLayout layout;
+    layout.cellSize     = std::max({ 2.0f * maxParticleRadius(config), containerDiameter / utils::MAX_GRID_RESOLUTION, 1e-4f });
+    layout.origin       = config.sphereCenter - glm::vec3(config.sphereRadius);
+    layout.resolution   = glm::clamp(glm::ivec3(static_cast<int32_t>(std::ceil(containerDiameter / layout.cellSize))), 1, utils::MAX_GRID_RESOLUTION);
+    return layout;
+}
@@ -0,0 +1,235 @@
+#include "initial_state.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <simulation/particle_species.h>
+#include <simulation/state_dump.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// Packed particles keep this fraction of their diameter as extra spacing, so they do not touch after rounding to half floats
+static constexpr float PACKING_MARGIN       = 0.01f;
+// Candidates tried around an active sample before Poisson-disk sampling retires it (Bridson's k)
+static constexpr int POISSON_DISK_ATTEMPTS  = 30;
+// Random positions in the container sphere tried before giving up on finding one inside a mesh container
+static constexpr int CONTAINER_ATTEMPTS     = 1000;
+
+
+// Uniform float in [0, 1) built from the top 24 bits of the generator, unlike std::uniform_real_distribution identical on every standard library
+static float uniformFloat(std::mt19937& rng) {
+    return static_cast<float>(rng() >> 8U) * (1.0f / 16777216.0f);
+}
+
+static glm::vec3 uniformDirection(std::mt19937& rng) {
+    const float cosInclination  = 2.0f * uniformFloat(rng) - 1.0f;
+    const float sinInclination  = std::sqrt(std::max(0.0f, 1.0f - cosInclination * cosInclination));
+    const float azimuth         = glm::two_pi<float>() * uniformFloat(rng);
+    return glm::vec3(sinInclination * std::cos(azimuth), sinInclination * std::sin(azimuth), cosInclination);
+}
+
+// Radius of the ball of valid particle centers, so particles never start intersecting the container sphere
+// Placement does not know the species yet, so every particle is placed as if it were of the largest species
+static float placementRadius(const Config& config) {
+    return std::max(config.sphereRadius - maxParticleRadius(config), 0.0f);
+}
+
+// Whether a particle of the largest species centered at the position does not intersect the container wall
+static bool fitsInContainer(const Config& config, const ContainerSdf* containerSdf, const glm::vec3& position) {
+    return containerDistance(config, containerSdf, position) <= -maxParticleRadius(config);
+}
+
+// Uniformly distributed position in the container; mesh containers reject positions of the container sphere outside the mesh
+static glm::vec3 randomPositionInContainer(const Config& config, const ContainerSdf* containerSdf, std::mt19937& rng) {
+    glm::vec3 position = config.sphereCenter;
+    for (int attempt = 0; attempt < CONTAINER_ATTEMPTS; attempt++) {
+        const float radius  = placementRadius(config) * std::cbrt(uniformFloat(rng));
+        position            = config.sphereCenter + radius * uniformDirection(rng);
+        if (!containerSdf || fitsInContainer(config, containerSdf, position)) { break; }
+    }
+    return position;
+}
+
+static void setParticle(ParticleStateSoA& state, size_t idx, const glm::vec3& position) {
+    state.posX[idx]             = position.x;
+    state.posY[idx]             = position.y;
+    state.posZ[idx]             = position.z;
+    state.velX[idx]             = 0.0f;
+    state.velY[idx]             = 0.0f;
+    state.velZ[idx]             = 0.0f;
+    state.collisionCounts[idx]  = 0;
+    state.frameCounters[idx]    = 0;
+    state.sleepCounters[idx]    = 0;
+    state.stepCollisions[idx]   = 0;
+}
+
+// Particles that did not fit are placed uniformly at random in the container, overlapping the packed ones
+static void placeRemainingAtRandom(ParticleStateSoA& state, size_t numPlaced, const Config& config, const ContainerSdf* containerSdf, std::mt19937& rng) {
+    if (numPlaced == state.size()) { return; }
+    std::cerr << "Only " << numPlaced << " of " << state.size() << " particles fit in the container without overlap, the rest are placed at random" << std::endl;
+    for (size_t idx = numPlaced; idx < state.size(); idx++) { setParticle(state, idx, randomPositionInContainer(config, containerSdf, rng)); }
+}
+
+// Random radii along a spiral over the container sphere, the placement the simulation originally started from (with seed 42)
+// In a mesh container, the particles outside the mesh are moved to random positions inside it
+static ParticleStateSoA generateSpiral(const Config& config, const ContainerSdf* containerSdf) {
+    ParticleStateSoA state;
+    state.resize(config.numParticles);
+    for (size_t idx = 0UL; idx < state.size(); idx++) {
+        // Evenly-ish distribute on unit sphere
+        const float particleIdxFrac = static_cast<float>(idx) / static_cast<float>(state.size());
+        const float inclination     = particleIdxFrac * glm::pi<float>();
+        const float azimuth         = particleIdxFrac * glm::two_pi<float>();
+        const glm::vec3 direction(std::sin(inclination) * std::cos(azimuth),
+                                  std::sin(inclination) * std::sin(azimuth),
+                                  std::cos(inclination));
+
+        // Same hash as rand(vec2(seed, particleIdx)) in the shader
+        const float hash            = std::sin(static_cast<float>(config.initialSeed) * 12.9898f + static_cast<float>(idx) * 4.1414f) * 43758.5453f;
+        const float randomFactor    = hash - std::floor(hash);
+        setParticle(state, idx, config.sphereCenter + (randomFactor * placementRadius(config)) * direction);
+    }
+
+    if (containerSdf) {
+        std::mt19937 rng(config.initialSeed);
+        for (size_t idx = 0UL; idx < state.size(); idx++) {
+            if (!fitsInContainer(config, containerSdf, glm::vec3(state.posX[idx], state.posY[idx], state.posZ[idx]))) { setParticle(state, idx, randomPositionInContainer(config, containerSdf, rng)); }
+        }
+    }
+    return state;
+}
+
+// Bridson's Poisson-disk sampling, grown from the container center (or a random position in a mesh container) until all
+// particles are placed or the container is full
+// The background grid is hashed, so its memory scales with the particle count rather than with the container volume
+static ParticleStateSoA generatePoissonDisk(const Config& config, const ContainerSdf* containerSdf) {
+    ParticleStateSoA state;
+    state.resize(config.numParticles);
+    std::mt19937 rng(config.initialSeed);
+
+    // Cells with a diagonal of one spacing hold at most one sample, and any sample closer than the spacing lies within two cells
+    const float spacing     = 2.0f * maxParticleRadius(config) * (1.0f + PACKING_MARGIN);
+    const float cellSize    = spacing / std::sqrt(3.0f);
+    const float maxRadius   = placementRadius(config);
+    const auto cellKey      = [](const glm::ivec3& cell) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cell.x) & 0x1FFFFFU) << 42U)
+             | (static_cast<uint64_t>(static_cast<uint32_t>(cell.y) & 0x1FFFFFU) << 21U)
+             |  static_cast<uint64_t>(static_cast<uint32_t>(cell.z) & 0x1FFFFFU);
+    };
+    const auto cellOf       = [&](const glm::vec3& position) { return glm::ivec3(glm::floor((position - config.sphereCenter) / cellSize)); };
+    std::unordered_map<uint64_t, uint32_t> grid;
+
+    const auto isFree = [&](const glm::vec3& position) {
+        const glm::ivec3 cell = cellOf(position);
+        for (int32_t z = cell.z - 2; z <= cell.z + 2; z++) {
+            for (int32_t y = cell.y - 2; y <= cell.y + 2; y++) {
+                for (int32_t x = cell.x - 2; x <= cell.x + 2; x++) {
+                    const auto sampleIt = grid.find(cellKey(glm::ivec3(x, y, z)));
+                    if (sampleIt == grid.end()) { continue; }
+                    const glm::vec3 other(state.posX[sampleIt->second], state.posY[sampleIt->second], state.posZ[sampleIt->second]);
+                    if (glm::distance(position, other) < spacing) { return false; }
+                }
+            }
+        }
+        return true;
+    };
+
+    size_t numPlaced = 0UL;
+    std::vector<uint32_t> activeSamples;
+    const auto addSample = [&](const glm::vec3& position) {
+        setParticle(state, numPlaced, position);
+        grid.emplace(cellKey(cellOf(position)), static_cast<uint32_t>(numPlaced));
+        activeSamples.push_back(static_cast<uint32_t>(numPlaced));
+        numPlaced++;
+    };
+
+    const glm::vec3 firstSample = containerSdf && !fitsInContainer(config, containerSdf, config.sphereCenter) ? randomPositionInContainer(config, containerSdf, rng) : config.sphereCenter;
+    if (state.size() > 0UL) { addSample(firstSample); }
+    while (numPlaced < state.size() && !activeSamples.empty()) {
+        // Try candidates in the shell between one and two spacings around a random active sample
+        const size_t activeIdx  = static_cast<size_t>(uniformFloat(rng) * static_cast<float>(activeSamples.size()));
+        const uint32_t sample   = activeSamples[std::min(activeIdx, activeSamples.size() - 1UL)];
+        const glm::vec3 center(state.posX[sample], state.posY[sample], state.posZ[sample]);
+        bool foundCandidate = false;
+        for (int attempt = 0; attempt < POISSON_DISK_ATTEMPTS && !foundCandidate; attempt++) {
+            const glm::vec3 candidate = center + spacing * (1.0f + uniformFloat(rng)) * uniformDirection(rng);
+            if (glm::distance(candidate, config.sphereCenter) > maxRadius || (containerSdf && !fitsInContainer(config, containerSdf, candidate)) || !isFree(candidate)) { continue; }
+            addSample(candidate);
+            foundCandidate = true;
+        }
+
+        // Samples without room around them are retired
+        if (!foundCandidate) {
+            std::swap(activeSamples[std::min(activeIdx, activeSamples.size() - 1UL)], activeSamples.back());
+            activeSamples.pop_back();
+        }
+    }
+
+    placeRemainingAtRandom(state, numPlaced, config, containerSdf, rng);
+    return state;
+}
+
+// Simple cubic lattice around the container center, filled in order of distance to the center. The seed only affects
+// particles that do not fit
+static ParticleStateSoA generateLattice(const Config& config, const ContainerSdf* containerSdf) {
+    ParticleStateSoA state;
+    state.resize(config.numParticles);
+    std::mt19937 rng(config.initialSeed);
+
+    // A lattice ball of radius halfExtent holds about (4/3) pi halfExtent^3 points, so only that much of the container is
+    // generated. Mesh containers may leave out any part of that ball, so their whole container sphere is generated
+    const float spacing         = 2.0f * maxParticleRadius(config) * (1.0f + PACKING_MARGIN);
+    const float maxRadius       = placementRadius(config);
+    const int32_t neededExtent  = static_cast<int32_t>(std::ceil(std::cbrt(3.0f * static_cast<float>(state.size()) / (4.0f * glm::pi<float>())))) + 1;
+    const int32_t maxExtent     = static_cast<int32_t>(maxRadius / spacing);
+    const int32_t halfExtent    = containerSdf ? maxExtent : std::min(maxExtent, neededExtent);
+
+    std::vector<glm::ivec3> points;
+    for (int32_t z = -halfExtent; z <= halfExtent; z++) {
+        for (int32_t y = -halfExtent; y <= halfExtent; y++) {
+            for (int32_t x = -halfExtent; x <= halfExtent; x++) {
+                const bool inSphere = static_cast<float>(x * x + y * y + z * z) * spacing * spacing <= maxRadius * maxRadius;
+                if (inSphere && (!containerSdf || fitsInContainer(config, containerSdf, config.sphereCenter + spacing * glm::vec3(x, y, z)))) { points.emplace_back(x, y, z); }
+            }
+        }
+    }
+    std::stable_sort(points.begin(), points.end(), [](const glm::ivec3& lhs, const glm::ivec3& rhs) {
+        return lhs.x * lhs.x + lhs.y * lhs.y + lhs.z * lhs.z < rhs.x * rhs.x + rhs.y * rhs.y + rhs.z * rhs.z;
+    });
+
+    const size_t numPlaced = std::min(points.size(), state.size());
+    for (size_t idx = 0UL; idx < numPlaced; idx++) { setParticle(state, idx, config.sphereCenter + spacing * glm::vec3(points[idx])); }
+    placeRemainingAtRandom(state, numPlaced, config, containerSdf, rng);
+    return state;
+}
+
+static ParticleStateSoA generatePositions(const Config& config, const ContainerSdf* containerSdf) {
+    switch (config.initialDistribution) {
+        case InitialDistribution::PoissonDisk:  return generatePoissonDisk(config, containerSdf);
+        case InitialDistribution::Lattice:      return generateLattice(config, containerSdf);
+        case InitialDistribution::File:
+            try {
+                return readLatestStateDumpFrame(config.initialStateFile);
+            } catch (const StateDumpException& e) {
+                std::cerr << e.what() << ", falling back to the spiral distribution" << std::endl;
+                return generateSpiral(config, containerSdf);
+            }
+        default:                                return generateSpiral(config, containerSdf);
+    }
+}
+
+ParticleStateSoA generateInitialState(const Config& config, const ContainerSdf* containerSdf) {
+    // Species are assigned independently of the placement, which leaves room for the largest species everywhere
+    ParticleStateSoA state  = generatePositions(config, containerSdf);
+    state.species           = assignSpecies(config, state.size());
+    return state;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <simulation/container_sdf.h>
+#include <simulation/cpu_particles.h>
+#include <utils/config.h>
+
+
+// Places the particles according to config.initialDistribution, deterministically for a given config.initialSeed
+// Generated distributions always contain config.numParticles particles; packed distributions place the particles that do
+// not fit in the container without overlap at random instead. A state dump determines the particle count itself.
+// If the state dump cannot be read, the error is reported and the spiral distribution is used instead
+// Generated particles lie inside the mesh container of the given field, or inside the container sphere without one
+// Species are assigned from the config in every case, state dumps do not store them
+ParticleStateSoA generateInitialState(const Config& config, const ContainerSdf* containerSdf = nullptr);
@@ -0,0 +1,49 @@
+#include "particle_species.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+
+const ParticleSpecies& particleSpecies(const Config& config, uint32_t species) {
+    return config.particleSpecies[std::min(static_cast<size_t>(species), config.particleSpecies.size() - 1UL)];
+}
+
+float maxParticleRadius(const Config& config) {
+    float maxRadiusScale = 0.0f;
+    for (const ParticleSpecies& species : config.particleSpecies) { maxRadiusScale = std::max(maxRadiusScale, species.radiusScale); }
+    return config.particleRadius * maxRadiusScale;
+}
+
+std::vector<uint32_t> assignSpecies(const Config& config, size_t numParticles) {
+    // Largest remainder rounding of the fractions to particle counts; without any positive fraction the species are equally common
+    const size_t numSpecies     = config.particleSpecies.size();
+    const float totalFraction   = std::accumulate(config.particleSpecies.begin(), config.particleSpecies.end(), 0.0f,
+                                                  [](float total, const ParticleSpecies& species) { return total + std::max(species.fraction, 0.0f); });
+    std::vector<size_t> counts(numSpecies);
+    std::vector<float> remainders(numSpecies);
+    size_t numAssigned = 0UL;
+    for (size_t speciesIdx = 0UL; speciesIdx < numSpecies; speciesIdx++) {
+        const float share           = totalFraction > 0.0f ? std::max(config.particleSpecies[speciesIdx].fraction, 0.0f) / totalFraction : 1.0f / static_cast<float>(numSpecies);
+        const float exactCount      = share * static_cast<float>(numParticles);
+        counts[speciesIdx]          = std::min(static_cast<size_t>(exactCount), numParticles - numAssigned);
+        remainders[speciesIdx]      = exactCount - static_cast<float>(counts[speciesIdx]);
+        numAssigned                 += counts[speciesIdx];
+    }
+    std::vector<size_t> byRemainder(numSpecies);
+    std::iota(byRemainder.begin(), byRemainder.end(), 0UL);
+    std::stable_sort(byRemainder.begin(), byRemainder.end(), [&](size_t lhs, size_t rhs) { return remainders[lhs] > remainders[rhs]; });
+    for (size_t rank = 0UL; numAssigned < numParticles; rank = (rank + 1UL) % numSpecies, numAssigned++) { counts[byRemainder[rank]]++; }
+
+    std::vector<uint32_t> species;
+    species.reserve(numParticles);
+    for (size_t speciesIdx = 0UL; speciesIdx < numSpecies; speciesIdx++) { species.insert(species.end(), counts[speciesIdx], static_cast<uint32_t>(speciesIdx)); }
+
+    // Fisher-Yates shuffle on the raw generator output, unlike std::shuffle identical on every standard library. The generator
+    // is offset from the seed of the placement, so that the species do not correlate with the random placement choices
+    if (numSpecies > 1UL) {
+        std::mt19937 rng(config.initialSeed ^ 0x9E3779B9U);
+        for (size_t idx = species.size(); idx > 1UL; idx--) { std::swap(species[idx - 1UL], species[rng() % idx]); }
+    }
+    return species;
+}
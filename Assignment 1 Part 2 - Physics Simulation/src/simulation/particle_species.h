@@ -0,0 +1,20 @@
+#pragma once
+
+#include <utils/config.h>
+
+#include <stdint.h>
+#include <vector>
+
+
+// Species of a particle, clamped to the species of the config so that particles of a removed species fall back to the last one
+const ParticleSpecies& particleSpecies(const Config& config, uint32_t species);
+
+inline float speciesRadius(const Config& config, uint32_t species) { return config.particleRadius * particleSpecies(config, species).radiusScale; }
+inline float speciesMass(const Config& config, uint32_t species) { return particleSpecies(config, species).mass; }
+
+// Radius of the largest species, which the uniform grid cells and the initial placement are sized for
+float maxParticleRadius(const Config& config);
+
+// Species of every particle, in proportion to the species fractions (rounded to whole particles) and shuffled with the
+// initial seed, so that the species are spread evenly over any initial placement
+std::vector<uint32_t> assignSpecies(const Config& config, size_t numParticles);
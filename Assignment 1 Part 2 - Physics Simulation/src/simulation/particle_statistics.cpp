@@ -0,0 +1,190 @@
+#include "particle_statistics.h"
+
+#include <utils/constants.h>
+#include <utils/render_utils.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+
+ParticleStatistics::ParticleStatistics(const Config& simulationConfig)
+    : config(simulationConfig) {
+    initShaders();
+    glGenBuffers(static_cast<GLsizei>(readbackBuffers.size()), readbackBuffers.data());
+    for (GLuint readbackBuffer : readbackBuffers) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(2UL * 4UL * sizeof(float)), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+ParticleStatistics::~ParticleStatistics() {
+    deleteFramebuffersAndTextures();
+    for (GLsync fence : readbackFences) { glDeleteSync(fence); }
+    glDeleteBuffers(static_cast<GLsizei>(readbackBuffers.size()), readbackBuffers.data());
+}
+
+void ParticleStatistics::reset(uint32_t width, uint32_t height) {
+    stateTexWidth   = width;
+    stateTexHeight  = height;
+    deleteFramebuffersAndTextures();
+    initFramebuffersAndTextures();
+    statsPass.bind();
+    glUniform2i(statsPass.getUniformLocation("stateSize"), static_cast<GLint>(stateTexWidth), static_cast<GLint>(stateTexHeight));
+
+    // Results still in flight belong to the previous simulation
+    for (GLsync& fence : readbackFences) {
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    samples.clear();
+}
+
+const std::vector<StatisticsSample>& ParticleStatistics::history() const {
+    return samples;
+}
+
+void ParticleStatistics::record(GLuint positionTex, GLuint velocityTex, GLuint bounceDataTex, GLenum stateTexTarget, GLuint particlePropertiesTex, uint64_t step) {
+    collect();
+    if (readbackFences[nextReadback] != nullptr || reductionLevels.empty()) { return; }
+
+    // First level: per-particle quantities of every block of state texels
+    glBindFramebuffer(GL_FRAMEBUFFER, reductionLevels.front().framebuffer);
+    glViewport(0, 0, static_cast<GLsizei>(reductionLevels.front().width), static_cast<GLsizei>(reductionLevels.front().height));
+    // Buffer textures go to their own units, so the state textures and the state buffers never share one
+    const GLenum firstStateUnit = stateTexTarget == GL_TEXTURE_BUFFER ? GL_TEXTURE4 : GL_TEXTURE0;
+    statsPass.bind();
+    glActiveTexture(firstStateUnit);
+    glBindTexture(stateTexTarget, positionTex);
+    glActiveTexture(firstStateUnit + 1U);
+    glBindTexture(stateTexTarget, velocityTex);
+    glActiveTexture(firstStateUnit + 2U);
+    glBindTexture(stateTexTarget, bounceDataTex);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, particlePropertiesTex);
+    glUniform1i(statsPass.getUniformLocation("stateInBuffers"), stateTexTarget == GL_TEXTURE_BUFFER);
+    glUniform1ui(statsPass.getUniformLocation("numParticles"), config.numParticles);
+    utils::renderQuad(statsPass);
+
+    // Further levels: partial results of every block of the previous level, down to a single texel
+    reducePass.bind();
+    for (size_t levelIdx = 1UL; levelIdx < reductionLevels.size(); levelIdx++) {
+        const ReductionLevel& level = reductionLevels[levelIdx];
+        glBindFramebuffer(GL_FRAMEBUFFER, level.framebuffer);
+        glViewport(0, 0, static_cast<GLsizei>(level.width), static_cast<GLsizei>(level.height));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, reductionLevels[levelIdx - 1UL].texs[0]);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, reductionLevels[levelIdx - 1UL].texs[1]);
+        utils::renderQuad(reducePass);
+    }
+
+    // Read the final texel of both targets into the readback buffer without waiting for it
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[nextReadback]);
+    for (GLenum attachmentIdx = 0U; attachmentIdx < 2U; attachmentIdx++) {
+        glReadBuffer(GL_COLOR_ATTACHMENT0 + attachmentIdx);
+        glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, reinterpret_cast<void*>(attachmentIdx * 4UL * sizeof(float)));
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    readbackFences[nextReadback]    = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readbackSteps[nextReadback]     = step;
+    nextReadback                    = (nextReadback + 1UL) % READBACK_BUFFER_COUNT;
+}
+
+void ParticleStatistics::collect() {
+    // Oldest recording first, so the history stays ordered by step
+    for (size_t offset = 0UL; offset < READBACK_BUFFER_COUNT; offset++) {
+        const size_t slot = (nextReadback + offset) % READBACK_BUFFER_COUNT;
+        if (readbackFences[slot] == nullptr) { continue; }
+        if (glClientWaitSync(readbackFences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) { return; }
+        glDeleteSync(readbackFences[slot]);
+        readbackFences[slot] = nullptr;
+
+        std::array<float, 8UL> result;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[slot]);
+        glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(result.size() * sizeof(float)), result.data());
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        const float totalMass       = std::max(result[3], 1e-20f);
+        const float numParticles    = static_cast<float>(std::max(config.numParticles, 1U));
+        samples.push_back(StatisticsSample {
+            .step           = readbackSteps[slot],
+            .kineticEnergy  = result[4],
+            .maxSpeed       = result[5],
+            .meanSpeed      = result[7] / numParticles,
+            .collisions     = result[6],
+            .centerOfMass   = glm::vec3(result[0], result[1], result[2]) / totalMass });
+        if (samples.size() > HISTORY_SIZE) { samples.erase(samples.begin()); }
+    }
+}
+
+void ParticleStatistics::initFramebuffersAndTextures() {
+    // Every level is STATS_BLOCK_SIZE times smaller than the previous one (rounded up), down to a single texel
+    uint32_t levelWidth     = stateTexWidth;
+    uint32_t levelHeight    = stateTexHeight;
+    do {
+        ReductionLevel level;
+        level.width     = levelWidth    = (levelWidth + utils::STATS_BLOCK_SIZE - 1U) / utils::STATS_BLOCK_SIZE;
+        level.height    = levelHeight   = (levelHeight + utils::STATS_BLOCK_SIZE - 1U) / utils::STATS_BLOCK_SIZE;
+        glGenFramebuffers(1, &level.framebuffer);
+        glGenTextures(static_cast<GLsizei>(level.texs.size()), level.texs.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, level.framebuffer);
+        for (size_t texIdx = 0UL; texIdx < level.texs.size(); texIdx++) {
+            glBindTexture(GL_TEXTURE_2D, level.texs[texIdx]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, static_cast<GLsizei>(level.width), static_cast<GLsizei>(level.height), 0, GL_RGBA, GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(texIdx), level.texs[texIdx], 0);
+        }
+        std::array<GLenum, 2UL> attachments { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(static_cast<GLsizei>(attachments.size()), attachments.data());
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise statistics reduction framebuffer" << std::endl; }
+        reductionLevels.push_back(level);
+    } while (levelWidth > 1U || levelHeight > 1U);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ParticleStatistics::deleteFramebuffersAndTextures() {
+    for (ReductionLevel& level : reductionLevels) {
+        glDeleteFramebuffers(1, &level.framebuffer);
+        glDeleteTextures(static_cast<GLsizei>(level.texs.size()), level.texs.data());
+    }
+    reductionLevels.clear();
+}
+
+void ParticleStatistics::initShaders() {
+    // First reduction level, from the state textures or state buffers
+    try {
+        ShaderBuilder statsBuilder;
+        statsBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "screen-quad.vert");
+        statsBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-stats.frag");
+        statsBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        statsPass = statsBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Further reduction levels, from the partial results of the previous level
+    try {
+        ShaderBuilder reduceBuilder;
+        reduceBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "screen-quad.vert");
+        reduceBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-stats-reduce.frag");
+        reducePass = reduceBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Texture units never change, so they are assigned once here instead of every recording. The buffer of the stored position
+    // representation is bound by ParticlesSimulator
+    statsPass.setUniformBlockBinding("PositionTiling", utils::POSITION_TILING_BINDING);
+    statsPass.bind();
+    glUniform1i(statsPass.getUniformLocation("positions"), 0);
+    glUniform1i(statsPass.getUniformLocation("velocities"), 1);
+    glUniform1i(statsPass.getUniformLocation("bounceData"), 2);
+    glUniform1i(statsPass.getUniformLocation("particleProperties"), 3);
+    glUniform1i(statsPass.getUniformLocation("positionBuffer"), 4);
+    glUniform1i(statsPass.getUniformLocation("velocityBuffer"), 5);
+    glUniform1i(statsPass.getUniformLocation("bounceDataBuffer"), 6);
+    glUniform1i(statsPass.getUniformLocation("blockSize"), static_cast<GLint>(utils::STATS_BLOCK_SIZE));
+    reducePass.bind();
+    glUniform1i(reducePass.getUniformLocation("partialMassMoments"), 0);
+    glUniform1i(reducePass.getUniformLocation("partialMotion"), 1);
+    glUniform1i(reducePass.getUniformLocation("blockSize"), static_cast<GLint>(utils::STATS_BLOCK_SIZE));
+}
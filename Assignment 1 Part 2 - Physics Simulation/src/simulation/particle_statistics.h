@@ -0,0 +1,82 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <framework/opengl_includes.h>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/shader.h>
+
+#include <utils/config.h>
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+
+// Aggregate metrics of the particle state after a step
+struct StatisticsSample {
+    uint64_t step;
+    float kineticEnergy;        // Sum of 0.5 m |v|^2 over all particles
+    float maxSpeed;
+    float meanSpeed;
+    float collisions;           // Collisions counted towards the bounce coloring in this step
+    glm::vec3 centerOfMass;
+};
+
+// Live statistics of the last HISTORY_SIZE recorded steps
+// The particle state is reduced on the GPU: a first pass sums the per-particle quantities of STATS_BLOCK_SIZE^2 texel blocks, and
+// further passes reduce the partial results the same way down to a single texel. That texel is read into one of
+// READBACK_BUFFER_COUNT pixel pack buffers and fenced, and only read on the CPU once the fence has signaled, so recording never
+// stalls the pipeline. A step whose readback buffer is still in flight is skipped instead
+class ParticleStatistics {
+public:
+    static constexpr size_t HISTORY_SIZE = 256UL;
+
+    ParticleStatistics(const Config& simulationConfig);
+    ~ParticleStatistics();
+
+    ParticleStatistics(const ParticleStatistics&) = delete;
+    ParticleStatistics& operator=(const ParticleStatistics&) = delete;
+
+    // Size the reduction for state textures of the given dimensions and clear the history
+    void reset(uint32_t width, uint32_t height);
+    // Queue the reduction of the given state, which holds the state after the given step; also collects any results that
+    // became available. The state is either the state textures (GL_TEXTURE_2D) or the buffer textures of the transform-feedback
+    // state buffers (GL_TEXTURE_BUFFER), which are reduced in place. The radius and mass of every particle are read from the
+    // particle properties buffer texture
+    void record(GLuint positionTex, GLuint velocityTex, GLuint bounceDataTex, GLenum stateTexTarget, GLuint particlePropertiesTex, uint64_t step);
+
+    // Samples from oldest to newest, e.g. for plotting
+    const std::vector<StatisticsSample>& history() const;
+
+private:
+    static constexpr size_t READBACK_BUFFER_COUNT = 2UL;
+
+    struct ReductionLevel {
+        uint32_t width, height;
+        GLuint framebuffer;
+        std::array<GLuint, 2UL> texs;   // Partial results of every block: (sum of m*x, m*y, m*z, m) and (sum of 0.5*m*|v|^2, max |v|, sum of collisions, sum of |v|)
+    };
+
+    // Shared state
+    const Config& config;
+
+    // Internal variables
+    uint32_t stateTexWidth = 0U, stateTexHeight = 0U;
+    std::vector<ReductionLevel> reductionLevels;                        // Finest first, the last one is a single texel
+    std::array<GLuint, READBACK_BUFFER_COUNT> readbackBuffers;          // Pixel pack buffers the final texel is read into
+    std::array<GLsync, READBACK_BUFFER_COUNT> readbackFences {};        // Signaled once the matching buffer holds its result, nullptr if unused
+    std::array<uint64_t, READBACK_BUFFER_COUNT> readbackSteps {};
+    size_t nextReadback = 0UL;                                          // Readback buffer the next recording goes to; buffers are used round-robin
+    std::vector<StatisticsSample> samples;
+    Shader statsPass, reducePass;
+
+    // Setup
+    void initShaders();
+    void initFramebuffersAndTextures();
+    void deleteFramebuffersAndTextures();
+
+    // Readback
+    void collect();
+};
@@ -6,40 +6,111 @@ DISABLE_WARNINGS_PUSH()
 DISABLE_WARNINGS_POP()
 
 #include <render/mesh.h>
+#include <simulation/initial_state.h>
 #include <utils/constants.h>
 #include <utils/render_utils.hpp>
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <utility>
 
 
+// Gather the particles from the RGBA texels of the position, velocity and bounce data state textures (state is already sized)
+static void unpackStateTexels(const float* positions, const float* velocities, const float* bounceData, const PositionTiling& positionTiling, ParticleStateSoA& state) {
+    for (size_t idx = 0UL; idx < state.size(); idx++) {
+        const glm::vec3 position    = positionTiling.decode(glm::vec4(positions[4UL * idx], positions[4UL * idx + 1], positions[4UL * idx + 2], positions[4UL * idx + 3]));
+        state.posX[idx]             = position.x;
+        state.posY[idx]             = position.y;
+        state.posZ[idx]             = position.z;
+        state.velX[idx]             = velocities[4UL * idx];
+        state.velY[idx]             = velocities[4UL * idx + 1];
+        state.velZ[idx]             = velocities[4UL * idx + 2];
+        state.collisionCounts[idx]  = static_cast<int32_t>(bounceData[4UL * idx]);
+        state.frameCounters[idx]    = static_cast<int32_t>(bounceData[4UL * idx + 1]);
+        state.sleepCounters[idx]    = static_cast<int32_t>(bounceData[4UL * idx + 2]);
+        state.stepCollisions[idx]   = static_cast<int32_t>(bounceData[4UL * idx + 3]);
+    }
+}
+
 ParticlesSimulator::ParticlesSimulator(Config& config)
     : config(config)
-    , particleModel(utils::RESOURCES_DIR_PATH / "sphere.obj", true) {
+    , particleModel(utils::RESOURCES_DIR_PATH / "sphere.obj", true)
+    , particleCulling(config, particleModel.numIndices())
+    , particleLods(config)
+    , particleTrails(config)
+    , grid(config)
+    , particleStatistics(config)
+    , collisionEventRecorder(config)
+    , cpuSolver(config, config.cpuSolverThreads) {
+    initUniformBuffers();
     initShaders();
-    initFramebuffersAndTextures();
     setInitialData();
+    lastAutosave = std::chrono::steady_clock::now();
 }
 
 ParticlesSimulator::~ParticlesSimulator() {
+    // Requested snapshots are still written, so the last one (e.g. an autosave right before closing) is not lost
+    pollSnapshots(true);
     deleteFramebuffersAndTextures();
+    glDeleteBuffers(1, &simulationParametersUBO);
+    glDeleteBuffers(1, &positionTilingUBO);
+    glDeleteTextures(1, &containerSdfTex);
 }
 
-void ParticlesSimulator::render(const glm::mat4& viewProjection) {
-    // Simulation step needed
-    if (config.doContinuousSimulation || config.doSingleStep) {
-        simulate();             
-        renderToPing          = !renderToPing;  // Swap ping-pong buffers so drawing can happen from correct buffer
-        config.doSingleStep = false;            // Reset single step flag
-    }
+void ParticlesSimulator::render(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float frameTime) {
+    update(frameTime);
 
     // Draw particles based on current data
-    draw(viewProjection);
+    draw(viewProjection, cameraPosition);
+}
+
+void ParticlesSimulator::update(float frameTime) {
+    // Simulation steps needed
+    step(scheduleSteps(frameTime));
+}
+
+void ParticlesSimulator::step(uint32_t numSteps) {
+    pollSnapshots(false);
+    collisionEventRecorder.update();
+    updateSimulationParameters();
+    updateParticleProperties();
+    if (numSteps == 0U) { return; }
+
+    // Simulation passes render to textures of their own size, so the screen viewport has to be restored afterwards
+    std::array<GLint, 4UL> screenViewport;
+    glGetIntegerv(GL_VIEWPORT, screenViewport.data());
+    simulate(numSteps);
+    simulatedSteps += numSteps;
+    if (config.recordStatistics) { recordStatistics(); }
+    recordTrails();
+    glViewport(screenViewport[0], screenViewport[1], screenViewport[2], screenViewport[3]);
+    autosave();
+}
+
+uint32_t ParticlesSimulator::scheduleSteps(float frameTime) {
+    const uint32_t maxSteps = static_cast<uint32_t>(std::max(config.substepsPerFrame, 1));
+    if (!config.doContinuousSimulation) {
+        stepAccumulator     = 0.0f;
+        const bool doStep   = config.doSingleStep;
+        config.doSingleStep = false;    // Reset single step flag
+        return doStep ? 1U : 0U;
+    }
+    config.doSingleStep = false;
+    if (!config.realTimeStepping) { return maxSteps; }
+
+    // Consume the elapsed time in fixed timesteps. Time that does not fit in the step budget is dropped, so the simulation
+    // slows down instead of falling further and further behind when steps take longer than the time they simulate
+    stepAccumulator         += frameTime;
+    const uint32_t numSteps = std::min(static_cast<uint32_t>(stepAccumulator / config.particleSimTimestep), maxSteps);
+    stepAccumulator         = std::min(stepAccumulator - static_cast<float>(numSteps) * config.particleSimTimestep, config.particleSimTimestep);
+    return numSteps;
 }
 
 void ParticlesSimulator::resetSimulation() {
     deleteFramebuffersAndTextures();
-    initFramebuffersAndTextures();
     setInitialData();
 }
 
@@ -48,12 +119,26 @@ void ParticlesSimulator::initFramebuffersAndTextures() {
     glGenFramebuffers(1, &simulationFramebufferPing);
     glGenFramebuffers(1, &simulationFramebufferPong);
 
-    // Create all textures. Textures have dimensions (numParticles, 1)
+    // Particles are laid out in rows of at most STATE_TEX_MAX_WIDTH texels, so the particle count is not limited by the maximum texture width
+    GLint maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    stateTexWidth   = std::min(config.numParticles, utils::STATE_TEX_MAX_WIDTH);
+    stateTexHeight  = (config.numParticles + stateTexWidth - 1U) / stateTexWidth;
+    if (stateTexHeight > static_cast<uint32_t>(maxTextureSize)) { std::cerr << "Particle count exceeds the maximum state texture size" << std::endl; }
+
+    // The tiles the positions are stored relative to only change along with the textures, as the stored positions depend on them
+    positionTiling = computePositionTiling(config);
+    glBindBuffer(GL_UNIFORM_BUFFER, positionTilingUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PositionTiling), &positionTiling);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // Create all textures. Textures have dimensions (stateTexWidth, stateTexHeight)
+    const GLenum internalFormat = config.statePrecision == StatePrecision::Full ? GL_RGBA32F : GL_RGBA16F;
     std::array<GLuint*, 6UL> allTexPtrs = { &positionTexPing, &positionTexPong, &velocityTexPing, &velocityTexPong, &bouncesTexPing, &bouncesTexPong};
     for (GLuint* texPtr : allTexPtrs) {
         glGenTextures(1, texPtr);
         glBindTexture(GL_TEXTURE_2D, *texPtr);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, config.numParticles, 1, 0, GL_RGB, GL_HALF_FLOAT, nullptr);
+        glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(internalFormat), static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), 0, GL_RGBA, GL_FLOAT, nullptr);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -79,21 +164,104 @@ void ParticlesSimulator::initFramebuffersAndTextures() {
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise simulation ping framebuffer" << std::endl; }
     glBindFramebuffer(GL_FRAMEBUFFER, simulationFramebufferPong);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise simulation pong framebuffer" << std::endl; }
+
+    // Jacobi iterations accumulate small corrections, so their positions are always stored at full precision
+    glGenFramebuffers(static_cast<GLsizei>(predictedFramebuffers.size()), predictedFramebuffers.data());
+    glGenTextures(static_cast<GLsizei>(predictedTexs.size()), predictedTexs.data());
+    for (size_t texIdx = 0UL; texIdx < predictedTexs.size(); texIdx++) {
+        glBindTexture(GL_TEXTURE_2D, predictedTexs[texIdx]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, predictedFramebuffers[texIdx]);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, predictedTexs[texIdx], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise position-based solver framebuffer" << std::endl; }
+    }
+
+    // Sleeping: wake flags and the active list, which holds every particle when none are asleep
+    glGenTextures(1, &wakeTex);
+    glBindTexture(GL_TEXTURE_2D, wakeTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenFramebuffers(1, &wakeFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, wakeFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, wakeTex, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise wake framebuffer" << std::endl; }
+    glGenBuffers(1, &activeListBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, activeListBuffer);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(config.numParticles * sizeof(GLuint)), nullptr, GL_DYNAMIC_COPY);
+    glGenTransformFeedbacks(1, &activeListTransformFeedback);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, activeListTransformFeedback);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, activeListBuffer);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glGenVertexArrays(1, &activeListVAO);
+    glBindVertexArray(activeListVAO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Particle properties only change with the species in the config, so a single copy serves every backend and both sides of the ping-pong state
+    glGenBuffers(1, &particlePropertiesBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, particlePropertiesBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(4UL * sizeof(float) * config.numParticles), nullptr, GL_DYNAMIC_DRAW);
+    glGenTextures(1, &particlePropertiesTex);
+    glBindTexture(GL_TEXTURE_BUFFER, particlePropertiesTex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, particlePropertiesBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    particlePropertiesUploaded = false;
+
+    particleStatistics.reset(stateTexWidth, stateTexHeight);
+    particleTrails.reset(stateTexWidth, stateTexHeight);
+    initStateBuffers();
 }
 
 void ParticlesSimulator::setInitialData() {
-    // Set initial particle data for both framebuffers
-    std::array<GLuint, 2> dataFramebuffers = { simulationFramebufferPing, simulationFramebufferPong };
-    for (GLuint framebuffer : dataFramebuffers) {
-        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-        initialDataPass.bind();
-        glUniform1ui(initialDataPass.getUniformLocation("numParticles"), config.numParticles);
-        glUniform1f(initialDataPass.getUniformLocation("particleRadius"), config.particleRadius);
-        glUniform3fv(initialDataPass.getUniformLocation("containerCenter"), 1, glm::value_ptr(config.sphereCenter));
-        glUniform1f(initialDataPass.getUniformLocation("containerRadius"), config.sphereRadius);
-        utils::renderQuad(initialDataPass);
+    // The state is generated first, as a state dump determines the particle count the textures are sized for
+    updateContainerSdf();
+    initState(generateInitialState(config, activeContainerSdf()));
+    simulatedSteps = 0UL;
+}
+
+void ParticlesSimulator::initState(ParticleStateSoA state) {
+    config.numParticles = static_cast<uint32_t>(state.size());
+    initFramebuffersAndTextures();
+    grid.reset();
+    updateSimulationParameters();
+
+    // The CPU solver keeps the state, so switching to the CPU backend right away needs no readback
+    cpuSolver.setState(std::move(state));
+    cpuStateIsCurrent       = true;
+    buffersHoldLatestState  = false;
+    updateParticleProperties();
+
+    // Stage the positions, velocities and bounce data in one pixel unpack buffer, so the whole state is transferred in a
+    // single upload that the ping and pong textures are then both filled from
+    const size_t numTexels = static_cast<size_t>(stateTexWidth) * stateTexHeight;
+    std::vector<float> stagingData, rgbaData;
+    stagingData.reserve(3UL * 4UL * numTexels);
+    cpuSolver.packPositions(rgbaData, numTexels);
+    positionTiling.encodeTexels(rgbaData, config.numParticles);
+    stagingData.insert(stagingData.end(), rgbaData.begin(), rgbaData.end());
+    cpuSolver.packVelocities(rgbaData, numTexels);
+    stagingData.insert(stagingData.end(), rgbaData.begin(), rgbaData.end());
+    cpuSolver.packBounceData(rgbaData, numTexels);
+    stagingData.insert(stagingData.end(), rgbaData.begin(), rgbaData.end());
+
+    GLuint stagingBuffer;
+    glGenBuffers(1, &stagingBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(stagingData.size() * sizeof(float)), stagingData.data(), GL_STREAM_DRAW);
+    std::array<GLuint, 6UL> stateTexs = { positionTexPing, velocityTexPing, bouncesTexPing, positionTexPong, velocityTexPong, bouncesTexPong };
+    for (size_t texIdx = 0UL; texIdx < stateTexs.size(); texIdx++) {
+        const size_t stagingOffset = (texIdx % 3UL) * 4UL * numTexels * sizeof(float);
+        glBindTexture(GL_TEXTURE_2D, stateTexs[texIdx]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), GL_RGBA, GL_FLOAT, reinterpret_cast<const void*>(stagingOffset));
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &stagingBuffer);
 }
 
 void ParticlesSimulator::deleteFramebuffersAndTextures() {
@@ -104,6 +272,60 @@ void ParticlesSimulator::deleteFramebuffersAndTextures() {
     // Textures
     std::array<GLuint*, 6UL> allTexPtrs = { &positionTexPing, &positionTexPong, &velocityTexPing, &velocityTexPong, &bouncesTexPing, &bouncesTexPong };
     for (GLuint* texPtr : allTexPtrs) { glDeleteTextures(1, texPtr); }
+
+    // Position-based solver
+    glDeleteFramebuffers(static_cast<GLsizei>(predictedFramebuffers.size()), predictedFramebuffers.data());
+    glDeleteTextures(static_cast<GLsizei>(predictedTexs.size()), predictedTexs.data());
+
+    // Sleeping
+    glDeleteFramebuffers(1, &wakeFramebuffer);
+    glDeleteTextures(1, &wakeTex);
+    glDeleteTransformFeedbacks(1, &activeListTransformFeedback);
+    glDeleteBuffers(1, &activeListBuffer);
+    glDeleteVertexArrays(1, &activeListVAO);
+
+    // Particle properties
+    glDeleteTextures(1, &particlePropertiesTex);
+    glDeleteBuffers(1, &particlePropertiesBuffer);
+
+    deleteStateBuffers();
+}
+
+void ParticlesSimulator::initStateBuffers() {
+    // Buffers have the size of the state textures (including padding), so the state can be copied between both with pixel buffer transfers
+    const GLsizeiptr bufferSize = static_cast<GLsizeiptr>(4UL * sizeof(float) * stateTexWidth * stateTexHeight);
+    for (ParticleStateBuffers* buffers : { &stateBuffersPing, &stateBuffersPong }) {
+        std::array<GLuint*, 3UL> bufferPtrs = { &buffers->positionBuffer, &buffers->velocityBuffer, &buffers->bounceDataBuffer };
+        std::array<GLuint*, 3UL> texPtrs    = { &buffers->positionTex, &buffers->velocityTex, &buffers->bounceDataTex };
+        glGenTransformFeedbacks(1, &buffers->transformFeedback);
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, buffers->transformFeedback);
+        for (size_t bufferIdx = 0UL; bufferIdx < bufferPtrs.size(); bufferIdx++) {
+            glGenBuffers(1, bufferPtrs[bufferIdx]);
+            glBindBuffer(GL_ARRAY_BUFFER, *bufferPtrs[bufferIdx]);
+            glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_DYNAMIC_COPY);
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, static_cast<GLuint>(bufferIdx), *bufferPtrs[bufferIdx]);
+
+            glGenTextures(1, texPtrs[bufferIdx]);
+            glBindTexture(GL_TEXTURE_BUFFER, *texPtrs[bufferIdx]);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, *bufferPtrs[bufferIdx]);
+        }
+    }
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+void ParticlesSimulator::deleteStateBuffers() {
+    for (ParticleStateBuffers* buffers : { &stateBuffersPing, &stateBuffersPong }) {
+        std::array<GLuint, 3UL> allBuffers  = { buffers->positionBuffer, buffers->velocityBuffer, buffers->bounceDataBuffer };
+        std::array<GLuint, 3UL> allTexs     = { buffers->positionTex, buffers->velocityTex, buffers->bounceDataTex };
+        glDeleteTransformFeedbacks(1, &buffers->transformFeedback);
+        glDeleteBuffers(static_cast<GLsizei>(allBuffers.size()), allBuffers.data());
+        glDeleteTextures(static_cast<GLsizei>(allTexs.size()), allTexs.data());
+    }
+    glDeleteVertexArrays(1, &emptyVAO);
 }
 
 void ParticlesSimulator::initShaders() {
@@ -112,107 +334,886 @@ void ParticlesSimulator::initShaders() {
         ShaderBuilder simulationBuilder;
         simulationBuilder.addStage(GL_VERTEX_SHADER,    utils::SHADERS_DIR_PATH / "simulation" / "screen-quad.vert");
         simulationBuilder.addStage(GL_FRAGMENT_SHADER,  utils::SHADERS_DIR_PATH / "simulation" / "particle-sim.frag");
+        simulationBuilder.addStage(GL_FRAGMENT_SHADER,  utils::SHADERS_DIR_PATH / "simulation" / "particle-sim-step.glsl");
+        simulationBuilder.addStage(GL_FRAGMENT_SHADER,  utils::SHADERS_DIR_PATH / "simulation" / "container.glsl");
+        simulationBuilder.addStage(GL_FRAGMENT_SHADER,  utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
         simulationPass = simulationBuilder.build();
-    } catch (ShaderLoadingException e) { std::cerr << e.what() << std::endl; }
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+
+    // Transform-feedback simulation shader, sharing the particle update with the simulation shader above
+    try {
+        ShaderBuilder transformFeedbackBuilder;
+        transformFeedbackBuilder.addStage(GL_VERTEX_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-sim-tf.vert");
+        transformFeedbackBuilder.addStage(GL_VERTEX_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-sim-step.glsl");
+        transformFeedbackBuilder.addStage(GL_VERTEX_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "container.glsl");
+        transformFeedbackBuilder.addStage(GL_VERTEX_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        transformFeedbackBuilder.setTransformFeedbackVaryings({ "finalPosition", "finalVelocity", "finalBounceData" }, GL_SEPARATE_ATTRIBS);
+        transformFeedbackPass = transformFeedbackBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Position-based solver shaders: prediction, one Jacobi constraint iteration, and velocity update
+    try {
+        ShaderBuilder pbdPredictBuilder;
+        pbdPredictBuilder.addStage(GL_VERTEX_SHADER,    utils::SHADERS_DIR_PATH / "simulation" / "particle-pbd-point.vert");
+        pbdPredictBuilder.addStage(GL_FRAGMENT_SHADER,  utils::SHADERS_DIR_PATH / "simulation" / "particle-pbd-predict.frag");
+        pbdPredictBuilder.addStage(GL_FRAGMENT_SHADER,  utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        pbdPredictPass = pbdPredictBuilder.build();
+
+        ShaderBuilder pbdProjectBuilder;
+        pbdProjectBuilder.addStage(GL_VERTEX_SHADER,    utils::SHADERS_DIR_PATH / "simulation" / "particle-pbd-point.vert");
+        pbdProjectBuilder.addStage(GL_FRAGMENT_SHADER,  utils::SHADERS_DIR_PATH / "simulation" / "particle-pbd-project.frag");
+        pbdProjectBuilder.addStage(GL_FRAGMENT_SHADER,  utils::SHADERS_DIR_PATH / "simulation" / "container.glsl");
+        pbdProjectPass = pbdProjectBuilder.build();
 
+        ShaderBuilder pbdFinalizeBuilder;
+        pbdFinalizeBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-pbd-point.vert");
+        pbdFinalizeBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-pbd-finalize.frag");
+        pbdFinalizeBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "container.glsl");
+        pbdFinalizeBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        pbdFinalizePass = pbdFinalizeBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Sleeping shaders: wake-up of sleeping particles touched by moving ones, and compaction of the active list
+    try {
+        ShaderBuilder sleepWakeBuilder;
+        sleepWakeBuilder.addStage(GL_VERTEX_SHADER,     utils::SHADERS_DIR_PATH / "simulation" / "particle-sleep-index.vert");
+        sleepWakeBuilder.addStage(GL_GEOMETRY_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-sleep-wake.geom");
+        sleepWakeBuilder.addStage(GL_GEOMETRY_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        sleepWakeBuilder.addStage(GL_FRAGMENT_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-sleep-wake.frag");
+        sleepWakePass = sleepWakeBuilder.build();
+
+        ShaderBuilder sleepCompactBuilder;
+        sleepCompactBuilder.addStage(GL_VERTEX_SHADER,      utils::SHADERS_DIR_PATH / "simulation" / "particle-sleep-index.vert");
+        sleepCompactBuilder.addStage(GL_GEOMETRY_SHADER,    utils::SHADERS_DIR_PATH / "simulation" / "particle-sleep-compact.geom");
+        sleepCompactBuilder.setTransformFeedbackVaryings({ "activeParticleIdx" }, GL_INTERLEAVED_ATTRIBS);
+        sleepCompactPass = sleepCompactBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Collision event capture, repeating the particle update of the simulation shaders in a geometry shader
+    try {
+        ShaderBuilder collisionEventsBuilder;
+        collisionEventsBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-sleep-index.vert");
+        collisionEventsBuilder.addStage(GL_GEOMETRY_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-collision-events.geom");
+        collisionEventsBuilder.addStage(GL_GEOMETRY_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-sim-step.glsl");
+        collisionEventsBuilder.addStage(GL_GEOMETRY_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "container.glsl");
+        collisionEventsBuilder.addStage(GL_GEOMETRY_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        collisionEventsBuilder.setTransformFeedbackVaryings({ "eventParticleIdx", "eventOtherIdx", "eventContactPosition", "eventImpulse", "eventStep" }, GL_INTERLEAVED_ATTRIBS);
+        collisionEventsPass = collisionEventsBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
 
     // Draw shader
     try {
         ShaderBuilder drawBuilder;
         drawBuilder.addStage(GL_VERTEX_SHADER,      utils::SHADERS_DIR_PATH / "simulation" / "particle-draw.vert");
+        drawBuilder.addStage(GL_VERTEX_SHADER,      utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
         drawBuilder.addStage(GL_FRAGMENT_SHADER,    utils::SHADERS_DIR_PATH / "simulation" / "particle-draw.frag");
+        drawBuilder.addStage(GL_FRAGMENT_SHADER,    utils::SHADERS_DIR_PATH / "simulation" / "particle-shading.glsl");
         drawPass = drawBuilder.build();
-    }  catch (ShaderLoadingException e) { std::cerr << e.what() << std::endl; }
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Draw shader reading the particle state from the transform-feedback buffers as instanced attributes
+    try {
+        ShaderBuilder drawBuffersBuilder;
+        drawBuffersBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-draw-buffers.vert");
+        drawBuffersBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        drawBuffersBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-draw.frag");
+        drawBuffersBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-shading.glsl");
+        drawBuffersPass = drawBuffersBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
 
-    // Set initial positions and velocities shader
+    // Draw shader ray casting spheres on camera-facing quads, reading the particle state from either the textures or the buffers
     try {
-        ShaderBuilder initialPositionBuilder;
-        initialPositionBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "screen-quad.vert");
-        initialPositionBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-set-initial-data.frag");
-        initialDataPass = initialPositionBuilder.build();
-    }  catch (ShaderLoadingException e) { std::cerr << e.what() << std::endl; }
+        ShaderBuilder drawImpostorBuilder;
+        drawImpostorBuilder.addStage(GL_VERTEX_SHADER,      utils::SHADERS_DIR_PATH / "simulation" / "particle-impostor.vert");
+        drawImpostorBuilder.addStage(GL_VERTEX_SHADER,      utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        drawImpostorBuilder.addStage(GL_FRAGMENT_SHADER,    utils::SHADERS_DIR_PATH / "simulation" / "particle-impostor.frag");
+        drawImpostorBuilder.addStage(GL_FRAGMENT_SHADER,    utils::SHADERS_DIR_PATH / "simulation" / "particle-shading.glsl");
+        drawImpostorPass = drawImpostorBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Draw shader for the LOD meshes and culled meshes, drawing the particles whose indices were binned into a LOD or found visible
+    try {
+        ShaderBuilder drawLodBuilder;
+        drawLodBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-draw-lod.vert");
+        drawLodBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        drawLodBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-draw.frag");
+        drawLodBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-shading.glsl");
+        drawLodPass = drawLodBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Texture units and uniform blocks never change, so they are assigned once here instead of every frame
+    for (const Shader* pass : { &simulationPass, &transformFeedbackPass, &collisionEventsPass, &pbdPredictPass, &pbdProjectPass, &pbdFinalizePass, &sleepWakePass, &drawPass, &drawBuffersPass, &drawImpostorPass, &drawLodPass }) {
+        pass->bindUniformBlock("SimulationParameters", utils::SIMULATION_PARAMETERS_BINDING, simulationParametersUBO);
+    }
+    for (const Shader* pass : { &simulationPass, &transformFeedbackPass, &collisionEventsPass, &pbdPredictPass, &pbdFinalizePass, &sleepWakePass, &drawPass, &drawBuffersPass, &drawImpostorPass, &drawLodPass }) {
+        pass->bindUniformBlock("PositionTiling", utils::POSITION_TILING_BINDING, positionTilingUBO);
+    }
+    for (const Shader* pass : { &simulationPass, &transformFeedbackPass }) {
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("previousPositions"), 0);
+        glUniform1i(pass->getUniformLocation("previousVelocities"), 1);
+        glUniform1i(pass->getUniformLocation("previousBounceData"), 2);
+    }
+    collisionEventsPass.bind();
+    glUniform1i(collisionEventsPass.getUniformLocation("previousPositions"), 0);
+    glUniform1i(collisionEventsPass.getUniformLocation("previousVelocities"), 1);
+    glUniform1i(collisionEventsPass.getUniformLocation("previousPositionBuffer"), 8);
+    glUniform1i(collisionEventsPass.getUniformLocation("previousVelocityBuffer"), 9);
+    pbdPredictPass.bind();
+    glUniform1i(pbdPredictPass.getUniformLocation("previousPositions"), 0);
+    glUniform1i(pbdPredictPass.getUniformLocation("previousVelocities"), 1);
+    pbdProjectPass.bind();
+    glUniform1i(pbdProjectPass.getUniformLocation("predictedPositions"), 0);
+    pbdFinalizePass.bind();
+    glUniform1i(pbdFinalizePass.getUniformLocation("previousPositions"), 0);
+    glUniform1i(pbdFinalizePass.getUniformLocation("predictedPositions"), 1);
+    glUniform1i(pbdFinalizePass.getUniformLocation("previousBounceData"), 2);
+    sleepWakePass.bind();
+    glUniform1i(sleepWakePass.getUniformLocation("positions"), 0);
+    glUniform1i(sleepWakePass.getUniformLocation("velocities"), 1);
+    glUniform1i(sleepWakePass.getUniformLocation("bounceData"), 2);
+    sleepCompactPass.bind();
+    glUniform1i(sleepCompactPass.getUniformLocation("bounceData"), 2);
+    glUniform1i(sleepCompactPass.getUniformLocation("wakeFlags"), 5);
+    for (const Shader* pass : { &simulationPass, &transformFeedbackPass, &collisionEventsPass, &pbdProjectPass, &pbdFinalizePass }) {
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("containerSdf"), 6);
+    }
+    for (const Shader* pass : { &simulationPass, &transformFeedbackPass, &collisionEventsPass, &pbdProjectPass, &pbdFinalizePass, &sleepWakePass, &drawPass, &drawBuffersPass, &drawImpostorPass, &drawLodPass }) {
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("particleProperties"), 7);
+    }
+    for (const Shader* pass : { &drawPass, &drawImpostorPass, &drawLodPass }) {
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("positions"), 0);
+        glUniform1i(pass->getUniformLocation("velocities"), 1);
+        glUniform1i(pass->getUniformLocation("bounceData"), 2);
+    }
+    for (const Shader* pass : { &drawImpostorPass, &drawLodPass }) {
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("positionBuffer"), 3);
+        glUniform1i(pass->getUniformLocation("velocityBuffer"), 4);
+        glUniform1i(pass->getUniformLocation("bounceDataBuffer"), 5);
+    }
 }
 
-void ParticlesSimulator::simulate() {
-    // Figure out which textures to sample from and which framebuffer to draw to
-    GLuint drawFramebuffer      = renderToPing ? simulationFramebufferPing : simulationFramebufferPong;
-    GLuint samplePositionTex    = renderToPing ? positionTexPong : positionTexPing;
-    GLuint sampleVelocityTex    = renderToPing ? velocityTexPong : velocityTexPing;
-    GLuint sampleBounceDataTex  = renderToPing ? bouncesTexPong : bouncesTexPing;
+void ParticlesSimulator::simulate(uint32_t numSteps) {
+    // The container mesh may have been changed in the menu since the previous frame
+    updateContainerSdf();
+
+    // Move the latest state to where the selected backend reads it from, when switching over from or to the transform-feedback backend
+    const bool useStateBuffers = config.simulationBackend == SimulationBackend::TransformFeedback;
+    if (useStateBuffers && !buffersHoldLatestState)         { copyTexturesToBuffers(); }
+    else if (!useStateBuffers && buffersHoldLatestState)    { copyBuffersToTextures(); }
+    buffersHoldLatestState = useStateBuffers;
+
+    if (config.simulationBackend == SimulationBackend::CPU) {
+        simulateOnCpu(numSteps);
+        return;
+    }
+    cpuStateIsCurrent = false;
+    if (useStateBuffers) {
+        simulateWithTransformFeedback(numSteps);
+        return;
+    }
+    if (config.solverMode == SolverMode::PositionBased) {
+        simulatePositionBased(numSteps);
+        return;
+    }
 
-    // Bind framebuffer and simulation shader
-    glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+    // Uniforms keep their values in the shader program, so they are only set once for all steps
+    const bool useUniformGrid = config.particleInterCollision && config.broadPhase == BroadPhase::UniformGrid;
+    grid.updateLayout();
     simulationPass.bind();
+    bindSimulationUniforms(simulationPass, useUniformGrid);
+    beginCollisionEvents(useUniformGrid, false);
+
+    for (uint32_t step = 0U; step < numSteps; step++) {
+        // Figure out which textures to sample from and which framebuffer to draw to
+        GLuint drawFramebuffer      = renderToPing ? simulationFramebufferPing : simulationFramebufferPong;
+        GLuint samplePositionTex    = renderToPing ? positionTexPong : positionTexPing;
+        GLuint sampleVelocityTex    = renderToPing ? velocityTexPong : velocityTexPing;
+        GLuint sampleBounceDataTex  = renderToPing ? bouncesTexPong : bouncesTexPing;
+
+        // Sort particles into the uniform grid used by the narrow phase
+        if (useUniformGrid) { grid.build(samplePositionTex); }
+
+        // Bind framebuffer, simulation shader and previous iteration textures
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+        glViewport(0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight));
+        simulationPass.bind();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, samplePositionTex);
+        glActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_2D, sampleVelocityTex);
+        glActiveTexture(GL_TEXTURE0 + 2);
+        glBindTexture(GL_TEXTURE_2D, sampleBounceDataTex);
+        grid.bindQueryTextures(3); // Always bound, so the integer samplers never alias the float textures on unit 0
+        if (collisionEventRecorder.isCapturing()) {
+            captureCollisionEvents(samplePositionTex, sampleVelocityTex, GL_TEXTURE_2D, simulatedSteps + step + 1UL);
+            simulationPass.bind();
+        }
+
+        // Render fullscreen quad to 'touch' all texels
+        utils::renderQuad(simulationPass);
+        renderToPing = !renderToPing;   // Swap ping-pong buffers so the next step and drawing sample from the correct buffer
+    }
+    collisionEventRecorder.endFrame();
+}
+
+void ParticlesSimulator::simulateWithTransformFeedback(uint32_t numSteps) {
+    // Uniforms keep their values in the shader program, so they are only set once for all steps
+    const bool useUniformGrid = config.particleInterCollision && config.broadPhase == BroadPhase::UniformGrid;
+    grid.updateLayout();
+    transformFeedbackPass.bind();
+    bindSimulationUniforms(transformFeedbackPass, useUniformGrid);
+    beginCollisionEvents(useUniformGrid, true);
+
+    for (uint32_t step = 0U; step < numSteps; step++) {
+        // Figure out which buffers to sample from and which buffers to capture into
+        const ParticleStateBuffers& sampleBuffers   = renderToPing ? stateBuffersPong : stateBuffersPing;
+        const ParticleStateBuffers& captureBuffers  = renderToPing ? stateBuffersPing : stateBuffersPong;
+
+        // Sort particles into the uniform grid used by the narrow phase
+        if (useUniformGrid) { grid.build(sampleBuffers.positionTex, GL_TEXTURE_BUFFER); }
+
+        // Bind simulation shader and previous iteration buffers
+        transformFeedbackPass.bind();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, sampleBuffers.positionTex);
+        glActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_BUFFER, sampleBuffers.velocityTex);
+        glActiveTexture(GL_TEXTURE0 + 2);
+        glBindTexture(GL_TEXTURE_BUFFER, sampleBuffers.bounceDataTex);
+        grid.bindQueryTextures(3);
+        if (collisionEventRecorder.isCapturing()) {
+            captureCollisionEvents(sampleBuffers.positionTex, sampleBuffers.velocityTex, GL_TEXTURE_BUFFER, simulatedSteps + step + 1UL);
+            transformFeedbackPass.bind();
+        }
+
+        // Run one vertex per particle and capture its outputs; nothing needs to be rasterized (unlike the grid passes above)
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(emptyVAO);
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, captureBuffers.transformFeedback);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
+        glEndTransformFeedback();
+        glDisable(GL_RASTERIZER_DISCARD);
+        renderToPing = !renderToPing;
+    }
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    collisionEventRecorder.endFrame();
+}
+
+void ParticlesSimulator::simulatePositionBased(uint32_t numSteps) {
+    // Uniforms keep their values in the shader programs, so they are only set once for all steps
+    const bool useUniformGrid       = config.particleInterCollision && config.broadPhase == BroadPhase::UniformGrid;
+    const bool useActiveList        = config.sleepSettledParticles;
+    const uint32_t numIterations    = static_cast<uint32_t>(std::max(config.pbdIterations, 1));
+    const int32_t sleepSteps        = std::max(config.sleepSteps, 1);
+    grid.updateLayout();
+    for (const Shader* pass : { &pbdPredictPass, &pbdProjectPass, &pbdFinalizePass }) {
+        pass->bind();
+        glUniform1i(pass->getUniformLocation("useActiveList"), useActiveList);
+        glUniform2i(pass->getUniformLocation("stateTexSize"), static_cast<GLint>(stateTexWidth), static_cast<GLint>(stateTexHeight));
+    }
+    pbdProjectPass.bind();
+    bindSimulationUniforms(pbdProjectPass, useUniformGrid);
+    glUniform1f(pbdProjectPass.getUniformLocation("relaxation"), config.pbdRelaxation);
+    pbdFinalizePass.bind();
+    bindContainerUniforms(pbdFinalizePass);
+    glUniform1i(pbdFinalizePass.getUniformLocation("sleepingEnabled"), useActiveList);
+    glUniform1f(pbdFinalizePass.getUniformLocation("sleepEnergyThreshold"), config.sleepEnergyThreshold);
+    glUniform1i(pbdFinalizePass.getUniformLocation("sleepSteps"), sleepSteps);
+    if (useActiveList) {
+        sleepWakePass.bind();
+        bindSimulationUniforms(sleepWakePass, useUniformGrid);
+        glUniform1f(sleepWakePass.getUniformLocation("sleepEnergyThreshold"), config.sleepEnergyThreshold);
+        glUniform1i(sleepWakePass.getUniformLocation("sleepSteps"), sleepSteps);
+        sleepCompactPass.bind();
+        glUniform1i(sleepCompactPass.getUniformLocation("sleepSteps"), sleepSteps);
+    }
+
+    for (uint32_t step = 0U; step < numSteps; step++) {
+        // Figure out which textures to sample from and which framebuffer to draw to
+        GLuint sampleFramebuffer    = renderToPing ? simulationFramebufferPong : simulationFramebufferPing;
+        GLuint drawFramebuffer      = renderToPing ? simulationFramebufferPing : simulationFramebufferPong;
+        GLuint samplePositionTex    = renderToPing ? positionTexPong : positionTexPing;
+        GLuint sampleVelocityTex    = renderToPing ? velocityTexPong : velocityTexPing;
+        GLuint sampleBounceDataTex  = renderToPing ? bouncesTexPong : bouncesTexPing;
+
+        // Only the particles on the active list are drawn by the passes below, the others keep their previous state. The wake-up
+        // finds the particles touching a moving one at their previous positions, so it gets a grid of its own
+        if (useActiveList) {
+            if (useUniformGrid) { grid.build(samplePositionTex); }
+            updateActiveList(samplePositionTex, sampleVelocityTex, sampleBounceDataTex);
+            copySleepingState(sampleFramebuffer, drawFramebuffer, samplePositionTex);
+        }
+        glViewport(0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight));
+
+        // Predict unconstrained positions
+        glBindFramebuffer(GL_FRAMEBUFFER, predictedFramebuffers[0]);
+        pbdPredictPass.bind();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, samplePositionTex);
+        glActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_2D, sampleVelocityTex);
+        drawSimulatedParticles(pbdPredictPass, useActiveList);
+
+        // The grid is built once per step over the predicted positions and reused by every iteration; copySleepingState wrote
+        // the sleeping particles into them at their previous positions
+        if (useUniformGrid) {
+            grid.build(predictedTexs[0], GL_TEXTURE_2D, true);
+            glViewport(0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight));
+        }
+
+        // Jacobi iterations, ping-ponging between the predicted position textures
+        pbdProjectPass.bind();
+        grid.bindQueryTextures(3);
+        for (uint32_t iteration = 0U; iteration < numIterations; iteration++) {
+            glBindFramebuffer(GL_FRAMEBUFFER, predictedFramebuffers[(iteration + 1U) % 2U]);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, predictedTexs[iteration % 2U]);
+            glUniform1ui(pbdProjectPass.getUniformLocation("iteration"), iteration);
+            drawSimulatedParticles(pbdProjectPass, useActiveList);
+        }
+
+        // Derive velocities from the corrected positions and write the next state
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+        pbdFinalizePass.bind();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, samplePositionTex);
+        glActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_2D, predictedTexs[numIterations % 2U]);
+        glActiveTexture(GL_TEXTURE0 + 2);
+        glBindTexture(GL_TEXTURE_2D, sampleBounceDataTex);
+        drawSimulatedParticles(pbdFinalizePass, useActiveList);
+        renderToPing = !renderToPing;   // Swap ping-pong buffers so the next step and drawing sample from the correct buffer
+    }
+}
 
-    // Bind uniforms (previous iteration textures, timestep, and frame index)
+void ParticlesSimulator::updateActiveList(GLuint positionTex, GLuint velocityTex, GLuint bounceDataTex) {
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, samplePositionTex);
-    glUniform1i(simulationPass.getUniformLocation("previousPositions"), 0);
+    glBindTexture(GL_TEXTURE_2D, positionTex);
     glActiveTexture(GL_TEXTURE0 + 1);
-    glBindTexture(GL_TEXTURE_2D, sampleVelocityTex);
-    glUniform1i(simulationPass.getUniformLocation("previousVelocities"), 1);
+    glBindTexture(GL_TEXTURE_2D, velocityTex);
     glActiveTexture(GL_TEXTURE0 + 2);
-    glBindTexture(GL_TEXTURE_2D, sampleBounceDataTex);
-    glUniform1i(simulationPass.getUniformLocation("previousBounceData"), 2);
-    glUniform1f(simulationPass.getUniformLocation("timestep"), config.particleSimTimestep);
-    glUniform1ui(simulationPass.getUniformLocation("numParticles"), config.numParticles);
-    glUniform1f(simulationPass.getUniformLocation("particleRadius"), config.particleRadius);
-    glUniform3fv(simulationPass.getUniformLocation("containerCenter"), 1, glm::value_ptr(config.sphereCenter));
-    glUniform1f(simulationPass.getUniformLocation("containerRadius"), config.sphereRadius);
-    glUniform1i(simulationPass.getUniformLocation("interParticleCollision"), config.particleInterCollision);
+    glBindTexture(GL_TEXTURE_2D, bounceDataTex);
+    glActiveTexture(GL_TEXTURE0 + 5);
+    glBindTexture(GL_TEXTURE_2D, wakeTex);
+    grid.bindQueryTextures(3);
+    glBindVertexArray(emptyVAO);
 
-    // ===== Part 3: Blinking =====
-    //glUniform1i(drawPass.getUniformLocation("enableBounce"), config.enableBounceBasedColoring);
-    glUniform1i(simulationPass.getUniformLocation("bounceThreshold"), config.bounceThreshold);
-    glUniform1i(simulationPass.getUniformLocation("bounceFrames"), config.bounceFrames);
-    //glUniform3fv(drawPass.getUniformLocation("bounceColor"), 1, glm::value_ptr(config.bounceColor));
+    // Moving particles mark the sleeping particles they touch in the wake texture
+    constexpr std::array<GLfloat, 4UL> notWoken = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glBindFramebuffer(GL_FRAMEBUFFER, wakeFramebuffer);
+    glViewport(0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight));
+    glClearBufferfv(GL_COLOR, 0, notWoken.data());
+    sleepWakePass.bind();
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
 
-    // Render fullscreen quad to 'touch' all texels
-    utils::renderQuad(simulationPass);
+    // Awake and woken particles are captured into the active list; nothing needs to be rasterized
+    glEnable(GL_RASTERIZER_DISCARD);
+    sleepCompactPass.bind();
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, activeListTransformFeedback);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
+    glEndTransformFeedback();
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
 }
 
-void ParticlesSimulator::draw(const glm::mat4& viewProjection) {
+void ParticlesSimulator::copySleepingState(GLuint sampleFramebuffer, GLuint drawFramebuffer, GLuint samplePositionTex) {
+    // Sleeping particles are never drawn to, so the whole previous state is copied into the next one first, one attachment at a time
+    const GLint width   = static_cast<GLint>(stateTexWidth);
+    const GLint height  = static_cast<GLint>(stateTexHeight);
+    std::array<GLenum, 3UL> attachments { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sampleFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+    for (GLenum attachment : attachments) {
+        glReadBuffer(attachment);
+        glDrawBuffers(1, &attachment);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    glDrawBuffers(3, attachments.data());
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    // Neighbours read the positions of sleeping particles from both predicted position textures. Those hold world-space
+    // positions rather than stored ones, so they are written by the prediction pass, keeping every particle in place
+    glViewport(0, 0, width, height);
+    pbdPredictPass.bind();
+    glUniform1i(pbdPredictPass.getUniformLocation("keepPositions"), GL_TRUE);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, samplePositionTex);
+    for (GLuint predictedFramebuffer : predictedFramebuffers) {
+        glBindFramebuffer(GL_FRAMEBUFFER, predictedFramebuffer);
+        drawSimulatedParticles(pbdPredictPass, false);
+    }
+    glUniform1i(pbdPredictPass.getUniformLocation("keepPositions"), GL_FALSE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ParticlesSimulator::drawSimulatedParticles(const Shader& pass, bool useActiveList) const {
+    // One point per particle; the number of active particles is only known to the GPU, which draws as many as were captured
+    pass.bind();
+    if (useActiveList) {
+        glBindVertexArray(activeListVAO);
+        glDrawTransformFeedback(GL_POINTS, activeListTransformFeedback);
+    } else {
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
+    }
+}
+
+void ParticlesSimulator::bindSimulationUniforms(const Shader& pass, bool useUniformGrid) const {
+    // Everything else comes from the SimulationParameters uniform block
+    glUniform1i(pass.getUniformLocation("useUniformGrid"), useUniformGrid);
+    grid.bindQueryUniforms(pass, 3);
+    bindContainerUniforms(pass);
+}
+
+void ParticlesSimulator::bindContainerUniforms(const Shader& pass) const {
+    // No other pass uses 3D textures, so the field stays bound to its unit while the steps run
+    const ContainerSdf* sdf = activeContainerSdf();
+    glUniform1i(pass.getUniformLocation("useContainerSdf"), sdf != nullptr);
+    if (!sdf) { return; }
+    glUniform3fv(pass.getUniformLocation("containerSdfOrigin"), 1, glm::value_ptr(sdf->origin));
+    glUniform3fv(pass.getUniformLocation("containerSdfSize"), 1, glm::value_ptr(sdf->size()));
+    glActiveTexture(GL_TEXTURE0 + 6);
+    glBindTexture(GL_TEXTURE_3D, containerSdfTex);
+}
+
+void ParticlesSimulator::beginCollisionEvents(bool useUniformGrid, bool stateInBuffers) {
+    // Transform feedback is started with the capture program, which then has to be bound whenever a step is captured
+    collisionEventsPass.bind();
+    bindSimulationUniforms(collisionEventsPass, useUniformGrid);
+    glUniform1i(collisionEventsPass.getUniformLocation("stateInBuffers"), stateInBuffers);
+    collisionEventRecorder.beginFrame(simulatedSteps + 1UL);
+}
+
+void ParticlesSimulator::captureCollisionEvents(GLuint positionTex, GLuint velocityTex, GLenum target, uint64_t step) {
+    // Buffer textures go to units of their own, the float samplers on units 0 and 1 must not alias them
+    const GLenum firstUnit = target == GL_TEXTURE_BUFFER ? 8U : 0U;
+    std::array<GLuint, 2UL> stateTexs = { positionTex, velocityTex };
+    for (GLenum texIdx = 0U; texIdx < stateTexs.size(); texIdx++) {
+        glActiveTexture(GL_TEXTURE0 + firstUnit + texIdx);
+        glBindTexture(target, stateTexs[texIdx]);
+    }
+
+    // The grid of this step is already built and bound, so the capture sees exactly what the simulation pass sees
+    collisionEventsPass.bind();
+    glUniform1ui(collisionEventsPass.getUniformLocation("stepIndex"), static_cast<GLuint>(step));
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(emptyVAO);
+    collisionEventRecorder.captureStep(config.numParticles);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void ParticlesSimulator::updateContainerSdf() {
+    // Baking takes a while, so it only happens when the mesh container is selected with a mesh or resolution it was not baked for yet
+    if (config.containerShape == ContainerShape::Mesh
+        && (config.containerMeshFile != bakedContainerMeshFile || config.containerSdfResolution != bakedContainerSdfResolution)) {
+        bakedContainerMeshFile      = config.containerMeshFile;
+        bakedContainerSdfResolution = config.containerSdfResolution;
+        containerSdf.reset();
+        try {
+            containerSdf = bakeContainerSdf(config.containerMeshFile, config.containerSdfResolution);
+        } catch (const ContainerSdfException& e) {
+            std::cerr << e.what() << ", falling back to the container sphere" << std::endl;
+        }
+
+        if (containerSdf) {
+            if (containerSdfTex == 0U) { glGenTextures(1, &containerSdfTex); }
+            glBindTexture(GL_TEXTURE_3D, containerSdfTex);
+            glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, containerSdf->resolution.x, containerSdf->resolution.y, containerSdf->resolution.z, 0, GL_RED, GL_FLOAT, containerSdf->distances.data());
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_3D, 0);
+        }
+    }
+    cpuSolver.setContainerSdf(activeContainerSdf());
+}
+
+const ContainerSdf* ParticlesSimulator::activeContainerSdf() const {
+    return config.containerShape == ContainerShape::Mesh && containerSdf ? &*containerSdf : nullptr;
+}
+
+void ParticlesSimulator::initUniformBuffers() {
+    glGenBuffers(1, &simulationParametersUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, simulationParametersUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(SimulationParameters), nullptr, GL_DYNAMIC_DRAW);
+    simulationParametersUploaded = false;
+    glGenBuffers(1, &positionTilingUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, positionTilingUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(PositionTiling), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void ParticlesSimulator::updateSimulationParameters() {
+    SimulationParameters parameters {};
+    parameters.containerCenter          = config.sphereCenter;
+    parameters.containerRadius          = config.sphereRadius;
+    parameters.timestep                 = config.particleSimTimestep;
+    parameters.numParticles             = config.numParticles;
+    parameters.interParticleCollision   = config.particleInterCollision;
+    parameters.bounceThreshold          = config.bounceThreshold;
+    parameters.bounceFrames             = config.bounceFrames;
+
+    // The config is edited in place by the menu, so changes are detected by comparing against the last upload
+    if (!simulationParametersUploaded || std::memcmp(&parameters, &uploadedParameters, sizeof(SimulationParameters)) != 0) {
+        glBindBuffer(GL_UNIFORM_BUFFER, simulationParametersUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SimulationParameters), &parameters);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        uploadedParameters              = parameters;
+        simulationParametersUploaded    = true;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, utils::SIMULATION_PARAMETERS_BINDING, simulationParametersUBO);
+    glBindBufferBase(GL_UNIFORM_BUFFER, utils::POSITION_TILING_BINDING, positionTilingUBO);
+}
+
+void ParticlesSimulator::updateParticleProperties() {
+    // Species never change during a simulation, so the CPU solver always holds them, even while the GPU holds the latest state.
+    // Their radii and masses are edited in place by the menu, so changes are detected by comparing against the last upload
+    if (!particlePropertiesUploaded || config.particleRadius != uploadedParticleRadius || config.particleSpecies != uploadedSpecies) {
+        std::vector<float> rgbaData;
+        cpuSolver.packProperties(rgbaData, config.numParticles);
+        glBindBuffer(GL_TEXTURE_BUFFER, particlePropertiesBuffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(4UL * sizeof(float) * config.numParticles), rgbaData.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        uploadedParticleRadius      = config.particleRadius;
+        uploadedSpecies             = config.particleSpecies;
+        particlePropertiesUploaded  = true;
+    }
+
+    // No other pass uses texture unit 7, so the properties stay bound to it while the steps run
+    glActiveTexture(GL_TEXTURE0 + 7);
+    glBindTexture(GL_TEXTURE_BUFFER, particlePropertiesTex);
+}
+
+void ParticlesSimulator::draw(const glm::mat4& viewProjection, const glm::vec3& cameraPosition) {
     // renderToPing indicates which textures the simulation step will render to NEXT
     // This means that we sample from the one that was rendered to LAST, which is !renderToPing
     GLuint samplePositionTex    = renderToPing ? positionTexPong : positionTexPing;
     GLuint sampleVelocityTex    = renderToPing ? velocityTexPong : velocityTexPing;
     GLuint sampleBounceDataTex  = renderToPing ? bouncesTexPong : bouncesTexPing;
+    const ParticleStateBuffers& sampleBuffers = renderToPing ? stateBuffersPong : stateBuffersPing;
+
+    // Cull particles outside the view or hidden in the previous frame, and bin the visible ones into levels of detail by their
+    // size on screen; both render to their own small targets
+    const bool drawImpostors    = config.particleRenderMode == ParticleRenderMode::Impostor;
+    const bool drawLods         = config.particleRenderMode == ParticleRenderMode::LodMesh;
+    const bool cullInstances    = particleCulling.enabled() && !drawLods;
+    const bool drawIndexed      = drawLods || (cullInstances && !drawImpostors);   // Meshes drawn through a list of particle indices
+    std::array<GLint, 4UL> screenViewport;
+    glGetIntegerv(GL_VIEWPORT, screenViewport.data());
+    particleCulling.setView(viewProjection);
+    if (drawLods) {
+        const float screenScale = static_cast<float>(screenViewport[3]) / (2.0f * std::tan(utils::FOV / 2.0f));
+        if (buffersHoldLatestState) { particleLods.bin(sampleBuffers.positionTex, GL_TEXTURE_BUFFER, particlePropertiesTex, cameraPosition, screenScale, particleCulling); }
+        else                        { particleLods.bin(samplePositionTex, GL_TEXTURE_2D, particlePropertiesTex, cameraPosition, screenScale, particleCulling); }
+    } else if (cullInstances) {
+        if (buffersHoldLatestState) { particleCulling.cull(sampleBuffers.positionTex, GL_TEXTURE_BUFFER, particlePropertiesTex); }
+        else                        { particleCulling.cull(samplePositionTex, GL_TEXTURE_2D, particlePropertiesTex); }
+    }
+    glViewport(screenViewport[0], screenViewport[1], screenViewport[2], screenViewport[3]);
 
     // Bind main framebuffer and drawing shader
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    drawPass.bind();
+    const Shader& pass = drawImpostors ? drawImpostorPass : (drawIndexed ? drawLodPass : (buffersHoldLatestState ? drawBuffersPass : drawPass));
+    pass.bind();
+
+    // Bind particle data, either the state buffers (as instanced attributes for the mesh, or buffer textures otherwise) or the state textures
+    if (buffersHoldLatestState && !drawImpostors && !drawIndexed) {
+        particleModel.setInstanceAttribute(3, sampleBuffers.positionBuffer);
+        particleModel.setInstanceAttribute(4, sampleBuffers.velocityBuffer);
+        particleModel.setInstanceAttribute(5, sampleBuffers.bounceDataBuffer);
+    } else if (buffersHoldLatestState) {
+        glActiveTexture(GL_TEXTURE0 + 3);
+        glBindTexture(GL_TEXTURE_BUFFER, sampleBuffers.positionTex);
+        glActiveTexture(GL_TEXTURE0 + 4);
+        glBindTexture(GL_TEXTURE_BUFFER, sampleBuffers.velocityTex);
+        glActiveTexture(GL_TEXTURE0 + 5);
+        glBindTexture(GL_TEXTURE_BUFFER, sampleBuffers.bounceDataTex);
+    } else {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, samplePositionTex);
+        glActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_2D, sampleVelocityTex);
+        glActiveTexture(GL_TEXTURE0 + 2);
+        glBindTexture(GL_TEXTURE_2D, sampleBounceDataTex);
+    }
+    glActiveTexture(GL_TEXTURE0 + 7);
+    glBindTexture(GL_TEXTURE_BUFFER, particlePropertiesTex);
 
     // Bind uniforms
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, samplePositionTex);
-    glUniform1i(drawPass.getUniformLocation("positions"), 0);
-    glActiveTexture(GL_TEXTURE0 + 1);
-    glBindTexture(GL_TEXTURE_2D, sampleVelocityTex);
-    glUniform1i(drawPass.getUniformLocation("velocities"), 1);
-    glActiveTexture(GL_TEXTURE0 + 2);
-    glBindTexture(GL_TEXTURE_2D, sampleBounceDataTex);
-    glUniform1i(drawPass.getUniformLocation("bounceData"), 2);
-    glUniformMatrix4fv(drawPass.getUniformLocation("viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
-    glUniform1ui(drawPass.getUniformLocation("numParticles"), config.numParticles);
-    glUniform1f(drawPass.getUniformLocation("particleRadius"), config.particleRadius);
-    glUniform3fv(drawPass.getUniformLocation("containerCenter"), 1, glm::value_ptr(config.sphereCenter));
+    glUniformMatrix4fv(pass.getUniformLocation("viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    if (drawImpostors) {
+        glUniform3fv(pass.getUniformLocation("cameraPosition"), 1, glm::value_ptr(cameraPosition));
+        glUniform1i(pass.getUniformLocation("instancesCulled"), cullInstances);
+    }
+    if (drawImpostors || drawIndexed) { glUniform1i(pass.getUniformLocation("stateInBuffers"), buffersHoldLatestState); }
 
     // ===== Part 2: Drawing =====
-    glUniform3fv(drawPass.getUniformLocation("minSpeedColor"), 1, glm::value_ptr(config.minSpeedColor));
-    glUniform3fv(drawPass.getUniformLocation("maxSpeedColor"), 1, glm::value_ptr(config.maxSpeedColor));
-    glUniform1f(drawPass.getUniformLocation("maxSpeedThreshold"), config.maxSpeedThreshold);
-    glUniform1i(drawPass.getUniformLocation("useSpeedBasedColoring"), config.useSpeedBasedColoring);
+    glUniform3fv(pass.getUniformLocation("minSpeedColor"), 1, glm::value_ptr(config.minSpeedColor));
+    glUniform3fv(pass.getUniformLocation("maxSpeedColor"), 1, glm::value_ptr(config.maxSpeedColor));
+    glUniform1f(pass.getUniformLocation("maxSpeedThreshold"), config.maxSpeedThreshold);
+    glUniform1i(pass.getUniformLocation("useSpeedBasedColoring"), config.useSpeedBasedColoring);
 
-    glUniform1i(drawPass.getUniformLocation("enableShading"), config.enableShading);
-    glUniform1f(drawPass.getUniformLocation("ambientCoefficient"), config.ambientCoefficient);
+    glUniform1i(pass.getUniformLocation("enableShading"), config.enableShading);
+    glUniform1f(pass.getUniformLocation("ambientCoefficient"), config.ambientCoefficient);
 
     // ===== Part 3: Blinking =====
-    glUniform1i(drawPass.getUniformLocation("enableBounce"), config.enableBounceBasedColoring);
-    //glUniform1i(drawPass.getUniformLocation("bounceThreshold"), config.bounceThreshold);
-    //glUniform1i(drawPass.getUniformLocation("bounceFrames"), config.bounceFrames);
-    glUniform3fv(drawPass.getUniformLocation("bounceColor"), 1, glm::value_ptr(config.bounceColor));
+    glUniform1i(pass.getUniformLocation("enableBounce"), config.enableBounceBasedColoring);
+    //glUniform1i(pass.getUniformLocation("bounceThreshold"), config.bounceThreshold);
+    //glUniform1i(pass.getUniformLocation("bounceFrames"), config.bounceFrames);
+    glUniform3fv(pass.getUniformLocation("bounceColor"), 1, glm::value_ptr(config.bounceColor));
 
 
-    // Render number of instances equal to number of particles
-    particleModel.drawInstanced(config.numParticles);
+    // Render number of instances equal to number of (visible) particles, as a quad per particle for impostors or split over the LOD meshes
+    if (drawLods) {
+        particleLods.draw(3);
+    } else if (cullInstances) {
+        if (drawImpostors)  { particleCulling.drawQuads(0); }
+        else                { particleCulling.drawMeshes(particleModel, 3); }
+    } else if (drawImpostors) {
+        glBindVertexArray(emptyVAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(config.numParticles));
+    } else {
+        particleModel.drawInstanced(static_cast<GLsizei>(config.numParticles));
+    }
+
+    // The depth of the particles is what the particles of the next frame are tested against
+    particleCulling.updateHiZ(viewProjection, screenViewport);
+
+    particleTrails.draw(viewProjection);
+}
+
+void ParticlesSimulator::simulateOnCpu(uint32_t numSteps) {
+    // Continue from the state the GPU left behind, when switching over from the GPU backend
+    if (!cpuStateIsCurrent) {
+        downloadStateToCpu();
+        cpuStateIsCurrent = true;
+    }
+
+    // Step on the CPU and upload the final result to the textures the GPU would have rendered to last, so drawing is unchanged
+    for (uint32_t step = 0U; step < numSteps; step++) {
+        cpuSolver.step();
+        renderToPing = !renderToPing;
+    }
+    if (renderToPing)   { uploadStateFromCpu(positionTexPong, velocityTexPong, bouncesTexPong); }
+    else                { uploadStateFromCpu(positionTexPing, velocityTexPing, bouncesTexPing); }
+}
+
+ParticleStateSoA ParticlesSimulator::readState() {
+    if (cpuStateIsCurrent) { return cpuSolver.state(); }
+    if (buffersHoldLatestState) { copyBuffersToTextures(); }
+
+    // Textures rendered to LAST hold the latest state
+    std::array<GLuint, 3UL> sampleTexs = { renderToPing ? positionTexPong : positionTexPing,
+                                           renderToPing ? velocityTexPong : velocityTexPing,
+                                           renderToPing ? bouncesTexPong : bouncesTexPing };
+    std::array<std::vector<float>, 3UL> rgbaData;
+    for (size_t texIdx = 0UL; texIdx < sampleTexs.size(); texIdx++) {
+        rgbaData[texIdx].resize(4UL * stateTexWidth * stateTexHeight);
+        glBindTexture(GL_TEXTURE_2D, sampleTexs[texIdx]);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, rgbaData[texIdx].data());
+    }
+
+    ParticleStateSoA state;
+    state.resize(config.numParticles);
+    unpackStateTexels(rgbaData[0].data(), rgbaData[1].data(), rgbaData[2].data(), positionTiling, state);
+    state.species = cpuSolver.state().species;  // Species never change, so the CPU copy is current
+    return state;
+}
+
+void ParticlesSimulator::saveState(const std::filesystem::path& filePath) {
+    PendingSnapshot pending;
+    pending.filePath        = filePath;
+    pending.snapshot.step   = simulatedSteps;
+    if (cpuStateIsCurrent) {
+        pending.snapshot.state = cpuSolver.state();
+        pendingSnapshots.push_back(std::move(pending));
+        return;
+    }
+
+    // Copy the latest state into a pixel pack buffer and fence it; pollSnapshots() maps the buffer once the GPU got there,
+    // so the simulation does not stall on the readback like readState() does
+    pending.numTexels               = static_cast<size_t>(stateTexWidth) * stateTexHeight;
+    pending.positionTiling          = positionTiling;
+    pending.snapshot.state.species  = cpuSolver.state().species;
+    const size_t blockSize          = 4UL * sizeof(float) * pending.numTexels;
+    glGenBuffers(1, &pending.packBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.packBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(3UL * blockSize), nullptr, GL_STREAM_READ);
+    if (buffersHoldLatestState) {
+        const ParticleStateBuffers& buffers = renderToPing ? stateBuffersPong : stateBuffersPing;
+        std::array<GLuint, 3UL> allBuffers  = { buffers.positionBuffer, buffers.velocityBuffer, buffers.bounceDataBuffer };
+        for (size_t bufferIdx = 0UL; bufferIdx < allBuffers.size(); bufferIdx++) {
+            glBindBuffer(GL_COPY_READ_BUFFER, allBuffers[bufferIdx]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_PIXEL_PACK_BUFFER, 0, static_cast<GLintptr>(bufferIdx * blockSize), static_cast<GLsizeiptr>(blockSize));
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    } else {
+        std::array<GLuint, 3UL> sampleTexs = { renderToPing ? positionTexPong : positionTexPing,
+                                               renderToPing ? velocityTexPong : velocityTexPing,
+                                               renderToPing ? bouncesTexPong : bouncesTexPing };
+        for (size_t texIdx = 0UL; texIdx < sampleTexs.size(); texIdx++) {
+            glBindTexture(GL_TEXTURE_2D, sampleTexs[texIdx]);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, reinterpret_cast<void*>(texIdx * blockSize));
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    pending.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();  // Make sure the fence is submitted, so polling it without flushing eventually succeeds
+    pendingSnapshots.push_back(std::move(pending));
+}
+
+void ParticlesSimulator::loadState(const std::filesystem::path& filePath) {
+    // Read the whole file before touching the current state, so a broken file leaves the simulation running as it was
+    Snapshot snapshot = readSnapshot(filePath);
+    deleteFramebuffersAndTextures();
+    updateContainerSdf();
+    initState(std::move(snapshot.state));
+    simulatedSteps = snapshot.step;
+}
+
+void ParticlesSimulator::pollSnapshots(bool wait) {
+    while (!pendingSnapshots.empty()) {
+        // Files are written one at a time in the order they were requested, so an older snapshot never replaces a newer one
+        if (snapshotWrite.valid()) {
+            if (!wait && snapshotWrite.wait_for(std::chrono::seconds(0)) != std::future_status::ready) { return; }
+            try {
+                snapshotWrite.get();
+            } catch (const SnapshotException& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+
+        PendingSnapshot& pending = pendingSnapshots.front();
+        if (pending.packBuffer != 0U) {
+            const GLenum syncStatus = wait ? glClientWaitSync(pending.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED) : glClientWaitSync(pending.fence, 0, 0);
+            if (syncStatus == GL_TIMEOUT_EXPIRED) { return; }
+            bool readBackFailed = syncStatus == GL_WAIT_FAILED;
+            if (!readBackFailed) {
+                const size_t numFloats = 4UL * pending.numTexels;
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.packBuffer);
+                const float* rgbaData = static_cast<const float*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(3UL * numFloats * sizeof(float)), GL_MAP_READ_BIT));
+                if (rgbaData) {
+                    ParticleStateSoA& state = pending.snapshot.state;
+                    state.resize(state.species.size());
+                    unpackStateTexels(rgbaData, rgbaData + numFloats, rgbaData + 2UL * numFloats, pending.positionTiling, state);
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                } else {
+                    readBackFailed = true;
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+            if (readBackFailed) { std::cerr << "Failed to read back the particle state for " << pending.filePath.string() << std::endl; }
+            glDeleteSync(pending.fence);
+            glDeleteBuffers(1, &pending.packBuffer);
+            if (readBackFailed) {
+                pendingSnapshots.pop_front();
+                continue;
+            }
+        }
+
+        snapshotWrite = std::async(std::launch::async, [filePath = std::move(pending.filePath), snapshot = std::move(pending.snapshot)]() { writeSnapshot(filePath, snapshot); });
+        pendingSnapshots.pop_front();
+    }
+
+    if (wait && snapshotWrite.valid()) {
+        try {
+            snapshotWrite.get();
+        } catch (const SnapshotException& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+}
+
+void ParticlesSimulator::autosave() {
+    // Skip an autosave while the previous one is still on its way, so a slow disk does not pile up readbacks
+    const auto now = std::chrono::steady_clock::now();
+    if (config.autosaveInterval <= 0.0f || !pendingSnapshots.empty()) { return; }
+    if (std::chrono::duration<float>(now - lastAutosave).count() < config.autosaveInterval) { return; }
+    saveState(config.snapshotFile);
+    lastAutosave = now;
+}
+
+const ParticleStatistics& ParticlesSimulator::statistics() const {
+    return particleStatistics;
+}
+
+const CollisionEventRecorder& ParticlesSimulator::collisionEvents() const {
+    return collisionEventRecorder;
+}
+
+void ParticlesSimulator::recordStatistics() {
+    // Buffers or textures written to LAST hold the latest state; the state buffers are reduced in place rather than copied to the
+    // state textures every frame
+    if (buffersHoldLatestState) {
+        const ParticleStateBuffers& latestBuffers = renderToPing ? stateBuffersPong : stateBuffersPing;
+        particleStatistics.record(latestBuffers.positionTex, latestBuffers.velocityTex, latestBuffers.bounceDataTex, GL_TEXTURE_BUFFER, particlePropertiesTex, simulatedSteps);
+    }
+    else if (renderToPing)  { particleStatistics.record(positionTexPong, velocityTexPong, bouncesTexPong, GL_TEXTURE_2D, particlePropertiesTex, simulatedSteps); }
+    else                    { particleStatistics.record(positionTexPing, velocityTexPing, bouncesTexPing, GL_TEXTURE_2D, particlePropertiesTex, simulatedSteps); }
+}
+
+void ParticlesSimulator::recordTrails() {
+    // Buffers or textures written to LAST hold the latest positions
+    if (buffersHoldLatestState) { particleTrails.recordFromBuffer(renderToPing ? stateBuffersPong.positionBuffer : stateBuffersPing.positionBuffer); }
+    else                        { particleTrails.record(renderToPing ? positionTexPong : positionTexPing); }
+}
+
+void ParticlesSimulator::downloadStateToCpu() {
+    cpuSolver.setState(readState());
+}
+
+void ParticlesSimulator::uploadStateFromCpu(GLuint positionTex, GLuint velocityTex, GLuint bounceDataTex) {
+    // Texels past the last particle in the final row are padding
+    const size_t numTexels = static_cast<size_t>(stateTexWidth) * stateTexHeight;
+    std::vector<float> rgbaData;
+    cpuSolver.packPositions(rgbaData, numTexels);
+    positionTiling.encodeTexels(rgbaData, config.numParticles);
+    glBindTexture(GL_TEXTURE_2D, positionTex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), GL_RGBA, GL_FLOAT, rgbaData.data());
+    cpuSolver.packVelocities(rgbaData, numTexels);
+    glBindTexture(GL_TEXTURE_2D, velocityTex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), GL_RGBA, GL_FLOAT, rgbaData.data());
+    cpuSolver.packBounceData(rgbaData, numTexels);
+    glBindTexture(GL_TEXTURE_2D, bounceDataTex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), GL_RGBA, GL_FLOAT, rgbaData.data());
+}
+
+void ParticlesSimulator::copyTexturesToBuffers() {
+    // Textures rendered to LAST hold the latest state; read them straight into the matching buffers through the pixel pack target
+    const ParticleStateBuffers& buffers = renderToPing ? stateBuffersPong : stateBuffersPing;
+    std::array<GLuint, 3UL> sampleTexs  = { renderToPing ? positionTexPong : positionTexPing,
+                                            renderToPing ? velocityTexPong : velocityTexPing,
+                                            renderToPing ? bouncesTexPong : bouncesTexPing };
+    std::array<GLuint, 3UL> allBuffers  = { buffers.positionBuffer, buffers.velocityBuffer, buffers.bounceDataBuffer };
+    for (size_t texIdx = 0UL; texIdx < sampleTexs.size(); texIdx++) {
+        glBindTexture(GL_TEXTURE_2D, sampleTexs[texIdx]);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, allBuffers[texIdx]);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void ParticlesSimulator::copyBuffersToTextures() {
+    // Buffers captured to LAST hold the latest state; upload them straight into the matching textures through the pixel unpack target
+    const ParticleStateBuffers& buffers = renderToPing ? stateBuffersPong : stateBuffersPing;
+    std::array<GLuint, 3UL> sampleTexs  = { renderToPing ? positionTexPong : positionTexPing,
+                                            renderToPing ? velocityTexPong : velocityTexPing,
+                                            renderToPing ? bouncesTexPong : bouncesTexPing };
+    std::array<GLuint, 3UL> allBuffers  = { buffers.positionBuffer, buffers.velocityBuffer, buffers.bounceDataBuffer };
+    for (size_t texIdx = 0UL; texIdx < sampleTexs.size(); texIdx++) {
+        glBindTexture(GL_TEXTURE_2D, sampleTexs[texIdx]);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, allBuffers[texIdx]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, static_cast<GLsizei>(stateTexWidth), static_cast<GLsizei>(stateTexHeight), GL_RGBA, GL_FLOAT, nullptr);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
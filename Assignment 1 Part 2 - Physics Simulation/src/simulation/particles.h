@@ -4,44 +4,184 @@
 DISABLE_WARNINGS_PUSH()
 #include <framework/opengl_includes.h>
 #include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
 #include <framework/shader.h>
 
 #include <render/mesh.h>
+#include <render/particle_culling.h>
+#include <render/particle_lods.h>
+#include <render/particle_trails.h>
+#include <simulation/collision_events.h>
+#include <simulation/container_sdf.h>
+#include <simulation/cpu_particles.h>
+#include <simulation/particle_statistics.h>
+#include <simulation/position_tiling.h>
+#include <simulation/snapshot.h>
+#include <simulation/uniform_grid.h>
 #include <utils/config.h>
 
+#include <array>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <optional>
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 
+// One side of the ping-pong particle state of the transform-feedback backend
+struct ParticleStateBuffers {
+    GLuint transformFeedback;                                   // Captures the simulation outputs into the buffers below
+    GLuint positionBuffer, velocityBuffer, bounceDataBuffer;    // One vec4 per particle, laid out like the texels of the state textures
+    GLuint positionTex, velocityTex, bounceDataTex;             // Buffer textures for random access to the buffers above
+};
+
+// CPU mirror of the std140 SimulationParameters uniform block shared by the simulation and draw shaders
+struct SimulationParameters {
+    glm::vec3 containerCenter;
+    float containerRadius;
+    float timestep;
+    uint32_t numParticles;
+    int32_t interParticleCollision; // GLSL bool, 4 bytes in std140
+    int32_t bounceThreshold;
+    int32_t bounceFrames;
+    float padding[3];               // std140 rounds the block size up to a multiple of 16 bytes
+};
+static_assert(sizeof(SimulationParameters) == 48UL, "SimulationParameters must match the std140 layout of the uniform block");
+
+// Particle state on its way from the GPU to a snapshot file
+struct PendingSnapshot {
+    std::filesystem::path filePath;
+    Snapshot snapshot;              // Species and step are filled in right away, the rest once the readback completes
+    size_t numTexels;
+    PositionTiling positionTiling;  // Tiles the read back positions are relative to
+    GLuint packBuffer = 0;          // Position, velocity and bounce data texels of the state, one block after the other (0 if the snapshot is already complete)
+    GLsync fence = nullptr;         // Signaled once the GPU has filled packBuffer
+};
+
 class ParticlesSimulator {
 public:
     ParticlesSimulator(Config& config);
     ~ParticlesSimulator();
 
-    void render(const glm::mat4& viewProjection);
+    // Advance the simulation by the steps scheduled for a frame that took frameTime seconds, then draw the particles
+    void render(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float frameTime);
+    // The two halves of render, for callers that time them separately
+    void update(float frameTime);
+    void draw(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+    // Advance the simulation by numSteps fixed timesteps without drawing, e.g. for headless batch runs
+    void step(uint32_t numSteps);
     void resetSimulation();
 
+    // Read back the latest particle state, waiting for the GPU to finish all pending steps
+    ParticleStateSoA readState();
+
+    // Write the latest particle state to a snapshot file. The state is read back without stalling and written by a worker
+    // thread, so the file appears a few steps later; write errors are reported on std::cerr
+    void saveState(const std::filesystem::path& filePath);
+    // Continue from a snapshot file, adopting its particle count and step number
+    // Throws a SnapshotException, leaving the simulation unchanged, if the file cannot be loaded
+    void loadState(const std::filesystem::path& filePath);
+
+    // Aggregate metrics of the recent frames, recorded when enabled in the config
+    const ParticleStatistics& statistics() const;
+    // Collision event log, recorded when enabled in the config
+    const CollisionEventRecorder& collisionEvents() const;
+
 private:
     // Shared state
     Config& config;
 
     // Internal variables
     bool renderToPing = true;                                                   // Indicates which framebuffer the simulation step will render to
+    float stepAccumulator = 0.0f;                                               // Elapsed time not yet simulated with real-time stepping
+    uint64_t simulatedSteps = 0UL;                                              // Steps since the initial state, stored in snapshots
+    uint32_t stateTexWidth, stateTexHeight;                                     // Dimensions of the state textures, particle i is stored at texel (i % width, i / width)
+    PositionTiling positionTiling;                                              // Tiles the stored positions are relative to, fixed while the state textures exist
     GLuint simulationFramebufferPing, simulationFramebufferPong;                // Framebuffers rendered to in our mock compute shader
     GLuint positionTexPing, velocityTexPing, positionTexPong, velocityTexPong;  // Textures storing per-particle position and velocity data
-    GLuint bouncesTexPing, bouncesTexPong;                                      // Textures storing per-particle collision counting data (R channel is number of bounces, G channel is number of frames left for the bounce color to be active)
-    Shader initialDataPass, drawPass, simulationPass;
+    GLuint bouncesTexPing, bouncesTexPong;                                      // Textures storing per-particle collision counting data (R channel is number of bounces, G channel is number of frames left for the bounce color to be active, B channel is number of consecutive steps at rest for sleeping, A channel is number of collisions in the latest step)
+    ParticleStateBuffers stateBuffersPing, stateBuffersPong;                    // Buffers storing the same data as the textures above, for the transform-feedback backend
+    std::array<GLuint, 2UL> predictedFramebuffers, predictedTexs;               // Ping-pong positions of the Jacobi iterations of the position-based solver (A channel is the number of violated constraints)
+    GLuint wakeFramebuffer, wakeTex;                                            // Sleeping particles woken by a moving neighbour in the current step (R channel)
+    GLuint activeListBuffer, activeListTransformFeedback, activeListVAO;        // Indices of the particles simulated in the current step, captured by transform feedback
+    GLuint emptyVAO;                                                            // Attribute-less VAO used to run one transform-feedback vertex per particle
+    GLuint particlePropertiesBuffer, particlePropertiesTex;                     // Per-particle radius, mass and species (RGBA), read by every pass through the buffer texture
+    float uploadedParticleRadius;                                               // Radius and species the properties were last uploaded for, to detect config changes
+    std::vector<ParticleSpecies> uploadedSpecies;
+    bool particlePropertiesUploaded = false;
+    std::optional<ContainerSdf> containerSdf;                                   // Signed distance field of the mesh container, if it could be baked
+    std::string bakedContainerMeshFile;                                         // Mesh file and resolution of the last bake (successful or not), so the field is only baked again when they change
+    int bakedContainerSdfResolution = 0;
+    GLuint containerSdfTex = 0;                                                 // 3D texture holding containerSdf (R channel)
+    Shader drawPass, drawBuffersPass, drawImpostorPass, drawLodPass, simulationPass, transformFeedbackPass;
+    Shader pbdPredictPass, pbdProjectPass, pbdFinalizePass, sleepWakePass, sleepCompactPass, collisionEventsPass;
+    GLuint simulationParametersUBO;                                             // Uniform buffer backing the SimulationParameters block of the shaders above
+    SimulationParameters uploadedParameters;                                    // Contents of simulationParametersUBO, to detect config changes
+    bool simulationParametersUploaded = false;
+    GLuint positionTilingUBO;                                                   // Uniform buffer backing the PositionTiling block of every shader reading the state
     GPUMesh particleModel;
+    ParticleCulling particleCulling;
+    ParticleLods particleLods;
+    ParticleTrails particleTrails;
+    UniformGrid grid;
+    ParticleStatistics particleStatistics;
+    CollisionEventRecorder collisionEventRecorder;
+    CpuParticleSolver cpuSolver;
+    bool cpuStateIsCurrent = false;                                             // Indicates whether the CPU solver holds the latest state (otherwise the textures do)
+    bool buffersHoldLatestState = false;                                        // Indicates whether the state buffers hold the latest state (otherwise the textures do)
+    std::deque<PendingSnapshot> pendingSnapshots;                               // Readbacks in flight, oldest first
+    std::future<void> snapshotWrite;                                            // Snapshot file being written; one at a time, so they land in order
+    std::chrono::steady_clock::time_point lastAutosave;
 
     // Framebuffer and texture management
     void initFramebuffersAndTextures();
     void setInitialData();
+    void initState(ParticleStateSoA state);
     void deleteFramebuffersAndTextures();
+    void initStateBuffers();
+    void deleteStateBuffers();
 
     // Misc setup
     void initShaders();
+    void initUniformBuffers();
+    void updateSimulationParameters();
+    void updateParticleProperties();
+    void updateContainerSdf();
+    const ContainerSdf* activeContainerSdf() const;
 
     // Main loop
-    void draw(const glm::mat4& viewProjection);
-    void simulate();
+    uint32_t scheduleSteps(float frameTime);
+    void simulate(uint32_t numSteps);
+    void simulateOnCpu(uint32_t numSteps);
+    void simulateWithTransformFeedback(uint32_t numSteps);
+    void simulatePositionBased(uint32_t numSteps);
+    void updateActiveList(GLuint positionTex, GLuint velocityTex, GLuint bounceDataTex);
+    void copySleepingState(GLuint sampleFramebuffer, GLuint drawFramebuffer, GLuint samplePositionTex);
+    void drawSimulatedParticles(const Shader& pass, bool useActiveList) const;
+    void bindSimulationUniforms(const Shader& pass, bool useUniformGrid) const;
+    void bindContainerUniforms(const Shader& pass) const;
+
+    // Collision events of the impulse solver steps of a frame, captured from the same inputs as each step
+    void beginCollisionEvents(bool useUniformGrid, bool stateInBuffers);
+    void captureCollisionEvents(GLuint positionTex, GLuint velocityTex, GLenum target, uint64_t step);
+
+    // CPU backend state transfer
+    void downloadStateToCpu();
+    void uploadStateFromCpu(GLuint positionTex, GLuint velocityTex, GLuint bounceDataTex);
+
+    // Transform-feedback backend state transfer (GPU-side copies of the latest state)
+    void copyTexturesToBuffers();
+    void copyBuffersToTextures();
+
+    // Statistics and trails of the latest state
+    void recordStatistics();
+    void recordTrails();
+
+    // Snapshots: completes the readbacks the GPU has finished (or all of them, when waiting) and hands them to the writer
+    void pollSnapshots(bool wait);
+    void autosave();
 };
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <utils/config.h>
+#include <utils/constants.h>
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+
+// Tiles the positions in the state textures and buffers are stored relative to with StatePrecision::TileRelative. A stored
+// position is the offset from the center of its tile, with the tile ID in the A channel, so a half float only has to resolve
+// offsets within a tile rather than coordinates across the whole container. Every other precision stores world-space positions
+// CPU mirror of the std140 PositionTiling uniform block (mirrors encodePosition() and decodePosition() in particle-position.glsl)
+struct PositionTiling {
+    glm::vec3 origin;               // Corner of the first tile
+    float tileSize;
+    int32_t tilesPerAxis;           // 0 when positions are stored as world-space coordinates
+    float padding[3];               // std140 rounds the block size up to a multiple of 16 bytes
+
+    // Tile IDs are stored shifted to be centered around zero, as half floats hold integers up to 2048 exactly
+    static constexpr int32_t TILE_ID_OFFSET = 2048;
+
+    bool enabled() const { return tilesPerAxis > 0; }
+
+    // Stored RGBA texel of a world-space position; positions outside the tiles are stored relative to the nearest one
+    glm::vec4 encode(const glm::vec3& position) const {
+        if (!enabled()) { return glm::vec4(position, 1.0f); }
+        const glm::ivec3 tile   = glm::clamp(glm::ivec3(glm::floor((position - origin) / tileSize)), glm::ivec3(0), glm::ivec3(tilesPerAxis - 1));
+        const int32_t tileId    = tile.x + tilesPerAxis * (tile.y + tilesPerAxis * tile.z);
+        return glm::vec4(position - tileCenter(tile), static_cast<float>(tileId - TILE_ID_OFFSET));
+    }
+    glm::vec3 decode(const glm::vec4& texel) const {
+        if (!enabled()) { return glm::vec3(texel); }
+        const int32_t tileId = static_cast<int32_t>(texel.w) + TILE_ID_OFFSET;
+        return tileCenter(glm::ivec3(tileId % tilesPerAxis, (tileId / tilesPerAxis) % tilesPerAxis, tileId / (tilesPerAxis * tilesPerAxis))) + glm::vec3(texel);
+    }
+
+    // Encode the first numPositions RGBA texels of world-space positions in place
+    void encodeTexels(std::vector<float>& rgbaData, size_t numPositions) const {
+        if (!enabled()) { return; }
+        for (size_t idx = 0UL; idx < numPositions; idx++) {
+            const glm::vec4 texel = encode(glm::vec3(rgbaData[4UL * idx], rgbaData[4UL * idx + 1], rgbaData[4UL * idx + 2]));
+            std::copy_n(&texel.x, 4UL, &rgbaData[4UL * idx]);
+        }
+    }
+
+private:
+    glm::vec3 tileCenter(const glm::ivec3& tile) const { return origin + (glm::vec3(tile) + 0.5f) * tileSize; }
+};
+static_assert(sizeof(PositionTiling) == 32UL, "PositionTiling must match the std140 layout of the uniform block");
+
+// Tiles spanning the bounding cube of the container. The stored positions depend on them, so they are only computed when the
+// state textures are created, and stay fixed while the container is edited
+inline PositionTiling computePositionTiling(const Config& config) {
+    PositionTiling tiling {};
+    if (config.statePrecision != StatePrecision::TileRelative) { return tiling; }
+    tiling.tilesPerAxis = utils::POSITION_TILES_PER_AXIS;
+    tiling.tileSize     = std::max(2.0f * config.sphereRadius / static_cast<float>(utils::POSITION_TILES_PER_AXIS), 1e-4f);
+    tiling.origin       = config.sphereCenter - 0.5f * tiling.tileSize * static_cast<float>(utils::POSITION_TILES_PER_AXIS);
+    return tiling;
+}
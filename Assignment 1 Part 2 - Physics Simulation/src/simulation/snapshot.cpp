@@ -0,0 +1,81 @@
+#include "snapshot.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <fmt/format.h>
+DISABLE_WARNINGS_POP()
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+
+template <typename T>
+static void writeArray(std::ofstream& file, const std::vector<T>& values) {
+    file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+template <typename T>
+static void readArray(std::ifstream& file, std::vector<T>& values) {
+    file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+void writeSnapshot(const std::filesystem::path& filePath, const Snapshot& snapshot) {
+    const std::filesystem::path tempPath = std::filesystem::path(filePath).concat(".tmp");
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) { throw SnapshotException(fmt::format("Could not open {} for writing", tempPath.string())); }
+
+        SnapshotHeader header;
+        std::memcpy(header.magic.data(), "PSIMSNAP", header.magic.size());
+        header.version      = SNAPSHOT_VERSION;
+        header.numParticles = static_cast<uint32_t>(snapshot.state.size());
+        header.step         = snapshot.step;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        const ParticleStateSoA& state = snapshot.state;
+        for (const std::vector<float>* component : { &state.posX, &state.posY, &state.posZ, &state.velX, &state.velY, &state.velZ }) { writeArray(file, *component); }
+        for (const std::vector<int32_t>* counters : { &state.collisionCounts, &state.frameCounters, &state.sleepCounters }) { writeArray(file, *counters); }
+        writeArray(file, state.species);
+        if (!file.flush()) { throw SnapshotException(fmt::format("Failed to write {}", tempPath.string())); }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, filePath, error);
+    if (error) { throw SnapshotException(fmt::format("Could not replace {}: {}", filePath.string(), error.message())); }
+}
+
+Snapshot readSnapshot(const std::filesystem::path& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) { throw SnapshotException(fmt::format("Could not open {} for reading", filePath.string())); }
+
+    SnapshotHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic.data(), "PSIMSNAP", header.magic.size()) != 0) {
+        throw SnapshotException(fmt::format("{} is not a snapshot", filePath.string()));
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw SnapshotException(fmt::format("Unsupported snapshot version {} in {}", header.version, filePath.string()));
+    }
+    if (header.numParticles == 0U) { throw SnapshotException(fmt::format("{} holds no particles", filePath.string())); }
+
+    // Check the particle count against the file size before allocating, so a corrupt header cannot request gigabytes
+    constexpr uintmax_t bytesPerParticle = 6U * sizeof(float) + 3U * sizeof(int32_t) + sizeof(uint32_t);
+    std::error_code error;
+    const uintmax_t fileSize = std::filesystem::file_size(filePath, error);
+    if (error || fileSize != sizeof(header) + header.numParticles * bytesPerParticle) {
+        throw SnapshotException(fmt::format("{} is truncated", filePath.string()));
+    }
+
+    Snapshot snapshot;
+    snapshot.step = header.step;
+    ParticleStateSoA& state = snapshot.state;
+    state.resize(header.numParticles);
+    for (std::vector<float>* component : { &state.posX, &state.posY, &state.posZ, &state.velX, &state.velY, &state.velZ }) { readArray(file, *component); }
+    for (std::vector<int32_t>* counters : { &state.collisionCounts, &state.frameCounters, &state.sleepCounters }) { readArray(file, *counters); }
+    readArray(file, state.species);
+    if (!file) { throw SnapshotException(fmt::format("{} is truncated", filePath.string())); }
+    return snapshot;
+}
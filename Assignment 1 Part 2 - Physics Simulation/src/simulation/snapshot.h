@@ -0,0 +1,41 @@
+#pragma once
+
+#include <simulation/cpu_particles.h>
+
+#include <array>
+#include <filesystem>
+#include <stdexcept>
+#include <stdint.h>
+
+
+struct SnapshotException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Header at the start of a snapshot file. All values are stored in native byte order
+struct SnapshotHeader {
+    std::array<char, 8UL> magic;    // "PSIMSNAP"
+    uint32_t version;
+    uint32_t numParticles;
+    uint64_t step;                  // Number of steps simulated since the initial state
+};
+static_assert(sizeof(SnapshotHeader) == 24UL, "SnapshotHeader must not contain implicit padding");
+
+// Complete particle state of a simulation, from which it continues exactly as if it had never stopped (given the same config)
+struct Snapshot {
+    uint64_t step;
+    ParticleStateSoA state;
+};
+
+// The header is followed by one array of numParticles values per component of ParticleStateSoA, in declaration order:
+//   float posX[], posY[], posZ[], velX[], velY[], velZ[];
+//   int32_t collisionCounts[], frameCounters[], sleepCounters[];
+//   uint32_t species[];
+// Unlike state dumps, which stream positions and velocities for analysis, snapshots hold everything needed to resume
+constexpr uint32_t SNAPSHOT_VERSION = 1U;
+
+// Writes to a temporary file next to the given one first and then replaces it, so a crash mid-write never destroys the previous snapshot
+// Throws a SnapshotException if the file cannot be written
+void writeSnapshot(const std::filesystem::path& filePath, const Snapshot& snapshot);
+// Throws a SnapshotException if the file cannot be read, is not a snapshot, or has an unsupported version
+Snapshot readSnapshot(const std::filesystem::path& filePath);
@@ -0,0 +1,102 @@
+#include "state_dump.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <fmt/format.h>
+DISABLE_WARNINGS_POP()
+
+#include <cstring>
+
+
+StateDumpWriter::StateDumpWriter(const std::filesystem::path& filePath, uint32_t numParticles, float timestep, uint32_t stepsPerFrame, uint32_t ringCapacity)
+    : file(filePath, std::ios::binary | std::ios::trunc) {
+    if (!file) { throw StateDumpException(fmt::format("Could not open {} for writing", filePath.string())); }
+
+    std::memcpy(header.magic.data(), "PSIMDUMP", header.magic.size());
+    header.version          = VERSION;
+    header.numParticles     = numParticles;
+    header.timestep         = timestep;
+    header.stepsPerFrame    = stepsPerFrame;
+    header.ringCapacity     = ringCapacity;
+    header.padding          = 0U;
+    header.numFramesWritten = 0UL;
+    writeHeader();
+
+    frameData.resize(6UL * numParticles);
+}
+
+size_t StateDumpWriter::frameSize(uint32_t numParticles) {
+    return sizeof(uint64_t) + 6UL * numParticles * sizeof(float);
+}
+
+void StateDumpWriter::writeFrame(uint64_t step, const ParticleStateSoA& state) {
+    if (state.size() != header.numParticles) {
+        throw StateDumpException(fmt::format("Expected {} particles in frame, got {}", header.numParticles, state.size()));
+    }
+
+    // Positions of all particles first, then velocities, as xyz triples
+    const size_t numParticles = header.numParticles;
+    for (size_t idx = 0UL; idx < numParticles; idx++) {
+        frameData[3UL * idx]                        = state.posX[idx];
+        frameData[3UL * idx + 1]                    = state.posY[idx];
+        frameData[3UL * idx + 2]                    = state.posZ[idx];
+        frameData[3UL * (numParticles + idx)]       = state.velX[idx];
+        frameData[3UL * (numParticles + idx) + 1]   = state.velY[idx];
+        frameData[3UL * (numParticles + idx) + 2]   = state.velZ[idx];
+    }
+
+    const uint64_t slot = header.ringCapacity > 0U ? header.numFramesWritten % header.ringCapacity : header.numFramesWritten;
+    file.seekp(static_cast<std::streamoff>(sizeof(StateDumpHeader) + slot * frameSize(header.numParticles)));
+    file.write(reinterpret_cast<const char*>(&step), sizeof(step));
+    file.write(reinterpret_cast<const char*>(frameData.data()), static_cast<std::streamsize>(frameData.size() * sizeof(float)));
+
+    // Keep the frame count in the header up to date, so the file stays readable if the run is aborted
+    header.numFramesWritten++;
+    writeHeader();
+    if (!file) { throw StateDumpException("Failed to write state dump frame"); }
+}
+
+void StateDumpWriter::writeHeader() {
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.flush();
+}
+
+ParticleStateSoA readLatestStateDumpFrame(const std::filesystem::path& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) { throw StateDumpException(fmt::format("Could not open {} for reading", filePath.string())); }
+
+    StateDumpHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic.data(), "PSIMDUMP", header.magic.size()) != 0) {
+        throw StateDumpException(fmt::format("{} is not a state dump", filePath.string()));
+    }
+    if (header.version != StateDumpWriter::VERSION) {
+        throw StateDumpException(fmt::format("Unsupported state dump version {} in {}", header.version, filePath.string()));
+    }
+    if (header.numFramesWritten == 0UL || header.numParticles == 0U) { throw StateDumpException(fmt::format("{} holds no particles", filePath.string())); }
+
+    const uint64_t lastFrame    = header.numFramesWritten - 1UL;
+    const uint64_t slot         = header.ringCapacity > 0U ? lastFrame % header.ringCapacity : lastFrame;
+    std::vector<float> frameData(6UL * header.numParticles);
+    file.seekg(static_cast<std::streamoff>(sizeof(StateDumpHeader) + slot * StateDumpWriter::frameSize(header.numParticles) + sizeof(uint64_t)));
+    file.read(reinterpret_cast<char*>(frameData.data()), static_cast<std::streamsize>(frameData.size() * sizeof(float)));
+    if (!file) { throw StateDumpException(fmt::format("{} is truncated", filePath.string())); }
+
+    const size_t numParticles = header.numParticles;
+    ParticleStateSoA state;
+    state.resize(numParticles);
+    for (size_t idx = 0UL; idx < numParticles; idx++) {
+        state.posX[idx]             = frameData[3UL * idx];
+        state.posY[idx]             = frameData[3UL * idx + 1];
+        state.posZ[idx]             = frameData[3UL * idx + 2];
+        state.velX[idx]             = frameData[3UL * (numParticles + idx)];
+        state.velY[idx]             = frameData[3UL * (numParticles + idx) + 1];
+        state.velZ[idx]             = frameData[3UL * (numParticles + idx) + 2];
+        state.collisionCounts[idx]  = 0;
+        state.frameCounters[idx]    = 0;
+        state.sleepCounters[idx]    = 0;
+        state.stepCollisions[idx]   = 0;
+    }
+    return state;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <simulation/cpu_particles.h>
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <vector>
+
+
+struct StateDumpException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Header at the start of a state dump file. All values are stored in native byte order
+struct StateDumpHeader {
+    std::array<char, 8UL> magic;    // "PSIMDUMP"
+    uint32_t version;
+    uint32_t numParticles;
+    float timestep;                 // Simulated time per step
+    uint32_t stepsPerFrame;         // Number of simulation steps between consecutive frames
+    uint32_t ringCapacity;          // Number of frame slots in the file, or 0 if frames are appended indefinitely
+    uint32_t padding;
+    uint64_t numFramesWritten;      // Total number of frames written, updated after every frame
+};
+static_assert(sizeof(StateDumpHeader) == 40UL, "StateDumpHeader must not contain implicit padding");
+
+// Streams particle positions and velocities to a compact binary file during batch runs
+// Every frame has the same size, so the file can be memory-mapped as the header followed by an array of frames:
+//   uint64_t step;                       Index of the step after which the frame was taken
+//   float positions[numParticles][3];
+//   float velocities[numParticles][3];
+// With a ring capacity, frame i overwrites slot (i % ringCapacity), bounding the file size of long runs
+class StateDumpWriter {
+public:
+    static constexpr uint32_t VERSION = 1U;
+
+    StateDumpWriter(const std::filesystem::path& filePath, uint32_t numParticles, float timestep, uint32_t stepsPerFrame, uint32_t ringCapacity = 0U);
+
+    void writeFrame(uint64_t step, const ParticleStateSoA& state);
+
+    static size_t frameSize(uint32_t numParticles);
+
+private:
+    std::ofstream file;
+    StateDumpHeader header;
+    std::vector<float> frameData;   // Staging buffer for the interleaved xyz positions and velocities of a frame
+
+    void writeHeader();
+};
+
+// Reads the most recently written frame of a state dump, e.g. to continue from the end of a batch run
+// Bounce counters are not stored in the dump and start at zero
+ParticleStateSoA readLatestStateDumpFrame(const std::filesystem::path& filePath);
@@ -0,0 +1,200 @@
+#include "uniform_grid.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/type_ptr.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <utils/constants.h>
+#include <utils/render_utils.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <iostream>
+
+
+UniformGrid::UniformGrid(const Config& config)
+    : config(config) {
+    updateLayout();
+    initShaders();
+    initFramebuffersAndTextures();
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+UniformGrid::~UniformGrid() {
+    deleteFramebuffersAndTextures();
+    glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void UniformGrid::updateLayout() {
+    layout = computeGridLayout(config);
+}
+
+void UniformGrid::build(GLuint positionTex, GLenum positionTexTarget, bool worldSpacePositions) {
+    assignCells(positionTex, positionTexTarget, worldSpacePositions);
+    sortByCell();
+    findCellRanges();
+}
+
+void UniformGrid::bindQueryUniforms(const Shader& shader, GLint firstTextureUnit) const {
+    glUniform1i(shader.getUniformLocation("sortedParticles"), firstTextureUnit);
+    glUniform1i(shader.getUniformLocation("cellRanges"), firstTextureUnit + 1);
+    glUniform3fv(shader.getUniformLocation("gridOrigin"), 1, glm::value_ptr(layout.origin));
+    glUniform1f(shader.getUniformLocation("gridCellSize"), layout.cellSize);
+    glUniform3iv(shader.getUniformLocation("gridResolution"), 1, glm::value_ptr(layout.resolution));
+}
+
+void UniformGrid::bindQueryTextures(GLint firstTextureUnit) const {
+    glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(firstTextureUnit));
+    glBindTexture(GL_TEXTURE_2D, sortTexs[currentSortTex]);
+    glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(firstTextureUnit) + 1U);
+    glBindTexture(GL_TEXTURE_2D, cellRangesTex);
+}
+
+void UniformGrid::reset() {
+    deleteFramebuffersAndTextures();
+    initFramebuffersAndTextures();
+}
+
+void UniformGrid::initFramebuffersAndTextures() {
+    // Sort textures hold the particle count padded to the next power of two, laid out in rows of at most SORT_TEX_MAX_WIDTH keys
+    numSortEntries  = std::bit_ceil(std::max(config.numParticles, 1U));
+    sortTexWidth    = std::min(numSortEntries, utils::SORT_TEX_MAX_WIDTH);
+    sortTexHeight   = numSortEntries / sortTexWidth;
+
+    // Create sort textures and their framebuffers
+    glGenFramebuffers(2, sortFramebuffers.data());
+    glGenTextures(2, sortTexs.data());
+    for (size_t idx = 0UL; idx < sortTexs.size(); idx++) {
+        glBindTexture(GL_TEXTURE_2D, sortTexs[idx]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, static_cast<GLsizei>(sortTexWidth), static_cast<GLsizei>(sortTexHeight), 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sortFramebuffers[idx]);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sortTexs[idx], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise grid sort framebuffer" << std::endl; }
+    }
+
+    // Create cell range table, large enough for the finest possible grid
+    glGenFramebuffers(1, &cellRangesFramebuffer);
+    glGenTextures(1, &cellRangesTex);
+    glBindTexture(GL_TEXTURE_2D, cellRangesTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, utils::CELL_TABLE_WIDTH, utils::CELL_TABLE_WIDTH, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindFramebuffer(GL_FRAMEBUFFER, cellRangesFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, cellRangesTex, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "Failed to initialise grid cell range framebuffer" << std::endl; }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    currentSortTex = 0U;
+}
+
+void UniformGrid::deleteFramebuffersAndTextures() {
+    glDeleteFramebuffers(2, sortFramebuffers.data());
+    glDeleteTextures(2, sortTexs.data());
+    glDeleteFramebuffers(1, &cellRangesFramebuffer);
+    glDeleteTextures(1, &cellRangesTex);
+}
+
+void UniformGrid::initShaders() {
+    // Cell assignment shader
+    try {
+        ShaderBuilder assignCellsBuilder;
+        assignCellsBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "screen-quad.vert");
+        assignCellsBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "grid-assign-cells.frag");
+        assignCellsBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "particle-position.glsl");
+        assignCellsPass = assignCellsBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Bitonic sort step shader
+    try {
+        ShaderBuilder bitonicSortBuilder;
+        bitonicSortBuilder.addStage(GL_VERTEX_SHADER,   utils::SHADERS_DIR_PATH / "simulation" / "screen-quad.vert");
+        bitonicSortBuilder.addStage(GL_FRAGMENT_SHADER, utils::SHADERS_DIR_PATH / "simulation" / "grid-bitonic-sort.frag");
+        bitonicSortPass = bitonicSortBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // Cell range scatter shader
+    try {
+        ShaderBuilder cellRangesBuilder;
+        cellRangesBuilder.addStage(GL_VERTEX_SHADER,    utils::SHADERS_DIR_PATH / "simulation" / "grid-cell-ranges.vert");
+        cellRangesBuilder.addStage(GL_FRAGMENT_SHADER,  utils::SHADERS_DIR_PATH / "simulation" / "grid-cell-ranges.frag");
+        cellRangesPass = cellRangesBuilder.build();
+    } catch (const ShaderLoadingException& e) { std::cerr << e.what() << std::endl; }
+
+    // The buffer of the stored position representation is bound by ParticlesSimulator
+    assignCellsPass.setUniformBlockBinding("PositionTiling", utils::POSITION_TILING_BINDING);
+}
+
+void UniformGrid::assignCells(GLuint positionTex, GLenum positionTexTarget, bool worldSpacePositions) {
+    glBindFramebuffer(GL_FRAMEBUFFER, sortFramebuffers[0]);
+    glViewport(0, 0, static_cast<GLsizei>(sortTexWidth), static_cast<GLsizei>(sortTexHeight));
+    assignCellsPass.bind();
+
+    // Both position samplers need their own unit, since samplers of different types may not share one
+    const bool positionsInBuffer = positionTexTarget == GL_TEXTURE_BUFFER;
+    glActiveTexture(positionsInBuffer ? GL_TEXTURE0 + 1 : GL_TEXTURE0);
+    glBindTexture(positionTexTarget, positionTex);
+    glUniform1i(assignCellsPass.getUniformLocation("positions"), 0);
+    glUniform1i(assignCellsPass.getUniformLocation("positionBuffer"), 1);
+    glUniform1i(assignCellsPass.getUniformLocation("positionsInBuffer"), positionsInBuffer);
+    glUniform1i(assignCellsPass.getUniformLocation("worldSpacePositions"), worldSpacePositions);
+    glUniform1ui(assignCellsPass.getUniformLocation("numParticles"), config.numParticles);
+    glUniform1ui(assignCellsPass.getUniformLocation("sortTexWidth"), sortTexWidth);
+    glUniform3fv(assignCellsPass.getUniformLocation("gridOrigin"), 1, glm::value_ptr(layout.origin));
+    glUniform1f(assignCellsPass.getUniformLocation("gridCellSize"), layout.cellSize);
+    glUniform3iv(assignCellsPass.getUniformLocation("gridResolution"), 1, glm::value_ptr(layout.resolution));
+
+    utils::renderQuad(assignCellsPass);
+    currentSortTex = 0U;
+}
+
+void UniformGrid::sortByCell() {
+    glViewport(0, 0, static_cast<GLsizei>(sortTexWidth), static_cast<GLsizei>(sortTexHeight));
+    bitonicSortPass.bind();
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(bitonicSortPass.getUniformLocation("keys"), 0);
+
+    // Each (stage, pass) pair compares-and-swaps keys that are passDistance apart, ping-ponging between the sort textures
+    for (uint32_t stageWidth = 2U; stageWidth <= numSortEntries; stageWidth <<= 1U) {
+        for (uint32_t passDistance = stageWidth >> 1U; passDistance > 0U; passDistance >>= 1U) {
+            glBindFramebuffer(GL_FRAMEBUFFER, sortFramebuffers[1U - currentSortTex]);
+            glBindTexture(GL_TEXTURE_2D, sortTexs[currentSortTex]);
+            glUniform1ui(bitonicSortPass.getUniformLocation("stageWidth"), stageWidth);
+            glUniform1ui(bitonicSortPass.getUniformLocation("passDistance"), passDistance);
+            utils::renderQuad(bitonicSortPass);
+            currentSortTex = 1U - currentSortTex;
+        }
+    }
+}
+
+void UniformGrid::findCellRanges() {
+    // Empty cells keep the range [0, 0)
+    constexpr std::array<GLuint, 4UL> clearValue = { 0U, 0U, 0U, 0U };
+    glBindFramebuffer(GL_FRAMEBUFFER, cellRangesFramebuffer);
+    glViewport(0, 0, utils::CELL_TABLE_WIDTH, utils::CELL_TABLE_WIDTH);
+    glClearBufferuiv(GL_COLOR, 0, clearValue.data());
+
+    cellRangesPass.bind();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sortTexs[currentSortTex]);
+    glUniform1i(cellRangesPass.getUniformLocation("sortedParticles"), 0);
+    glUniform1ui(cellRangesPass.getUniformLocation("numParticles"), config.numParticles);
+    glUniform1ui(cellRangesPass.getUniformLocation("cellTableWidth"), utils::CELL_TABLE_WIDTH);
+
+    // Scatter one point per sorted key; only the first (R channel) or last (G channel) key of each cell survives
+    glBindVertexArray(emptyVAO);
+    glColorMask(GL_TRUE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glUniform1i(cellRangesPass.getUniformLocation("writeCellEnd"), GL_FALSE);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
+    glColorMask(GL_FALSE, GL_TRUE, GL_FALSE, GL_FALSE);
+    glUniform1i(cellRangesPass.getUniformLocation("writeCellEnd"), GL_TRUE);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(config.numParticles));
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <framework/opengl_includes.h>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/shader.h>
+
+#include <simulation/grid_layout.h>
+#include <utils/config.h>
+
+#include <array>
+#include <stdint.h>
+
+
+// Uniform-grid broad phase for inter-particle collisions
+// Every step, particles are assigned to a cell of a uniform grid spanning the container, sorted by cell index with a bitonic sort,
+// and the [start, end) range of every cell in the sorted list is scattered into a cell table. The narrow phase then only
+// visits the particles in the 27 cells neighbouring its own
+class UniformGrid {
+public:
+    UniformGrid(const Config& config);
+    ~UniformGrid();
+
+    // Recompute the grid dimensions from the config; the layout then stays fixed for every build until the next update
+    void updateLayout();
+    // Positions are read from a state texture (GL_TEXTURE_2D) or a buffer texture over a state buffer (GL_TEXTURE_BUFFER), in
+    // their stored representation unless worldSpacePositions is set (e.g. the predicted positions of the position-based solver)
+    void build(GLuint positionTex, GLenum positionTexTarget = GL_TEXTURE_2D, bool worldSpacePositions = false);
+    void reset();
+
+    // Uniforms only need to be set once per layout update, while the textures have to be bound again after every build
+    void bindQueryUniforms(const Shader& shader, GLint firstTextureUnit) const;
+    void bindQueryTextures(GLint firstTextureUnit) const;
+
+private:
+    // Shared state
+    const Config& config;
+
+    // Grid layout of the current step
+    GridLayout layout;
+
+    // Internal variables
+    uint32_t numSortEntries;                            // Particle count padded to a power of two, as required by the bitonic sort
+    uint32_t sortTexWidth, sortTexHeight;               // Dimensions of the sort textures (numSortEntries = sortTexWidth * sortTexHeight)
+    uint32_t currentSortTex = 0U;                       // Index of the sort texture holding the latest (partially) sorted keys
+    std::array<GLuint, 2UL> sortFramebuffers, sortTexs; // Ping-pong textures storing (cell index, particle index) keys
+    GLuint cellRangesFramebuffer, cellRangesTex;        // Table storing per-cell [start, end) ranges into the sorted keys (R channel is start, G channel is end)
+    GLuint emptyVAO;                                    // Attribute-less VAO used to scatter one point per sorted key
+    Shader assignCellsPass, bitonicSortPass, cellRangesPass;
+
+    // Framebuffer and texture management
+    void initFramebuffersAndTextures();
+    void deleteFramebuffersAndTextures();
+
+    // Misc setup
+    void initShaders();
+
+    // Build steps
+    void assignCells(GLuint positionTex, GLenum positionTexTarget, bool worldSpacePositions);
+    void sortByCell();
+    void findCellRanges();
+};
@@ -5,12 +5,21 @@ DISABLE_WARNINGS_PUSH()
 #include <imgui/imgui.h>
 #include <nativefiledialog/nfd.h>
 DISABLE_WARNINGS_POP()
+#include <utils/constants.h>
+#include <algorithm>
+#include <cstdlib>
 #include <filesystem>
 #include <iostream>
+#include <vector>
 
-Menu::Menu(Config& config)
+Menu::Menu(Config& config, const GpuProfiler& profiler, const ParticleStatistics& statistics, const CollisionEventRecorder& collisionEvents)
 : m_config(config)
+, m_profiler(profiler)
+, m_statistics(statistics)
+, m_collisionEvents(collisionEvents)
 , m_newParticleCount(config.numParticles)
+, m_newStatePrecision(config.statePrecision)
+, m_newSdfResolution(config.containerSdfResolution)
 {}
 
 void Menu::draw() {
@@ -21,9 +30,9 @@ void Menu::draw() {
     drawParticleSimControls();
     ImGui::Spacing();
 
-    ImGui::Text("Sphere Container");
+    ImGui::Text("Container");
     ImGui::Separator();
-    drawSphereContainerControls();
+    drawContainerControls();
     ImGui::Spacing();
 
     ImGui::Text("Particle Coloring");
@@ -34,17 +43,97 @@ void Menu::draw() {
     ImGui::Text("Bounce Coloring");
     ImGui::Separator();
     drawBounceControls();
+    ImGui::Spacing();
+
+    ImGui::Text("Statistics");
+    ImGui::Separator();
+    drawStatistics();
+    ImGui::Spacing();
+
+    ImGui::Text("Collision Events");
+    ImGui::Separator();
+    drawCollisionEvents();
+    ImGui::Spacing();
+
+    ImGui::Text("Frame Capture");
+    ImGui::Separator();
+    drawFrameCapture();
+    ImGui::Spacing();
+
+    ImGui::Text("Profiling");
+    ImGui::Separator();
+    drawProfilerStats();
 
     ImGui::End();
 }
 
 void Menu::drawParticleSimControls() {
+    constexpr int SUBSTEPS_MAX          = 32;
+    constexpr int PBD_ITERATIONS_MAX    = 32;
+    constexpr int SLEEP_STEPS_MAX       = 240;
+    constexpr size_t SPECIES_MAX                = 8UL;
+    constexpr float AUTOSAVE_INTERVAL_MAX       = 600.0f;
+    constexpr float SPECIES_RADIUS_SCALE_MIN    = 0.25f;
+    constexpr float SPECIES_RADIUS_SCALE_MAX    = 2.0f;
+    constexpr float SPECIES_MASS_MIN            = 0.1f;
+    constexpr float SPECIES_MASS_MAX            = 10.0f;
+
     // Parameters
     m_newParticleCount = std::max(1, m_newParticleCount); // Ensure that the new number of particles is always positive
     ImGui::InputInt("New particle count", &m_newParticleCount);
+    ImGui::Combo("New state precision", reinterpret_cast<int*>(&m_newStatePrecision), "Half (RGBA16F)\0Full (RGBA32F)\0Tile-relative half (RGBA16F)\0");
+    ImGui::Combo("Initial placement", reinterpret_cast<int*>(&m_config.initialDistribution), "Spiral (may overlap)\0Poisson-disk packed\0Lattice packed\0State dump file\0");
+    if (m_config.initialDistribution == InitialDistribution::File) {
+        if (ImGui::Button("Choose state dump")) {
+            nfdchar_t* outPath = nullptr;
+            if (NFD_OpenDialog(nullptr, nullptr, &outPath) == NFD_OKAY) {
+                m_config.initialStateFile = outPath;
+                std::free(outPath);
+            }
+        }
+        ImGui::SameLine();
+        ImGui::Text("%s", m_config.initialStateFile.empty() ? "(none)" : m_config.initialStateFile.c_str());
+    } else {
+        ImGui::InputScalar("Placement seed", ImGuiDataType_U32, &m_config.initialSeed);
+    }
     ImGui::SliderFloat("Timestep", &m_config.particleSimTimestep, 0.001f, 0.05f, "%.3f");
+    ImGui::SliderInt("Substeps per frame", &m_config.substepsPerFrame, 1, SUBSTEPS_MAX);
+    ImGui::Checkbox("Real-time stepping", &m_config.realTimeStepping);
     ImGui::SliderFloat("Particle radius", &m_config.particleRadius, 0.05f, 1.0f);
+    if (ImGui::TreeNode("Species")) {
+        // Radii and masses apply right away; particles are only assigned to species on reset, so species are only added or
+        // removed at the end of the list to keep the species of the current particles unchanged
+        for (size_t speciesIdx = 0UL; speciesIdx < m_config.particleSpecies.size(); speciesIdx++) {
+            ParticleSpecies& species = m_config.particleSpecies[speciesIdx];
+            ImGui::PushID(static_cast<int>(speciesIdx));
+            ImGui::Text("Species %zu", speciesIdx);
+            ImGui::SliderFloat("Radius scale", &species.radiusScale, SPECIES_RADIUS_SCALE_MIN, SPECIES_RADIUS_SCALE_MAX);
+            ImGui::SliderFloat("Mass", &species.mass, SPECIES_MASS_MIN, SPECIES_MASS_MAX, "%.2f", ImGuiSliderFlags_Logarithmic);
+            ImGui::SliderFloat("Fraction (on reset)", &species.fraction, 0.0f, 1.0f);
+            ImGui::PopID();
+        }
+        if (m_config.particleSpecies.size() < SPECIES_MAX && ImGui::Button("Add species")) { m_config.particleSpecies.push_back(ParticleSpecies {}); }
+        if (m_config.particleSpecies.size() > 1UL) {
+            ImGui::SameLine();
+            if (ImGui::Button("Remove last species")) { m_config.particleSpecies.pop_back(); }
+        }
+        ImGui::TreePop();
+    }
     ImGui::Checkbox("Inter-particle collisions", &m_config.particleInterCollision);
+    ImGui::Combo("Broad phase", reinterpret_cast<int*>(&m_config.broadPhase), "Brute force (reference)\0Uniform grid\0");
+    ImGui::Combo("Backend", reinterpret_cast<int*>(&m_config.simulationBackend), "GPU (fragment)\0CPU (reference)\0GPU (transform feedback)\0");
+    if (m_config.simulationBackend == SimulationBackend::GPU) {
+        ImGui::Combo("Solver", reinterpret_cast<int*>(&m_config.solverMode), "Impulse (push and reflect)\0Position-based (Jacobi)\0");
+        if (m_config.solverMode == SolverMode::PositionBased) {
+            ImGui::SliderInt("Constraint iterations", &m_config.pbdIterations, 1, PBD_ITERATIONS_MAX);
+            ImGui::SliderFloat("Relaxation", &m_config.pbdRelaxation, 0.5f, 2.0f);
+            ImGui::Checkbox("Sleep settled particles", &m_config.sleepSettledParticles);
+            if (m_config.sleepSettledParticles) {
+                ImGui::SliderFloat("Sleep energy threshold", &m_config.sleepEnergyThreshold, 0.0f, 0.5f, "%.3f");
+                ImGui::SliderInt("Steps at rest before sleeping", &m_config.sleepSteps, 1, SLEEP_STEPS_MAX);
+            }
+        }
+    }
 
     // Flags
     std::string simPlaybackText = m_config.doContinuousSimulation ? "Pause simulation" : "Resume simulation";
@@ -54,14 +143,55 @@ void Menu::drawParticleSimControls() {
     ImGui::SameLine();
     if (ImGui::Button("Reset simulation")) {
         m_config.numParticles       = m_newParticleCount;
+        m_config.statePrecision     = m_newStatePrecision;
         m_config.doResetSimulation  = true;
     }
+
+    // Snapshots, which autosaves overwrite as well
+    if (ImGui::Button("Save state")) {
+        nfdchar_t* outPath = nullptr;
+        if (NFD_SaveDialog("psnap", nullptr, &outPath) == NFD_OKAY) {
+            m_config.snapshotFile   = outPath;
+            m_config.doSaveState    = true;
+            std::free(outPath);
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load state")) {
+        nfdchar_t* outPath = nullptr;
+        if (NFD_OpenDialog("psnap", nullptr, &outPath) == NFD_OKAY) {
+            m_config.snapshotFile   = outPath;
+            m_config.doLoadState    = true;
+            std::free(outPath);
+        }
+    }
+    ImGui::SameLine();
+    ImGui::Text("%s", m_config.snapshotFile.c_str());
+    ImGui::SliderFloat("Autosave interval (s, 0 = off)", &m_config.autosaveInterval, 0.0f, AUTOSAVE_INTERVAL_MAX, "%.0f");
 }
 
-void Menu::drawSphereContainerControls() {
+void Menu::drawContainerControls() {
     constexpr float CENTER_MAX              = 10.0f;
     constexpr float RADIUS_MAX              = 10.0f;
     constexpr float WIREFRAME_THICKNESS_MAX = 10.0f;
+    constexpr int SDF_RESOLUTION_MIN        = 16;
+    constexpr int SDF_RESOLUTION_MAX        = 256;
+
+    ImGui::Combo("Shape", reinterpret_cast<int*>(&m_config.containerShape), "Sphere\0Mesh (signed distance field)\0");
+    if (m_config.containerShape == ContainerShape::Mesh) {
+        if (ImGui::Button("Choose mesh")) {
+            nfdchar_t* outPath = nullptr;
+            if (NFD_OpenDialog("obj", nullptr, &outPath) == NFD_OKAY) {
+                m_config.containerMeshFile = outPath;
+                std::free(outPath);
+            }
+        }
+        ImGui::SameLine();
+        ImGui::Text("%s", m_config.containerMeshFile.empty() ? "(none)" : m_config.containerMeshFile.c_str());
+        // Every change bakes the field again, so the resolution is only applied once the slider is released
+        ImGui::SliderInt("SDF resolution", &m_newSdfResolution, SDF_RESOLUTION_MIN, SDF_RESOLUTION_MAX);
+        if (ImGui::IsItemDeactivatedAfterEdit()) { m_config.containerSdfResolution = m_newSdfResolution; }
+    }
 
     ImGui::DragFloat3("Center", glm::value_ptr(m_config.sphereCenter), 0.01f, -CENTER_MAX, CENTER_MAX, "%.2f");
     ImGui::DragFloat("Radius", &m_config.sphereRadius, 0.01f, 0.0f, RADIUS_MAX, "%.2f");
@@ -71,7 +201,22 @@ void Menu::drawSphereContainerControls() {
 void Menu::drawParticleColorControls() {
     constexpr float SPEED_MAX = 10.0f;
     constexpr float AMBIENT_COEFF_MAX = 0.5f;
+    constexpr float LOD_RADIUS_MAX = 100.0f;
+    constexpr int TRAIL_MEMORY_BUDGET_MAX_MB = 2048;
 
+    ImGui::Combo("Rendering", reinterpret_cast<int*>(&m_config.particleRenderMode), "Mesh (sphere.obj)\0Impostor (ray-cast quads)\0Mesh LOD (icospheres)\0");
+    if (m_config.particleRenderMode == ParticleRenderMode::LodMesh) {
+        ImGui::DragFloat2("LOD switch radii (px)", glm::value_ptr(m_config.lodSwitchPixelRadii), 0.1f, 0.0f, LOD_RADIUS_MAX, "%.1f");
+    }
+    ImGui::Checkbox("Frustum culling", &m_config.frustumCulling);
+    ImGui::Checkbox("Occlusion culling", &m_config.occlusionCulling);
+    ImGui::Checkbox("Draw trails", &m_config.drawTrails);
+    if (m_config.drawTrails) {
+        // Drawing cost grows with the particle count times the trail length; trails are cut short when the budget runs out
+        ImGui::SliderInt("Trail length", &m_config.trailLength, 2, static_cast<int>(utils::TRAIL_MAX_LENGTH));
+        ImGui::SliderInt("Trail memory budget (MB)", &m_config.trailMemoryBudgetMb, 1, TRAIL_MEMORY_BUDGET_MAX_MB);
+        ImGui::ColorEdit3("Trail color", glm::value_ptr(m_config.trailColor));
+    }
     ImGui::Checkbox("Enable Shading", &m_config.enableShading);
     ImGui::SliderFloat("Ambient Coefficient", &m_config.ambientCoefficient, 0.0f, AMBIENT_COEFF_MAX, "%.2f");
 
@@ -96,3 +241,95 @@ void Menu::drawBounceControls() {
         ImGui::ColorEdit3("Bounce Color", glm::value_ptr(m_config.bounceColor));
     }
 }
+
+void Menu::drawStatistics() {
+    ImGui::Checkbox("Record statistics", &m_config.recordStatistics);
+    const std::vector<StatisticsSample>& history = m_statistics.history();
+    if (history.empty()) { return; }
+
+    // Latest values, which lag a frame or two behind the simulation as they are read back without stalling
+    const StatisticsSample& latest = history.back();
+    ImGui::Text("Step %llu", static_cast<unsigned long long>(latest.step));
+    ImGui::Text("Kinetic energy: %.3f", static_cast<double>(latest.kineticEnergy));
+    ImGui::Text("Speed: mean %.3f | max %.3f", static_cast<double>(latest.meanSpeed), static_cast<double>(latest.maxSpeed));
+    ImGui::Text("Collisions in step: %.0f", static_cast<double>(latest.collisions));
+    ImGui::Text("Center of mass: (%.3f, %.3f, %.3f)", static_cast<double>(latest.centerOfMass.x), static_cast<double>(latest.centerOfMass.y), static_cast<double>(latest.centerOfMass.z));
+
+    // History of every metric from oldest to newest
+    const auto plotMetric = [&history](const char* label, auto metric) {
+        std::vector<float> values;
+        values.reserve(history.size());
+        for (const StatisticsSample& sample : history) { values.push_back(metric(sample)); }
+        ImGui::PlotLines(label, values.data(), static_cast<int>(values.size()));
+    };
+    plotMetric("Kinetic energy", [](const StatisticsSample& sample) { return sample.kineticEnergy; });
+    plotMetric("Max speed", [](const StatisticsSample& sample) { return sample.maxSpeed; });
+    plotMetric("Collisions", [](const StatisticsSample& sample) { return sample.collisions; });
+    plotMetric("Center of mass height", [](const StatisticsSample& sample) { return sample.centerOfMass.y; });
+}
+
+void Menu::drawCollisionEvents() {
+    constexpr int CAPACITY_STEP = 1 << 16;
+    ImGui::Checkbox("Record collision events", &m_config.recordCollisionEvents);
+    ImGui::SameLine();
+    if (ImGui::Button("Event log file")) {
+        nfdchar_t* outPath = nullptr;
+        if (NFD_SaveDialog("pevents", nullptr, &outPath) == NFD_OKAY) {
+            m_config.collisionEventFile = outPath;
+            std::free(outPath);
+        }
+    }
+    ImGui::SameLine();
+    ImGui::Text("%s", m_config.collisionEventFile.c_str());
+    if (ImGui::InputInt("Events per frame", &m_config.collisionEventCapacity, CAPACITY_STEP, CAPACITY_STEP * 16)) {
+        m_config.collisionEventCapacity = std::max(m_config.collisionEventCapacity, 1);
+    }
+    if (!m_config.recordCollisionEvents) { return; }
+
+    if (m_config.simulationBackend == SimulationBackend::CPU || m_config.solverMode != SolverMode::Impulse) {
+        ImGui::TextDisabled("Only the impulse solver on the GPU backends records events");
+    }
+    ImGui::Text("Recorded %llu | dropped %llu", static_cast<unsigned long long>(m_collisionEvents.numEventsRecorded()),
+                static_cast<unsigned long long>(m_collisionEvents.numEventsDropped()));
+}
+
+void Menu::drawFrameCapture() {
+    // Every start of a recording numbers its frames from zero again, overwriting the frames of the previous one
+    ImGui::Checkbox("Record frames", &m_config.recordFrames);
+    if (!m_config.frameEncoderCommand.empty()) {
+        ImGui::SameLine();
+        ImGui::Text("Piped to %s", m_config.frameEncoderCommand.c_str());
+        return;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Capture folder")) {
+        nfdchar_t* outPath = nullptr;
+        if (NFD_PickFolder(nullptr, &outPath) == NFD_OKAY) {
+            m_config.frameCaptureDirectory = outPath;
+            std::free(outPath);
+        }
+    }
+    ImGui::SameLine();
+    ImGui::Text("%s", m_config.frameCaptureDirectory.c_str());
+}
+
+void Menu::drawProfilerStats() {
+    const float averageFrameMs = m_profiler.averageFrameMs();
+    ImGui::Text("Frame: %.2f ms (%.0f FPS)", static_cast<double>(averageFrameMs), averageFrameMs > 0.0f ? 1000.0 / static_cast<double>(averageFrameMs) : 0.0);
+    const std::vector<float> frameTimes = m_profiler.frameTimeHistory();
+    ImGui::PlotLines("Frame time (ms)", frameTimes.data(), static_cast<int>(frameTimes.size()));
+
+    // Averages over the profiler history; CPU time is the time spent issuing the pass
+    for (size_t sectionIdx = 0UL; sectionIdx < m_profiler.numSections(); sectionIdx++) {
+        ImGui::Text("%-16s GPU %7.3f ms | CPU %7.3f ms", m_profiler.sectionName(sectionIdx).c_str(),
+                    static_cast<double>(m_profiler.averageGpuMs(sectionIdx)), static_cast<double>(m_profiler.averageCpuMs(sectionIdx)));
+    }
+
+    if (ImGui::Button("Export CSV")) {
+        nfdchar_t* outPath = nullptr;
+        if (NFD_SaveDialog("csv", nullptr, &outPath) == NFD_OKAY) {
+            if (!m_profiler.exportCsv(outPath)) { std::cerr << "Could not write profiler timings to " << outPath << std::endl; }
+            std::free(outPath);
+        }
+    }
+}
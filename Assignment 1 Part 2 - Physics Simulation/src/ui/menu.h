@@ -1,21 +1,34 @@
 #pragma once
 
+#include <simulation/collision_events.h>
+#include <simulation/particle_statistics.h>
 #include <utils/config.h>
+#include <utils/gpu_profiler.h>
 
 
 class Menu {
 public:
-    Menu(Config& config);
+    Menu(Config& config, const GpuProfiler& profiler, const ParticleStatistics& statistics, const CollisionEventRecorder& collisionEvents);
 
     void draw();
 
 private:
     void drawParticleSimControls();
-    void drawSphereContainerControls();
+    void drawContainerControls();
     void drawParticleColorControls();
 
     void drawBounceControls();
 
+    void drawStatistics();
+    void drawCollisionEvents();
+    void drawFrameCapture();
+    void drawProfilerStats();
+
     Config& m_config;
+    const GpuProfiler& m_profiler;
+    const ParticleStatistics& m_statistics;
+    const CollisionEventRecorder& m_collisionEvents;
     int32_t m_newParticleCount;
+    StatePrecision m_newStatePrecision;
+    int m_newSdfResolution;
 };
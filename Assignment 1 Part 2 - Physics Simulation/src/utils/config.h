@@ -2,26 +2,117 @@
 
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
 
+#include <string>
+#include <vector>
+
+
+// Broad phase used to find candidate pairs for inter-particle collisions
+enum class BroadPhase : int {
+    BruteForce = 0, // Test every particle against every other particle (reference mode)
+    UniformGrid     // Only test particles in neighbouring cells of a uniform grid over the container
+};
+
+// Backend that advances the particle simulation
+enum class SimulationBackend : int {
+    GPU = 0,            // Fragment shader passes over the ping-pong state textures
+    CPU,                // Multithreaded SIMD reference solver, its results are uploaded to the state textures for drawing
+    TransformFeedback   // Vertex shader over ping-pong state buffers, captured with transform feedback and drawn from the buffers directly
+};
+
+// Collision response of the GPU (fragment shader) backend; the other backends always use the impulse solver
+enum class SolverMode : int {
+    Impulse = 0,    // Push overlapping particles apart by half the overlap and reflect their velocities, in a single pass per step
+    PositionBased   // Position-based dynamics: predict positions, then project contact and container constraints in Jacobi iterations
+};
+
+// Storage format of the per-particle state textures
+enum class StatePrecision : int {
+    Half = 0,       // RGBA16F, half the memory and bandwidth
+    Full,           // RGBA32F, for large containers where half floats lose too much precision
+    TileRelative    // RGBA16F with positions relative to the center of a tile of the container (A channel is the tile ID), so large
+                    // containers keep most of the precision of small ones at the memory and bandwidth of half floats
+};
+
+// Geometry used to draw the particles
+enum class ParticleRenderMode : int {
+    Mesh = 0,   // Instanced sphere.obj mesh
+    Impostor,   // One camera-facing quad per particle, ray-cast against the sphere in the fragment shader
+    LodMesh     // Instanced icospheres, with coarser levels of detail for particles that are small on screen
+};
+
+// Initial placement of the particles when the simulation is (re)set
+enum class InitialDistribution : int {
+    Spiral = 0,     // Random radii along a spiral over the container, particles may overlap (the original placement)
+    PoissonDisk,    // Random non-overlapping positions, packed outward from the container center
+    Lattice,        // Non-overlapping cubic lattice, filled outward from the container center
+    File            // Latest frame of a state dump written by a batch run
+};
+
+// Shape of the container the particles are kept in
+enum class ContainerShape : int {
+    Sphere = 0, // Analytic sphere of sphereCenter and sphereRadius
+    Mesh        // Closed mesh from an OBJ file, fitted into that sphere and baked into a signed distance field
+};
+
+// Kind of particle in a polydisperse mixture. Particles are assigned a species when the simulation is (re)set, in proportion to the species fractions
+struct ParticleSpecies {
+    float radiusScale   = 1.0f; // Radius relative to Config::particleRadius
+    float mass          = 1.0f;
+    float fraction      = 1.0f; // Share of the particles, relative to the fractions of the other species
+
+    bool operator==(const ParticleSpecies&) const = default;
+};
 
 struct Config {
     // Particle simulation parameters
     uint32_t numParticles       = 2;
     float particleSimTimestep   = 0.014f;
     float particleRadius        = 0.45f;
+    std::vector<ParticleSpecies> particleSpecies = { ParticleSpecies {} };  // At least one species; radii and masses apply live, fractions on reset
     bool particleInterCollision = true;
+    BroadPhase broadPhase       = BroadPhase::UniformGrid;
+    SimulationBackend simulationBackend = SimulationBackend::GPU;
+    SolverMode solverMode               = SolverMode::Impulse;
+    int pbdIterations                   = 4;        // Jacobi constraint iterations per step of the position-based solver
+    float pbdRelaxation                 = 1.0f;     // Over-relaxation of the averaged Jacobi corrections (1 = plain average)
+    bool sleepSettledParticles          = false;    // Skip particles at rest until a moving neighbour touches them (position-based solver only)
+    float sleepEnergyThreshold          = 0.02f;    // Kinetic energy per unit mass below which a particle counts as at rest
+    int sleepSteps                      = 30;       // Consecutive steps at rest before a particle falls asleep
+    uint32_t cpuSolverThreads           = 0;    // Worker threads of the CPU backend (0 = one per hardware thread)
+    StatePrecision statePrecision       = StatePrecision::Half;
+    int substepsPerFrame                = 1;        // Simulation steps per rendered frame (the maximum per frame with real-time stepping)
+    bool realTimeStepping               = false;    // Advance simulated time by the elapsed wall-clock time instead of a fixed number of steps per frame
+    bool recordStatistics               = false;    // Reduce the state to aggregate metrics after the steps of every frame, plotted in the menu
+    bool recordCollisionEvents          = false;    // Append every collision resolved by the impulse solver on the GPU to collisionEventFile
+    int collisionEventCapacity          = 1 << 20;  // Collision events captured per frame; further ones are dropped and counted in the log
+    InitialDistribution initialDistribution = InitialDistribution::Spiral;
+    uint32_t initialSeed                    = 42;
+    std::string initialStateFile;                       // State dump read by InitialDistribution::File
+    std::string snapshotFile                = "simulation.psnap"; // Snapshot file written by autosaves
+    float autosaveInterval                  = 0.0f;     // Wall-clock seconds between snapshots written to snapshotFile (0 = off)
+    std::string collisionEventFile          = "collisions.pevents"; // Binary collision event log, overwritten whenever recording starts
+    bool recordFrames                       = false;    // Capture every rendered frame (without the menu), read back asynchronously
+    std::string frameCaptureDirectory       = "frames"; // Numbered PNG files of the captured frames are written here
+    std::string frameEncoderCommand;                    // Encoder process the raw frames are piped to instead, if not empty (see FrameCaptureSettings)
 
     // Particle simulation flags
     bool doSingleStep           = false;
     bool doContinuousSimulation = true;
     bool doResetSimulation      = false;
+    bool doSaveState            = false;    // Write a snapshot to snapshotFile
+    bool doLoadState            = false;    // Continue from the snapshot in snapshotFile
 
     // Container sphere parameters
     glm::vec3 sphereCenter          = glm::vec3(0.0f);
     float sphereRadius              = 3.0f;
     glm::vec3 sphereColor           = glm::vec3(1.0f);
+    ContainerShape containerShape   = ContainerShape::Sphere;
+    std::string containerMeshFile;                  // OBJ file of ContainerShape::Mesh, which falls back to the sphere if it cannot be loaded
+    int containerSdfResolution      = 64;           // Voxels along the longest side of the signed distance field of the mesh
 
     // ===== Part 2: Drawing =====
 
@@ -31,6 +122,15 @@ struct Config {
     float maxSpeedThreshold = 7.5f;
     bool useSpeedBasedColoring = true;
 
+    ParticleRenderMode particleRenderMode = ParticleRenderMode::Mesh;
+    glm::vec2 lodSwitchPixelRadii         = glm::vec2(16.0f, 6.0f);   // Projected radius in pixels below which the second and third LOD are used
+    bool frustumCulling                   = true;                     // Only draw particles whose bounding sphere intersects the view frustum
+    bool occlusionCulling                 = false;                    // Only draw particles not hidden behind the particles drawn in the previous frame
+    bool drawTrails                       = false;                    // Draw the last positions of every particle as a fading line
+    int trailLength                       = 16;                       // Number of positions per trail, at most as many as fit in the memory budget
+    int trailMemoryBudgetMb               = 128;                      // GPU memory for the past positions of all particles
+    glm::vec3 trailColor                  = glm::vec3(0.4f, 0.8f, 1.0f);
+
     // Task 2.2: Shading
     bool enableShading = true; // For shading toggle
     float ambientCoefficient = 0.25f;
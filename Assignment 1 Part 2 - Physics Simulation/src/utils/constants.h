@@ -17,6 +17,26 @@ namespace utils {
     constexpr glm::vec3 START_POSITION  = {3.0f, 3.0f, 3.0f};
     constexpr glm::vec3 START_LOOK_AT   = -START_POSITION;
 
+    // Particle state textures
+    constexpr uint32_t STATE_TEX_MAX_WIDTH  = 1024; // Particles are laid out in rows of at most this many texels
+    constexpr int32_t POSITION_TILES_PER_AXIS = 16; // Tiles of StatePrecision::TileRelative; their 4096 IDs are exact integers in a half float
+
+    // Particle drawing
+    constexpr uint32_t NUM_PARTICLE_LODS = 3;   // Icosphere levels of detail, from 2 subdivisions (finest) down to the plain icosahedron
+    constexpr uint32_t TRAIL_MAX_LENGTH  = 256; // Maximum number of past positions kept per particle for motion trails
+
+    // Uniform block binding points
+    constexpr uint32_t SIMULATION_PARAMETERS_BINDING = 0;
+    constexpr uint32_t POSITION_TILING_BINDING       = 1;
+
+    // Uniform grid broad phase
+    constexpr int32_t MAX_GRID_RESOLUTION   = 64;   // Maximum number of cells along each axis of the grid
+    constexpr uint32_t CELL_TABLE_WIDTH     = 512;  // Width of the cell range table (MAX_GRID_RESOLUTION^3 cells must fit in a square table)
+    constexpr uint32_t SORT_TEX_MAX_WIDTH   = 1024; // Maximum width of the textures the (cell, particle) keys are sorted in
+
+    // Particle statistics
+    constexpr uint32_t STATS_BLOCK_SIZE = 8;    // Every reduction pass sums blocks of STATS_BLOCK_SIZE x STATS_BLOCK_SIZE texels into one
+
     // File paths
     const std::filesystem::path RESOURCES_DIR_PATH  = RESOURCES_DIR;
     const std::filesystem::path SHADERS_DIR_PATH    = SHADERS_DIR;
@@ -0,0 +1,166 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+
+namespace {
+    float millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+GpuProfiler::GpuProfiler()
+    : m_activeSection(SIZE_MAX)
+    , m_frameTimes(HISTORY_SIZE, 0.0f) {}
+
+GpuProfiler::~GpuProfiler() {
+    for (Section& section : m_sections) {
+        glDeleteQueries(static_cast<GLsizei>(section.queries.size()), section.queries.data());
+    }
+}
+
+void GpuProfiler::beginFrame() {
+    // Frame time is measured from the start of one frame to the start of the next
+    if (m_frameStarted) {
+        m_frameTimes[m_frameIndex % HISTORY_SIZE] = millisecondsSince(m_frameStart);
+        m_frameIndex++;
+    }
+    m_frameStarted  = true;
+    m_frameStart    = std::chrono::steady_clock::now();
+
+    for (Section& section : m_sections) {
+        for (size_t slot = 0UL; slot < QUERY_BUFFER_COUNT; slot++) { collectQuery(section, slot); }
+    }
+}
+
+void GpuProfiler::beginSection(std::string_view name) {
+    Section& section    = findOrAddSection(name);
+    m_activeSection     = static_cast<size_t>(&section - m_sections.data());
+
+    // Only reuse this frame's query once the GPU is done with it, otherwise skip GPU timing rather than wait
+    const size_t slot = m_frameIndex % QUERY_BUFFER_COUNT;
+    collectQuery(section, slot);
+    section.timingGpu = !section.queryPending[slot];
+    if (section.timingGpu) {
+        section.queryFrames[slot] = m_frameIndex;
+        glBeginQuery(GL_TIME_ELAPSED, section.queries[slot]);
+    }
+
+    m_sectionStart = std::chrono::steady_clock::now();
+}
+
+void GpuProfiler::endSection() {
+    if (m_activeSection >= m_sections.size()) { return; }
+    Section& section = m_sections[m_activeSection];
+    m_activeSection  = SIZE_MAX;
+
+    Sample& sample  = section.history[m_frameIndex % HISTORY_SIZE];
+    sample.frame    = m_frameIndex;
+    sample.cpuMs    = millisecondsSince(m_sectionStart);
+    sample.gpuMs    = std::numeric_limits<float>::quiet_NaN();
+
+    if (section.timingGpu) {
+        glEndQuery(GL_TIME_ELAPSED);
+        section.queryPending[m_frameIndex % QUERY_BUFFER_COUNT] = true;
+    }
+}
+
+size_t GpuProfiler::numSections() const {
+    return m_sections.size();
+}
+
+const std::string& GpuProfiler::sectionName(size_t sectionIdx) const {
+    return m_sections[sectionIdx].name;
+}
+
+float GpuProfiler::averageGpuMs(size_t sectionIdx) const {
+    float sum           = 0.0f;
+    size_t numSamples   = 0UL;
+    for (const Sample& sample : m_sections[sectionIdx].history) {
+        if (sample.frame == INVALID_FRAME || std::isnan(sample.gpuMs)) { continue; }
+        sum += sample.gpuMs;
+        numSamples++;
+    }
+    return numSamples > 0UL ? sum / static_cast<float>(numSamples) : 0.0f;
+}
+
+float GpuProfiler::averageCpuMs(size_t sectionIdx) const {
+    float sum           = 0.0f;
+    size_t numSamples   = 0UL;
+    for (const Sample& sample : m_sections[sectionIdx].history) {
+        if (sample.frame == INVALID_FRAME) { continue; }
+        sum += sample.cpuMs;
+        numSamples++;
+    }
+    return numSamples > 0UL ? sum / static_cast<float>(numSamples) : 0.0f;
+}
+
+float GpuProfiler::averageFrameMs() const {
+    const size_t numFrames = std::min(static_cast<size_t>(m_frameIndex), HISTORY_SIZE);
+    if (numFrames == 0UL) { return 0.0f; }
+    float sum = 0.0f;
+    for (size_t frameIdx = 0UL; frameIdx < numFrames; frameIdx++) { sum += m_frameTimes[frameIdx]; }
+    return sum / static_cast<float>(numFrames);
+}
+
+std::vector<float> GpuProfiler::frameTimeHistory() const {
+    // The oldest entry follows the one of the current (unfinished) frame
+    std::vector<float> frameTimes;
+    frameTimes.reserve(HISTORY_SIZE);
+    for (size_t offset = 1UL; offset <= HISTORY_SIZE; offset++) {
+        frameTimes.push_back(m_frameTimes[(m_frameIndex + offset) % HISTORY_SIZE]);
+    }
+    return frameTimes;
+}
+
+bool GpuProfiler::exportCsv(const std::filesystem::path& filePath) const {
+    std::ofstream file(filePath);
+    if (!file) { return false; }
+
+    file << "frame,section,gpu_ms,cpu_ms\n";
+    const uint64_t firstFrame = m_frameIndex >= HISTORY_SIZE ? m_frameIndex - HISTORY_SIZE + 1UL : 0UL;
+    for (uint64_t frame = firstFrame; frame <= m_frameIndex; frame++) {
+        for (const Section& section : m_sections) {
+            const Sample& sample = section.history[frame % HISTORY_SIZE];
+            if (sample.frame != frame) { continue; }
+            file << frame << ',' << section.name << ',';
+            if (!std::isnan(sample.gpuMs)) { file << sample.gpuMs; } // Left empty while the query is in flight
+            file << ',' << sample.cpuMs << '\n';
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+GpuProfiler::Section& GpuProfiler::findOrAddSection(std::string_view name) {
+    auto sectionIt = std::find_if(m_sections.begin(), m_sections.end(), [&](const Section& section) { return section.name == name; });
+    if (sectionIt != m_sections.end()) { return *sectionIt; }
+
+    Section& section = m_sections.emplace_back();
+    section.name = name;
+    glGenQueries(static_cast<GLsizei>(section.queries.size()), section.queries.data());
+    section.queryFrames.fill(INVALID_FRAME);
+    section.queryPending.fill(false);
+    section.timingGpu = false;
+    section.history.assign(HISTORY_SIZE, Sample { INVALID_FRAME, 0.0f, std::numeric_limits<float>::quiet_NaN() });
+    return section;
+}
+
+void GpuProfiler::collectQuery(Section& section, size_t slot) {
+    if (!section.queryPending[slot]) { return; }
+
+    GLint available;
+    glGetQueryObjectiv(section.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) { return; }
+
+    GLuint64 elapsedNs;
+    glGetQueryObjectui64v(section.queries[slot], GL_QUERY_RESULT, &elapsedNs);
+    section.queryPending[slot] = false;
+
+    // The sample may have been overwritten already if the result took longer than the history to arrive
+    const uint64_t frame    = section.queryFrames[slot];
+    Sample& sample          = section.history[frame % HISTORY_SIZE];
+    if (sample.frame == frame) { sample.gpuMs = static_cast<float>(elapsedNs) * 1e-6f; }
+}
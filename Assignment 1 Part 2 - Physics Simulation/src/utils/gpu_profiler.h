@@ -0,0 +1,80 @@
+#pragma once
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <framework/opengl_includes.h>
+DISABLE_WARNINGS_POP()
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Per-pass GPU and CPU timings of the last HISTORY_SIZE frames
+// GPU times come from GL_TIME_ELAPSED queries, double-buffered per section: results are only read once the GPU reports them
+// available, so the profiler never stalls the pipeline. A section whose query from two frames ago is still in flight skips
+// its GPU timing for the frame instead. CPU times measure how long issuing the pass took on the CPU
+// Sections must not be nested, as only one GL_TIME_ELAPSED query can be active at a time
+class GpuProfiler {
+public:
+    static constexpr size_t HISTORY_SIZE = 256UL;
+
+    GpuProfiler();
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // Call once at the start of every frame; also collects any query results that became available
+    void beginFrame();
+    void beginSection(std::string_view name);
+    void endSection();
+
+    // Sections are numbered in the order they were first profiled
+    size_t numSections() const;
+    const std::string& sectionName(size_t sectionIdx) const;
+    // Averages over the frames in the history with a valid sample, in milliseconds
+    float averageGpuMs(size_t sectionIdx) const;
+    float averageCpuMs(size_t sectionIdx) const;
+    float averageFrameMs() const;
+    // Frame times in milliseconds from oldest to newest, e.g. for plotting
+    std::vector<float> frameTimeHistory() const;
+
+    // One row per section per frame in the history; returns false if the file could not be written
+    bool exportCsv(const std::filesystem::path& filePath) const;
+
+private:
+    static constexpr size_t QUERY_BUFFER_COUNT = 2UL;
+
+    struct Sample {
+        uint64_t frame; // Frame the sample was taken in, or INVALID_FRAME for unused history entries
+        float cpuMs;
+        float gpuMs;    // NaN until the query result is available
+    };
+
+    struct Section {
+        std::string name;
+        std::array<GLuint, QUERY_BUFFER_COUNT> queries;
+        std::array<uint64_t, QUERY_BUFFER_COUNT> queryFrames;
+        std::array<bool, QUERY_BUFFER_COUNT> queryPending;
+        bool timingGpu;                 // Whether a query was started for the current frame
+        std::vector<Sample> history;    // Ring buffer indexed by frame % HISTORY_SIZE
+    };
+
+    static constexpr uint64_t INVALID_FRAME = UINT64_MAX;
+
+    std::vector<Section> m_sections;
+    size_t m_activeSection;
+    std::chrono::steady_clock::time_point m_sectionStart;
+    uint64_t m_frameIndex = 0UL;
+    bool m_frameStarted = false;
+    std::chrono::steady_clock::time_point m_frameStart;
+    std::vector<float> m_frameTimes;    // Ring buffer indexed by frame % HISTORY_SIZE, 0 for frames not yet finished
+
+    Section& findOrAddSection(std::string_view name);
+    void collectQuery(Section& section, size_t slot);
+};
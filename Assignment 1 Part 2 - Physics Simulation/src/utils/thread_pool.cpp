@@ -0,0 +1,78 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(uint32_t numThreads) {
+    if (numThreads == 0U) { numThreads = std::max(std::thread::hardware_concurrency(), 1U); }
+
+    // The calling thread processes the first chunk itself, so only numThreads - 1 workers are spawned
+    for (uint32_t workerIdx = 0U; workerIdx + 1U < numThreads; workerIdx++) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this, workerIdx);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (std::thread& worker : m_workers) { worker.join(); }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body) {
+    const size_t numChunks = m_workers.size() + 1UL;
+    if (count == 0UL) { return; }
+    if (numChunks == 1UL || count < numChunks) {
+        body(0UL, count);
+        return;
+    }
+
+    // Publish the loop to the workers
+    {
+        std::lock_guard lock(m_mutex);
+        m_body              = &body;
+        m_count             = count;
+        m_pendingWorkers    = static_cast<uint32_t>(m_workers.size());
+        m_generation++;
+    }
+    m_workAvailable.notify_all();
+
+    // Process the first chunk on the calling thread, then wait for the workers to finish theirs
+    body(0UL, count / numChunks);
+    std::unique_lock lock(m_mutex);
+    m_workDone.wait(lock, [this]() { return m_pendingWorkers == 0U; });
+    m_body = nullptr;
+}
+
+uint32_t ThreadPool::numThreads() const {
+    return static_cast<uint32_t>(m_workers.size()) + 1U;
+}
+
+void ThreadPool::workerLoop(uint32_t workerIdx) {
+    uint64_t seenGeneration = 0UL;
+    while (true) {
+        const std::function<void(size_t, size_t)>* body;
+        size_t count;
+        {
+            std::unique_lock lock(m_mutex);
+            m_workAvailable.wait(lock, [&]() { return m_stopping || m_generation != seenGeneration; });
+            if (m_stopping) { return; }
+            seenGeneration  = m_generation;
+            body            = m_body;
+            count           = m_count;
+        }
+
+        // Chunk 0 belongs to the calling thread
+        const size_t numChunks  = m_workers.size() + 1UL;
+        const size_t chunkIdx   = workerIdx + 1UL;
+        (*body)(count * chunkIdx / numChunks, count * (chunkIdx + 1UL) / numChunks);
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_pendingWorkers--;
+        }
+        m_workDone.notify_one();
+    }
+}
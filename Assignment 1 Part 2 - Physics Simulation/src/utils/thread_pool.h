@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+
+// Fixed-size pool of worker threads for data-parallel loops
+class ThreadPool {
+public:
+    // A thread count of 0 uses one thread per hardware thread
+    ThreadPool(uint32_t numThreads = 0U);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Split [0, count) into one contiguous chunk per thread and block until all chunks are processed
+    void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body);
+
+    uint32_t numThreads() const;
+
+private:
+    void workerLoop(uint32_t workerIdx);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable, m_workDone;
+
+    // State of the loop currently being executed
+    const std::function<void(size_t, size_t)>* m_body = nullptr;
+    size_t m_count                                  = 0UL;
+    uint64_t m_generation                           = 0UL;  // Incremented for every loop so workers pick each one up exactly once
+    uint32_t m_pendingWorkers                       = 0U;
+    bool m_stopping                                 = false;
+};
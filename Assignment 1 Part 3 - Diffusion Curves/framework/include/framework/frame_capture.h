@@ -0,0 +1,90 @@
+#pragma once
+#include "disable_all_warnings.h"
+#include "opengl_includes.h"
+// Suppress warnings in third-party code.
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FrameCaptureSettings {
+    // Frames are written as numbered images (frame_000000.png, ...) into outputDirectory, unless an encoder command is given.
+    // The encoder command is started once the first frame arrives, with {width} and {height} replaced by its size, and
+    // receives the raw RGBA frames (top row first) on its standard input, e.g.
+    //   ffmpeg -y -f rawvideo -pix_fmt rgba -s {width}x{height} -r 60 -i - -pix_fmt yuv420p capture.mp4
+    std::filesystem::path outputDirectory { "frames" };
+    std::string imageExtension { ".png" }; // ".png" or ".bmp", any other extension fails the capture
+    std::string encoderCommand;
+
+    uint32_t numPixelBuffers { 3 }; // Readbacks in flight; a frame is only mapped once the GPU finished writing its buffer
+    uint32_t numWorkers { 2 }; // Encoding threads; frames piped to an encoder are always written by a single thread
+    uint32_t maxQueuedFrames { 8 }; // Frames waiting for a worker; further frames are dropped rather than stalling rendering
+};
+
+// Records the default framebuffer (or whichever framebuffer is bound for reading) as a sequence of frames without stalling the
+// render thread: every frame is read into the next of a ring of pixel buffer objects, which is only mapped frames later, once
+// its fence has signalled. Mapped frames are handed to a bounded queue of worker threads that encode them.
+class FrameCapture {
+public:
+    FrameCapture(const FrameCaptureSettings& settings = {});
+    ~FrameCapture(); // Waits for every captured frame to be written
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Start the readback of the bottom-left corner of the given size of the framebuffer bound for reading; call this after
+    // rendering and before swapping buffers
+    void captureFrame(const glm::ivec2& size);
+    // Wait for every captured frame to be read back and written
+    void finish();
+
+    [[nodiscard]] uint64_t numFramesCaptured() const; // Frames read back and queued, whether or not they were written yet
+    [[nodiscard]] uint64_t numFramesDropped() const; // Frames skipped because the queue was full when capturing or reading them back
+    [[nodiscard]] bool failed() const; // Writing a frame or starting the encoder failed, frames are no longer written
+
+private:
+    struct PixelBuffer {
+        GLuint buffer { 0 };
+        GLsync fence { nullptr };
+        glm::ivec2 size { 0 };
+        uint64_t frameIdx { 0 };
+    };
+    struct Frame {
+        uint64_t frameIdx;
+        glm::ivec2 size;
+        std::vector<uint8_t> pixels; // RGBA, bottom row first as read back
+    };
+
+    // Map the readbacks that finished, oldest first, and queue their frames; waits for all of them if wait is set
+    void collectReadbacks(bool wait);
+    // Returns false if the readback did not finish yet and wait is not set
+    bool collectReadback(PixelBuffer& pixelBuffer, bool wait);
+    void workerLoop();
+    bool writeFrame(Frame& frame);
+
+    FrameCaptureSettings m_settings;
+    std::vector<PixelBuffer> m_pixelBuffers;
+    size_t m_nextPixelBuffer { 0 };
+    uint64_t m_nextFrameIdx { 0 }; // Numbers the readbacks; frames dropped after their readback leave a gap
+    uint64_t m_framesCaptured { 0 };
+    uint64_t m_framesDropped { 0 };
+    FILE* m_encoderPipe { nullptr }; // Only used by the single worker of an encoder
+    glm::ivec2 m_encoderFrameSize { 0 };
+
+    // State shared with the workers
+    std::vector<std::thread> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_frameAvailable, m_queueDrained;
+    std::deque<Frame> m_queue;
+    uint32_t m_busyWorkers { 0 };
+    bool m_failed { false };
+    bool m_stopping { false };
+};
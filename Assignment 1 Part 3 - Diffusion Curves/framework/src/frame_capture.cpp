@@ -0,0 +1,248 @@
+#include "frame_capture.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <fmt/format.h>
+#include <stb/stb_image_write.h>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+static constexpr const char* pipeMode = "wb";
+#else
+#include <csignal>
+static constexpr const char* pipeMode = "w";
+#endif
+
+FrameCapture::FrameCapture(const FrameCaptureSettings& settings)
+    : m_settings(settings)
+{
+    m_pixelBuffers.resize(std::max(m_settings.numPixelBuffers, 1u));
+    for (PixelBuffer& pixelBuffer : m_pixelBuffers)
+        glGenBuffers(1, &pixelBuffer.buffer);
+
+    if (m_settings.encoderCommand.empty() && m_settings.imageExtension != ".png" && m_settings.imageExtension != ".bmp") {
+        std::cerr << "Unsupported frame capture image extension \"" << m_settings.imageExtension << "\", use .png or .bmp" << std::endl;
+        m_failed = true;
+    } else if (m_settings.encoderCommand.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(m_settings.outputDirectory, error);
+        if (error) {
+            std::cerr << "Could not create frame capture directory " << m_settings.outputDirectory << ": " << error.message() << std::endl;
+            m_failed = true;
+        }
+    }
+#ifndef _WIN32
+    // An encoder that exits early should fail the capture rather than terminate the application. The disposition is process
+    // wide, so it is set here on the creating thread rather than by the worker that starts the encoder
+    if (!m_settings.encoderCommand.empty())
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    // Frames piped to an encoder have to arrive in order, so only a single worker writes them
+    const uint32_t numWorkers = m_settings.encoderCommand.empty() ? std::max(m_settings.numWorkers, 1u) : 1u;
+    for (uint32_t workerIdx = 0; workerIdx < numWorkers; workerIdx++)
+        m_workers.emplace_back(&FrameCapture::workerLoop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    finish();
+    {
+        std::lock_guard lock { m_mutex };
+        m_stopping = true;
+    }
+    m_frameAvailable.notify_all();
+    for (std::thread& worker : m_workers)
+        worker.join();
+
+    if (m_encoderPipe && pclose(m_encoderPipe) != 0)
+        std::cerr << "Frame encoder \"" << m_settings.encoderCommand << "\" did not exit cleanly" << std::endl;
+    for (PixelBuffer& pixelBuffer : m_pixelBuffers)
+        glDeleteBuffers(1, &pixelBuffer.buffer);
+}
+
+void FrameCapture::captureFrame(const glm::ivec2& size)
+{
+    collectReadbacks(false);
+
+    // Frames are dropped rather than waiting for the workers, so recording never stalls rendering
+    {
+        std::lock_guard lock { m_mutex };
+        if (m_failed)
+            return;
+        if (m_queue.size() >= m_settings.maxQueuedFrames) {
+            m_framesDropped++;
+            return;
+        }
+    }
+
+    // The next buffer holds the oldest readback, which only has to be waited for if the GPU is all buffers behind
+    PixelBuffer& pixelBuffer = m_pixelBuffers[m_nextPixelBuffer];
+    collectReadback(pixelBuffer, true);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer.buffer);
+    if (pixelBuffer.size != size)
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(4) * size.x * size.y, nullptr, GL_STREAM_READ);
+    glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    pixelBuffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); // Make sure the fence is submitted, so polling it without flushing eventually succeeds
+    pixelBuffer.size = size;
+    pixelBuffer.frameIdx = m_nextFrameIdx++;
+    m_nextPixelBuffer = (m_nextPixelBuffer + 1) % m_pixelBuffers.size();
+}
+
+void FrameCapture::finish()
+{
+    collectReadbacks(true);
+    std::unique_lock lock { m_mutex };
+    m_queueDrained.wait(lock, [this]() { return m_queue.empty() && m_busyWorkers == 0; });
+}
+
+uint64_t FrameCapture::numFramesCaptured() const
+{
+    return m_framesCaptured;
+}
+
+uint64_t FrameCapture::numFramesDropped() const
+{
+    return m_framesDropped;
+}
+
+bool FrameCapture::failed() const
+{
+    std::lock_guard lock { m_mutex };
+    return m_failed;
+}
+
+void FrameCapture::collectReadbacks(bool wait)
+{
+    // Oldest readback first, so frames are queued in order
+    for (size_t offset = 0; offset < m_pixelBuffers.size(); offset++) {
+        if (!collectReadback(m_pixelBuffers[(m_nextPixelBuffer + offset) % m_pixelBuffers.size()], wait))
+            return;
+    }
+}
+
+bool FrameCapture::collectReadback(PixelBuffer& pixelBuffer, bool wait)
+{
+    if (!pixelBuffer.fence)
+        return true;
+    const GLenum syncStatus = wait ? glClientWaitSync(pixelBuffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED) : glClientWaitSync(pixelBuffer.fence, 0, 0);
+    if (syncStatus == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(pixelBuffer.fence);
+    pixelBuffer.fence = nullptr;
+    if (syncStatus == GL_WAIT_FAILED) {
+        std::cerr << "Failed to read back captured frame " << pixelBuffer.frameIdx << std::endl;
+        return true;
+    }
+
+    // Readbacks issued while the queue had room can finish after it filled up; their frames are dropped without mapping them.
+    // Only the render thread adds frames, so the queue cannot grow again before the frame below is pushed
+    {
+        std::lock_guard lock { m_mutex };
+        if (m_queue.size() >= m_settings.maxQueuedFrames) {
+            m_framesDropped++;
+            return true;
+        }
+    }
+
+    // The copy out of the mapped buffer is the only work on the render thread
+    Frame frame { pixelBuffer.frameIdx, pixelBuffer.size, std::vector<uint8_t>(static_cast<size_t>(4) * pixelBuffer.size.x * pixelBuffer.size.y) };
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer.buffer);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(frame.pixels.size()), GL_MAP_READ_BIT);
+    if (pixels) {
+        std::memcpy(frame.pixels.data(), pixels, frame.pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!pixels) {
+        std::cerr << "Failed to map captured frame " << pixelBuffer.frameIdx << std::endl;
+        return true;
+    }
+
+    {
+        std::lock_guard lock { m_mutex };
+        m_queue.push_back(std::move(frame));
+    }
+    m_framesCaptured++;
+    m_frameAvailable.notify_one();
+    return true;
+}
+
+void FrameCapture::workerLoop()
+{
+    while (true) {
+        Frame frame;
+        {
+            std::unique_lock lock { m_mutex };
+            m_frameAvailable.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty())
+                return; // Stopping, and every frame is written
+            frame = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_busyWorkers++;
+        }
+
+        // Frames still queued after a failure are discarded
+        const bool skip = failed();
+        const bool written = skip || writeFrame(frame);
+
+        {
+            std::lock_guard lock { m_mutex };
+            m_busyWorkers--;
+            m_failed |= !written;
+            if (m_queue.empty() && m_busyWorkers == 0)
+                m_queueDrained.notify_all();
+        }
+    }
+}
+
+bool FrameCapture::writeFrame(Frame& frame)
+{
+    // Read back bottom row first, but images and raw video frames start at the top
+    const size_t rowSize = static_cast<size_t>(4) * frame.size.x;
+    for (int row = 0; row < frame.size.y / 2; row++)
+        std::swap_ranges(frame.pixels.begin() + rowSize * row, frame.pixels.begin() + rowSize * (row + 1), frame.pixels.begin() + rowSize * (frame.size.y - row - 1));
+
+    if (!m_settings.encoderCommand.empty()) {
+        // Only one worker pipes frames, so the encoder is started and fed by the same thread
+        if (!m_encoderPipe) {
+            std::string command;
+            try {
+                command = fmt::format(fmt::runtime(m_settings.encoderCommand), fmt::arg("width", frame.size.x), fmt::arg("height", frame.size.y));
+            } catch (const fmt::format_error& e) {
+                std::cerr << "Invalid frame encoder command \"" << m_settings.encoderCommand << "\": " << e.what() << std::endl;
+                return false;
+            }
+            m_encoderPipe = popen(command.c_str(), pipeMode);
+            if (!m_encoderPipe) {
+                std::cerr << "Could not start frame encoder \"" << command << "\"" << std::endl;
+                return false;
+            }
+            m_encoderFrameSize = frame.size;
+        }
+        if (frame.size != m_encoderFrameSize) {
+            std::cerr << "Frame size changed while piping frames to the encoder, stopping the capture" << std::endl;
+            return false;
+        }
+        if (std::fwrite(frame.pixels.data(), 1, frame.pixels.size(), m_encoderPipe) != frame.pixels.size()) {
+            std::cerr << "Failed to pipe frame " << frame.frameIdx << " to the encoder" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    const std::string filePathString = (m_settings.outputDirectory / fmt::format("frame_{:06d}{}", frame.frameIdx, m_settings.imageExtension)).string();
+    const bool written = m_settings.imageExtension == ".bmp"
+        ? stbi_write_bmp(filePathString.c_str(), frame.size.x, frame.size.y, 4, frame.pixels.data()) != 0
+        : stbi_write_png(filePathString.c_str(), frame.size.x, frame.size.y, 4, frame.pixels.data(), static_cast<int>(rowSize)) != 0;
+    if (!written)
+        std::cerr << "Failed to write captured frame " << filePathString << std::endl;
+    return written;
+}
@@ -245,8 +245,8 @@ void Window::swapBuffers()
 
 
 void Window::renderToImage (const std::filesystem::path& filePath, const bool flipY) {
-        std::vector <GLubyte> pixels;
-        pixels.reserve (4 * m_windowSize.x * m_windowSize.y);
+        // Synchronous, for single screenshots; FrameCapture records frame sequences without stalling
+        std::vector <GLubyte> pixels(4 * m_windowSize.x * m_windowSize.y);
 
         glReadPixels(0, 0, m_windowSize.x, m_windowSize.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
 
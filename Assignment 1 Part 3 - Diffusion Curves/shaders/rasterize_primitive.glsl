@@ -20,19 +20,22 @@ struct Line {
     vec4 color_right[2];
 };
 
-//The uniform buffers for the shapes containing the count of shapes in the first slot and after that, the actual shapes
-//We need to give the arrays a fixed size to work with opengl 4.1
-layout(std140) uniform circleBuffer
-{
-    int circle_count;
-    Circle circles[32];
-};
-
-layout(std140) uniform lineBuffer
-{
-    int line_count;
-    Line lines[800];
-};
+//Texture buffers with the shapes, which unlike uniform buffers do not limit the number of shapes
+//Every texel holds 16 bytes of the structs in shape.h: a circle takes 2 texels and a line 5
+uniform samplerBuffer circle_texture;
+uniform samplerBuffer line_texture;
+
+Circle get_circle(int index) {
+    vec4 position_radius = texelFetch(circle_texture, 2 * index + 1);
+    return Circle(texelFetch(circle_texture, 2 * index), position_radius.xy, position_radius.z);
+}
+
+Line get_line(int index) {
+    vec4 points = texelFetch(line_texture, 5 * index);
+    return Line(points.xy, points.zw,
+        vec4[2](texelFetch(line_texture, 5 * index + 1), texelFetch(line_texture, 5 * index + 2)),
+        vec4[2](texelFetch(line_texture, 5 * index + 3), texelFetch(line_texture, 5 * index + 4)));
+}
 
 //The type of the shape we are rasterizing, the same as the enumerator in shapes.h
 // 0 - circles
@@ -43,6 +46,19 @@ uniform uint shape_type;
 //The maximum distance to the shape for a pixel to be part of the shape
 uniform float rasterize_width;
 
+//Uniform grid over the screen with the shapes that may rasterize into each cell, equivalent to ShapeGrid in shape.h
+//Only the shapes of the cell of a pixel are tested, in the same order as the shape arrays
+uniform int grid_cell_size;
+uniform ivec2 grid_cell_count;
+uniform isamplerBuffer grid_cells;     // Offset into grid_shapes (x) and number of shapes (y) of every cell, row by row
+uniform isamplerBuffer grid_shapes;    // Shape indices of all cells
+
+//The offset and number of shapes of the cell containing the pixel
+ivec2 grid_cell_shapes(vec2 pixel_center) {
+    ivec2 cell = clamp(ivec2(pixel_center) / grid_cell_size, ivec2(0), grid_cell_count - 1);
+    return texelFetch(grid_cells, cell.y * grid_cell_count.x + cell.x).xy;
+}
+
 void main()
 {   
     shape_id = -1;
@@ -50,9 +66,11 @@ void main()
     // ---- CIRCLE
     if (shape_type == 0) {
         vec2 pixel_center = gl_FragCoord.xy;
+        ivec2 cell_shapes = grid_cell_shapes(pixel_center);
 
-        for (int i = 0; i < circle_count; ++i) {
-            Circle circle = circles[i];
+        for (int k = 0; k < cell_shapes.y; ++k) {
+            int i = texelFetch(grid_shapes, cell_shapes.x + k).r;
+            Circle circle = get_circle(i);
             float distance = length(pixel_center - circle.position);
 
             // rasterization range: [circle.radius - rasterize_width, circle.radius + rasterize_width]
@@ -65,9 +83,11 @@ void main()
     // ---- LINE
     else if (shape_type == 1) {
         vec2 pixel_center = gl_FragCoord.xy;
+        ivec2 cell_shapes = grid_cell_shapes(pixel_center);
 
-        for (int i = 0; i < line_count; ++i) {
-            Line line = lines[i];
+        for (int k = 0; k < cell_shapes.y; ++k) {
+            int i = texelFetch(grid_shapes, cell_shapes.x + k).r;
+            Line line = get_line(i);
             vec2 start = line.start_point;
             vec2 end = line.end_point;
         
@@ -24,19 +24,22 @@ struct Line {
     vec4 color_right[2];
 };
 
-//The uniform buffers for the shapes containing the count of shapes in the first slot and after that, the actual shapes
-//We need to give the arrays a fixed size to work with opengl 4.1
-layout(std140) uniform circleBuffer
-{
-    int circle_count;
-    Circle circles[32];
-};
+//Texture buffers with the shapes, which unlike uniform buffers do not limit the number of shapes
+//Every texel holds 16 bytes of the structs in shape.h: a circle takes 2 texels and a line 5
+uniform samplerBuffer circle_texture;
+uniform samplerBuffer line_texture;
+
+Circle get_circle(int index) {
+    vec4 position_radius = texelFetch(circle_texture, 2 * index + 1);
+    return Circle(texelFetch(circle_texture, 2 * index), position_radius.xy, position_radius.z);
+}
 
-layout(std140) uniform lineBuffer
-{
-    int line_count;
-    Line lines[800];
-};
+Line get_line(int index) {
+    vec4 points = texelFetch(line_texture, 5 * index);
+    return Line(points.xy, points.zw,
+        vec4[2](texelFetch(line_texture, 5 * index + 1), texelFetch(line_texture, 5 * index + 2)),
+        vec4[2](texelFetch(line_texture, 5 * index + 3), texelFetch(line_texture, 5 * index + 4)));
+}
 
 //Textures for the rasterized shapes, and the accumulator
 uniform isampler2D rasterized_texture;
@@ -112,7 +115,7 @@ void main()
 
     if (shape_index >= 0) {
         if (shape_type == 0) {  // Circle
-            Circle circle = circles[shape_index];
+            Circle circle = get_circle(shape_index);
             float distance2center = distance(pixel_center, circle.position);
 
             if (distance2center <= circle.radius) {
@@ -120,7 +123,7 @@ void main()
                 hit = true;
             }
         } else {  // line
-            Line line = lines[shape_index];
+            Line line = get_line(shape_index);
             vec2 start = line.start_point;
             vec2 end = line.end_point;
 
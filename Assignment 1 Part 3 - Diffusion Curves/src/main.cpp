@@ -8,7 +8,9 @@ DISABLE_WARNINGS_PUSH()
 DISABLE_WARNINGS_POP()
 
 #include<iostream>
+#include<optional>
 #include<random>
+#include<framework/frame_capture.h>
 #include<framework/window.h>
 #include<framework/shader.h>
 #include<framework/trackball.h>
@@ -19,10 +21,22 @@ constexpr glm::ivec2 resolution{ 512, 512 };
 std::unique_ptr<Window> pWindow;
 std::unique_ptr<Trackball> pTrackball;
 
+//Texture buffers holding the grid of the shapes being rasterized, see ShapeGrid in shapes.h
+struct ShapeGridTextures {
+	GLuint cell_buffer, cell_texture;
+	GLuint shape_buffer, shape_texture;
+	int cell_size;
+	glm::ivec2 cell_count;
+};
+
 //Forward declaration for GLFW callback function
 void keyboard(int key, int /* scancode */, int /* action */, int /* mods */);
 void reshape(const glm::ivec2& size);
-void rasterize_shape(const GLuint& VAO, const GLuint& frameBuffer, const Shader& shader, const GLuint& circleBuffer, const GLuint& lineBuffer, const float& line_width, const Shape& shapetype);
+void create_texture_buffer(GLenum internal_format, GLuint& buffer, GLuint& texture);
+template <typename T>
+void upload_shapes(const GLuint& buffer, const std::vector<T>& shapes);
+void upload_shape_grid(ShapeGridTextures& grid_textures, const ShapeGrid& grid);
+void rasterize_shape(const GLuint& VAO, const GLuint& frameBuffer, const Shader& shader, const GLuint& circleTexture, const GLuint& lineTexture, const ShapeGridTextures& grid_textures, const float& line_width, const Shape& shapetype);
 
 int constexpr file_name_buffer_size = 40;
 
@@ -43,6 +57,8 @@ int max_curve_subdivision = 10;  // FIXME: changed from 0 to 10
 
 //Uniform for the maximum distance from a shape to be considered part of it
 float rasterize_width = 0.75f;
+//Size in pixels of the grid cells, rasterizing a pixel only tests the shapes overlapping its cell
+int constexpr grid_cell_size = 16;
 //Step size and maximum steps for raymarching
 float step_size = 0.05f;
 unsigned int max_raymarch_iters = 10000;
@@ -57,6 +73,10 @@ bool one_sample = false;
 // 2 - accumulator_texture
 int output_type = 0;
 
+//Record every frame (without the menu) as numbered images into capture_folder
+bool record_frames = false;
+std::filesystem::path capture_folder("frames");
+
 
 /// <summary>
 /// Creates nr_circles random circle shapes and adds them to circles
@@ -168,32 +188,22 @@ int main() {
     int circle_id = 1;
     randomize_circles(circles, number_of_circles, circle_seed);
 
-	//Create Uniform buffer objects for the circles and lines, the structs are also in GLSL so we can simply put the data directly in the buffer
+	//Create texture buffers for the circles and lines, the structs are also in GLSL so we can simply put the data directly in the buffer
+	//Unlike uniform buffers, texture buffers are large enough for any number of shapes
 	number_of_circles = (int)circles.size();
 
-	GLuint circleUbo;
-	glGenBuffers(1, &circleUbo);
-	glBindBuffer(GL_UNIFORM_BUFFER, circleUbo);
-	//Set buffer size but dont put anything in it just yet
-	glBufferData(GL_UNIFORM_BUFFER, number_of_circles * sizeof(Circle) + 16, NULL, GL_DYNAMIC_DRAW);
-	//put the number of circles in the first 4 bytes to the number of circles
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(int), &number_of_circles);
-	//GLSL data is 16 byte alligned so the actual data starts at byte 16
-	glBufferSubData(GL_UNIFORM_BUFFER, 16, number_of_circles * sizeof(Circle), circles.data());
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-	int number_of_lines = (int)lines.size();
-
-	GLuint lineUbo;
-	glGenBuffers(1, &lineUbo);
-	glBindBuffer(GL_UNIFORM_BUFFER, lineUbo);
-	//Set buffer size but dont put anything in it just yet
-	glBufferData(GL_UNIFORM_BUFFER, number_of_lines * sizeof(Line) + 16, NULL, GL_DYNAMIC_DRAW);
-	//put the number of circles in the first 4 bytes to the number of circles
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(int), &number_of_lines);
-	//GLSL data is 16 byte alligned so the actual data starts at byte 16
-	glBufferSubData(GL_UNIFORM_BUFFER, 16, number_of_lines * sizeof(Line), lines.data());
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	GLuint circleBuffer, circleTexture;
+	create_texture_buffer(GL_RGBA32F, circleBuffer, circleTexture);
+	upload_shapes(circleBuffer, circles);
+
+	GLuint lineBuffer, lineTexture;
+	create_texture_buffer(GL_RGBA32F, lineBuffer, lineTexture);
+	upload_shapes(lineBuffer, lines);
+
+	//Create texture buffers for the grid of shapes, filled right before rasterizing as it depends on the shape type and rasterize width
+	ShapeGridTextures grid_textures;
+	create_texture_buffer(GL_RG32I, grid_textures.cell_buffer, grid_textures.cell_texture);
+	create_texture_buffer(GL_R32I, grid_textures.shape_buffer, grid_textures.shape_texture);
 
 	//Create texture for the rasterized shapes
 	GLuint texRasterized;
@@ -247,12 +257,16 @@ int main() {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	// Rasterize the shapes in an intial rendering pass, this only needs to happen once (or after a reset)    
-	rasterize_shape(vao, rasterized_shape_buffer, rasterizeShader, circleUbo, lineUbo, rasterize_width, shape);
+	upload_shape_grid(grid_textures, build_circle_grid(circles, resolution, grid_cell_size, rasterize_width));
+	rasterize_shape(vao, rasterized_shape_buffer, rasterizeShader, circleTexture, lineTexture, grid_textures, rasterize_width, shape);
 
 	//With the shapes rasterized we can start taking samples of our integral
 	//Keep track of the frame nr for the random number generator
 	unsigned int frame_nr = 0;
 
+	//Started while record_frames is set
+	std::optional<FrameCapture> frame_capture;
+
 	while (!pWindow->shouldClose()) {
 		pWindow->updateInput();
 
@@ -270,9 +284,6 @@ int main() {
 			//----- run the sample shader
 			sampleShader.bind();
 
-			sampleShader.bindUniformBlock("circleBuffer", 0, circleUbo);
-			sampleShader.bindUniformBlock("lineBuffer", 1, lineUbo);
-
 			glUniform1ui(sampleShader.getUniformLocation("shape_type"), static_cast<GLuint>(shape));
 
 			glUniform1ui(sampleShader.getUniformLocation("frame_nr"), frame_nr);
@@ -288,6 +299,14 @@ int main() {
 			glBindTexture(GL_TEXTURE_2D, texAccumulator);
 			glUniform1i(sampleShader.getUniformLocation("accumulator_texture"), 1);
 
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_BUFFER, circleTexture);
+			glUniform1i(sampleShader.getUniformLocation("circle_texture"), 2);
+
+			glActiveTexture(GL_TEXTURE3);
+			glBindTexture(GL_TEXTURE_BUFFER, lineTexture);
+			glUniform1i(sampleShader.getUniformLocation("line_texture"), 3);
+
 			glBindFramebuffer(GL_FRAMEBUFFER, accumulator_buffer);
 			glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(6), GL_UNSIGNED_INT, nullptr);
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -414,6 +433,9 @@ int main() {
             //Selector for the output shown on screen
             const char* output_list[3] = { "color_shader", "rasterize_texture", "accumulator_texture" };
             ImGui::Combo("output type", &output_type, output_list, 3);
+
+            //Record frames into the capture folder
+            ImGui::Checkbox("Record frames", &record_frames);
             
             //Buttons to reset textures
             reset_accumulator |= ImGui::Button("reset sample");
@@ -425,14 +447,7 @@ int main() {
             if (redo_circles) {
                 number_of_circles = circles.size();
 
-				glBindBuffer(GL_UNIFORM_BUFFER, circleUbo);
-				//Set buffer size but dont put anything in it just yet
-				glBufferData(GL_UNIFORM_BUFFER, number_of_circles * sizeof(Circle) + 16, NULL, GL_DYNAMIC_DRAW);
-				//put the number of circles in the first 4 bytes to the number of circles
-				glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(int), &number_of_circles);
-				//GLSL data is 16 byte alligned so the actual data starts at byte 16
-				glBufferSubData(GL_UNIFORM_BUFFER, 16, number_of_circles * sizeof(Circle), circles.data());
-				glBindBuffer(GL_UNIFORM_BUFFER, 0);
+				upload_shapes(circleBuffer, circles);
 			}
 
 			//Load a new diffusion curve file
@@ -449,18 +464,7 @@ int main() {
 					lines.insert(lines.begin(), new_lines.begin(), new_lines.end());
 				}
 
-				number_of_lines = (int)lines.size();
-
-				glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-				glBindBuffer(GL_UNIFORM_BUFFER, lineUbo);
-				//Set buffer size but dont put anything in it just yet
-				glBufferData(GL_UNIFORM_BUFFER, number_of_lines * sizeof(Line) + 16, NULL, GL_DYNAMIC_DRAW);
-				//put the number of circles in the first 4 bytes to the number of circles
-				glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(int), &number_of_lines);
-				//GLSL data is 16 byte alligned so the actual data starts at byte 16
-				glBufferSubData(GL_UNIFORM_BUFFER, 16, number_of_lines * sizeof(Line), lines.data());
-				glBindBuffer(GL_UNIFORM_BUFFER, 0);
+				upload_shapes(lineBuffer, lines);
 			}
 
 			//Reset rasterized_texture, and re-rasterize
@@ -472,7 +476,14 @@ int main() {
 				//unbind buffer
 				glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-				rasterize_shape(vao, rasterized_shape_buffer, rasterizeShader, circleUbo, lineUbo, rasterize_width, shape);
+				//Sort the shapes into the grid first, only the current shape type is rasterized
+				if (shape == Shape::Circle) {
+					upload_shape_grid(grid_textures, build_circle_grid(circles, resolution, grid_cell_size, rasterize_width));
+				}
+				else {
+					upload_shape_grid(grid_textures, build_line_grid(lines, resolution, grid_cell_size, rasterize_width));
+				}
+				rasterize_shape(vao, rasterized_shape_buffer, rasterizeShader, circleTexture, lineTexture, grid_textures, rasterize_width, shape);
 			}
 
 			//Reset the acummulator texture
@@ -489,19 +500,95 @@ int main() {
 
 		}
 
+		//Capture before swapping buffers, as the menu is drawn when swapping
+		if (record_frames && !frame_capture) {
+			FrameCaptureSettings capture_settings;
+			capture_settings.outputDirectory = capture_folder;
+			frame_capture.emplace(capture_settings);
+		}
+		else if (!record_frames && frame_capture) {
+			frame_capture->finish();
+			std::cout << "Captured " << frame_capture->numFramesCaptured() << " frames into " << capture_folder << " (" << frame_capture->numFramesDropped() << " dropped)" << std::endl;
+			frame_capture.reset();
+		}
+		if (frame_capture) {
+			frame_capture->captureFrame(pWindow->getFrameBufferSize());
+		}
+
 		pWindow->swapBuffers();
 	}
 }
 
+//Function to create a buffer and a texture reading it as an array of texels of the given format
+void create_texture_buffer(GLenum internal_format, GLuint& buffer, GLuint& texture) {
+	//Buffers only exist once bound, before that they can't be attached to a texture
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, internal_format, buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+//Function to fill a shape texture buffer, sized to the number of shapes
+template <typename T>
+void upload_shapes(const GLuint& buffer, const std::vector<T>& shapes) {
+	static_assert(sizeof(T) % sizeof(glm::vec4) == 0, "Shapes are read as whole RGBA32F texels");
+
+	//Texture buffers are limited in texels rather than bytes, the limit is at least 65536 texels
+	GLint max_texels;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+	size_t texels_per_shape = sizeof(T) / sizeof(glm::vec4);
+	if (max_texels > 0 && shapes.size() * texels_per_shape > static_cast<size_t>(max_texels)) {
+		std::cerr << "Only " << static_cast<size_t>(max_texels) / texels_per_shape << " of " << shapes.size() << " shapes fit in a texture buffer" << std::endl;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	//Keep at least one shape, even if there are none
+	glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(shapes.size(), 1) * sizeof(T)), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(shapes.size() * sizeof(T)), shapes.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+//Function to fill the grid texture buffers
+void upload_shape_grid(ShapeGridTextures& grid_textures, const ShapeGrid& grid) {
+	grid_textures.cell_size = grid.cell_size;
+	grid_textures.cell_count = grid.cell_count;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, grid_textures.cell_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(grid.cells.size() * sizeof(glm::ivec2)), grid.cells.data(), GL_DYNAMIC_DRAW);
+	//Keep at least one element, even if no shape is on screen
+	glBindBuffer(GL_TEXTURE_BUFFER, grid_textures.shape_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(grid.shapes.size(), 1) * sizeof(int)), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(grid.shapes.size() * sizeof(int)), grid.shapes.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
 //Function to create the rasterized_texture texture
-void rasterize_shape(const GLuint& VAO, const GLuint& frameBuffer, const Shader& shader, const GLuint& circleBuffer, const GLuint& lineBuffer, const float& line_width, const Shape& shapetype) {
+void rasterize_shape(const GLuint& VAO, const GLuint& frameBuffer, const Shader& shader, const GLuint& circleTexture, const GLuint& lineTexture, const ShapeGridTextures& grid_textures, const float& line_width, const Shape& shapetype) {
 	//Bind all the data
 	glBindVertexArray(VAO);
 	shader.bind();
-	shader.bindUniformBlock("circleBuffer", 0, circleBuffer);
-	shader.bindUniformBlock("lineBuffer", 1, lineBuffer);
 	glUniform1ui(shader.getUniformLocation("shape_type"), static_cast<GLuint>(shapetype));
 	glUniform1f(shader.getUniformLocation("rasterize_width"), line_width);
+
+	glUniform1i(shader.getUniformLocation("grid_cell_size"), grid_textures.cell_size);
+	glUniform2iv(shader.getUniformLocation("grid_cell_count"), 1, glm::value_ptr(grid_textures.cell_count));
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, grid_textures.cell_texture);
+	glUniform1i(shader.getUniformLocation("grid_cells"), 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, grid_textures.shape_texture);
+	glUniform1i(shader.getUniformLocation("grid_shapes"), 1);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_BUFFER, circleTexture);
+	glUniform1i(shader.getUniformLocation("circle_texture"), 2);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_BUFFER, lineTexture);
+	glUniform1i(shader.getUniformLocation("line_texture"), 3);
+
 	//Bind the rasterized shape framebuffer do the rendering pass and unbind the buffer
 	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
 	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(6), GL_UNSIGNED_INT, nullptr);
@@ -17,6 +17,13 @@ void pushColor(rapidxml::xml_node<>* color_node, std::vector<glm::uvec2>& ind, s
 void linearize_bezier_curve_helper(BezierCurve curve, float tolerance, std::vector<Line>& lines, int max_depth);
 std::array<BezierCurve, 2> split_curve(BezierCurve curve, float alpha);
 bool is_curve_flat(BezierCurve curve, float tolerance);
+ShapeGrid create_grid(glm::ivec2 resolution, int cell_size, std::vector<std::vector<int>>& cell_shapes);
+bool overlapped_cells(const ShapeGrid& grid, glm::vec2 box_min, glm::vec2 box_max, glm::ivec2& first_cell, glm::ivec2& last_cell);
+bool segment_overlaps_box(glm::vec2 start, glm::vec2 end, glm::vec2 box_min, glm::vec2 box_max);
+void flatten_grid(ShapeGrid& grid, const std::vector<std::vector<int>>& cell_shapes);
+
+//Shapes are sorted into the grid with a slightly larger width, so pixels right at the rasterize width are not missed due to rounding
+constexpr float grid_width_margin = 0.01f;
 
 void load_Bezier_curves(std::vector<BezierCurve>& curves, const char* path, glm::ivec2 resolution) {
 	//rapidxml boilerplate
@@ -341,6 +348,120 @@ bool is_curve_flat(BezierCurve curve, float tolerance) {
 	return (fmaxf(u.x, v.x) + fmaxf(u.y, v.y) <= tolerance);
 }
 
+ShapeGrid build_circle_grid(const std::vector<Circle>& circles, glm::ivec2 resolution, int cell_size, float rasterize_width) {
+	std::vector<std::vector<int>> cell_shapes;
+	ShapeGrid grid = create_grid(resolution, cell_size, cell_shapes);
+	float width = rasterize_width + grid_width_margin;
+
+	for (int i = 0; i < (int)circles.size(); i++) {
+		const Circle& circle = circles[static_cast<size_t>(i)];
+		float outer_radius = circle.radius + width;
+		float inner_radius = circle.radius - width;
+
+		glm::ivec2 first_cell, last_cell;
+		if (!overlapped_cells(grid, circle.position - outer_radius, circle.position + outer_radius, first_cell, last_cell)) {
+			continue;
+		}
+		for (int y = first_cell.y; y <= last_cell.y; y++) {
+			for (int x = first_cell.x; x <= last_cell.x; x++) {
+				//Pixel centers of the cell, integer as set by pixel_center_integer, up to half a pixel further if the layout is not honoured
+				glm::vec2 cell_min = glm::vec2(x, y) * (float)cell_size;
+				glm::vec2 cell_max = cell_min + ((float)cell_size - 0.5f);
+
+				//The ring overlaps the cell if the nearest point of the cell is inside the outer radius and the farthest outside the inner radius
+				float min_distance = glm::distance(glm::clamp(circle.position, cell_min, cell_max), circle.position);
+				float max_distance = glm::length(glm::max(glm::abs(circle.position - cell_min), glm::abs(circle.position - cell_max)));
+				if (min_distance <= outer_radius && max_distance >= inner_radius) {
+					cell_shapes[static_cast<size_t>(y * grid.cell_count.x + x)].push_back(i);
+				}
+			}
+		}
+	}
+
+	flatten_grid(grid, cell_shapes);
+	return grid;
+}
+
+ShapeGrid build_line_grid(const std::vector<Line>& lines, glm::ivec2 resolution, int cell_size, float rasterize_width) {
+	std::vector<std::vector<int>> cell_shapes;
+	ShapeGrid grid = create_grid(resolution, cell_size, cell_shapes);
+	float width = rasterize_width + grid_width_margin;
+
+	for (int i = 0; i < (int)lines.size(); i++) {
+		const Line& line = lines[static_cast<size_t>(i)];
+
+		glm::ivec2 first_cell, last_cell;
+		if (!overlapped_cells(grid, glm::min(line.start_point, line.end_point) - width, glm::max(line.start_point, line.end_point) + width, first_cell, last_cell)) {
+			continue;
+		}
+		for (int y = first_cell.y; y <= last_cell.y; y++) {
+			for (int x = first_cell.x; x <= last_cell.x; x++) {
+				//Pixel centers of the cell, integer as set by pixel_center_integer, up to half a pixel further if the layout is not honoured
+				glm::vec2 cell_min = glm::vec2(x, y) * (float)cell_size;
+				glm::vec2 cell_max = cell_min + ((float)cell_size - 0.5f);
+
+				//A pixel within width of the line has a point of the line within width of it on both axes,
+				//so the line overlaps the cell if it passes through the cell grown by width
+				if (segment_overlaps_box(line.start_point, line.end_point, cell_min - width, cell_max + width)) {
+					cell_shapes[static_cast<size_t>(y * grid.cell_count.x + x)].push_back(i);
+				}
+			}
+		}
+	}
+
+	flatten_grid(grid, cell_shapes);
+	return grid;
+}
+
+//Helper function to create a grid without shapes covering the resolution, and an empty shape list for each of its cells
+ShapeGrid create_grid(glm::ivec2 resolution, int cell_size, std::vector<std::vector<int>>& cell_shapes) {
+	ShapeGrid grid;
+	grid.cell_size = std::max(cell_size, 1);
+	grid.cell_count = glm::max((resolution + grid.cell_size - 1) / grid.cell_size, glm::ivec2(1));
+	cell_shapes.assign(static_cast<size_t>(grid.cell_count.x * grid.cell_count.y), {});
+	return grid;
+}
+
+//Helper function to find the range of cells containing the box from box_min to box_max, returns false if none do
+bool overlapped_cells(const ShapeGrid& grid, glm::vec2 box_min, glm::vec2 box_max, glm::ivec2& first_cell, glm::ivec2& last_cell) {
+	first_cell = glm::max(glm::ivec2(glm::floor(box_min / (float)grid.cell_size)), glm::ivec2(0));
+	last_cell = glm::min(glm::ivec2(glm::floor(box_max / (float)grid.cell_size)), grid.cell_count - 1);
+	return first_cell.x <= last_cell.x && first_cell.y <= last_cell.y;
+}
+
+//Helper function to check if the segment from start to end passes through the box from box_min to box_max, by clipping it to the box one axis at a time
+bool segment_overlaps_box(glm::vec2 start, glm::vec2 end, glm::vec2 box_min, glm::vec2 box_max) {
+	glm::vec2 direction = end - start;
+	float t_min = 0.0f;
+	float t_max = 1.0f;
+
+	for (int axis = 0; axis < 2; axis++) {
+		//A segment parallel to the axis is either entirely between the box sides or not at all
+		if (direction[axis] == 0.0f) {
+			if (start[axis] < box_min[axis] || start[axis] > box_max[axis]) {
+				return false;
+			}
+			continue;
+		}
+		float t_0 = (box_min[axis] - start[axis]) / direction[axis];
+		float t_1 = (box_max[axis] - start[axis]) / direction[axis];
+		t_min = std::max(t_min, std::min(t_0, t_1));
+		t_max = std::min(t_max, std::max(t_0, t_1));
+	}
+
+	return t_min <= t_max;
+}
+
+//Helper function to concatenate the shape lists of all cells into the grid
+void flatten_grid(ShapeGrid& grid, const std::vector<std::vector<int>>& cell_shapes) {
+	grid.cells.clear();
+	grid.shapes.clear();
+	for (const std::vector<int>& shapes : cell_shapes) {
+		grid.cells.push_back({ (int)grid.shapes.size(), (int)shapes.size() });
+		grid.shapes.insert(grid.shapes.end(), shapes.begin(), shapes.end());
+	}
+}
+
 //Helper functionf for reading colors from diffusion curve file
 void pushColor(rapidxml::xml_node<>* color_node, std::vector<glm::uvec2>& ind, std::vector<float>& color_u, std::vector<glm::vec3>& color) {
 	float u = (float) (std::atof(color_node->first_attribute("globalID", 8)->value()) / 10.0f);
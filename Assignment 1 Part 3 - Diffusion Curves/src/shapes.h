@@ -10,7 +10,7 @@ enum class Shape {
 };
 
 // Be sure to know what you are doing when editing these structs!
-// Opengl std140 requires them to be 16 byte alligned, while MSVC alligns structs by 4 bytes
+// The shaders read them from texture buffers as RGBA32F texels, so their size has to be a multiple of 16 bytes, while MSVC alligns structs by 4 bytes
 
 // Struct for the circle, with position, radius, id and color
 struct Circle {
@@ -51,3 +51,31 @@ void load_Bezier_curves(std::vector<BezierCurve>& curves, const char* path, glm:
 /// <param name="max_depth">Stop after max_depth sub_divisions </param>
 /// <returns>The set of lines that approximate the curve</returns>
 std::vector<Line> linearize_bezier_curve(BezierCurve curve, float tolerance, int max_depth = INT_MAX);
+
+// Uniform grid over the screen listing, for every cell, the shapes that may rasterize into one of its pixels
+// Shape indices of a cell are ascending, so the first hit in a cell is the same as when testing all shapes in order
+struct ShapeGrid {
+	int cell_size;
+	glm::ivec2 cell_count;
+	std::vector<glm::ivec2> cells;	// Offset into shapes (x) and number of shapes (y) of every cell, row by row
+	std::vector<int> shapes;		// Shape indices of all cells
+};
+
+/// <summary>
+/// Builds the grid of the circles whose ring of pixels within rasterize_width of the circle overlaps each cell
+/// </summary>
+/// <param name="circles">The circles to sort into the grid</param>
+/// <param name="resolution">The resolution the circles are rasterized at</param>
+/// <param name="cell_size">Width and height of a cell in pixels</param>
+/// <param name="rasterize_width">The maximum distance from a circle for a pixel to be part of it</param>
+/// <returns>The grid covering the resolution</returns>
+ShapeGrid build_circle_grid(const std::vector<Circle>& circles, glm::ivec2 resolution, int cell_size, float rasterize_width);
+/// <summary>
+/// Builds the grid of the lines whose pixels within rasterize_width of the line overlap each cell
+/// </summary>
+/// <param name="lines">The lines to sort into the grid</param>
+/// <param name="resolution">The resolution the lines are rasterized at</param>
+/// <param name="cell_size">Width and height of a cell in pixels</param>
+/// <param name="rasterize_width">The maximum distance from a line for a pixel to be part of it</param>
+/// <returns>The grid covering the resolution</returns>
+ShapeGrid build_line_grid(const std::vector<Line>& lines, glm::ivec2 resolution, int cell_size, float rasterize_width);